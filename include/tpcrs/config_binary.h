@@ -0,0 +1,362 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tpcrs/config_type.h"
+
+
+namespace tpcrs {
+
+/**
+ * Identifies the layout of a configuration struct stored in a binary snapshot.
+ * The rows of a struct are stored as they are in memory, and a snapshot is
+ * accepted only if the version of every struct matches the one it was written
+ * with. The specializations are generated by util/struct2yamlcpp.py --binary
+ */
+template<typename Struct> struct BinaryCodec;
+
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcCalibResolutions> {
+  static uint32_t version() { return 0x22f54402; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<MDFCorrection> {
+  static uint32_t version() { return 0x1507225a; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcGlobalPosition> {
+  static uint32_t version() { return 0xe7157fd3; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcRDOMasks> {
+  static uint32_t version() { return 0x95516d7b; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tss_tsspar> {
+  static uint32_t version() { return 0xf6d1af86; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcOmegaTau> {
+  static uint32_t version() { return 0x750bf8d0; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcFieldCageShort> {
+  static uint32_t version() { return 0x1da1d693; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<g2t_tpc_hit> {
+  static uint32_t version() { return 0x64fb6cfe; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<TpcSecRowCor> {
+  static uint32_t version() { return 0x654d53b4; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcRDOMap> {
+  static uint32_t version() { return 0xb4378c06; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcAnodeHVavg> {
+  static uint32_t version() { return 0x1f100851; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcFieldCage> {
+  static uint32_t version() { return 0xc18364dd; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<trigDetSums> {
+  static uint32_t version() { return 0x4d3d9cbe; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcPadPlanes> {
+  static uint32_t version() { return 0x44d9a942; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcDriftVelocity> {
+  static uint32_t version() { return 0xbe8b0c1a; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<starClockOnl> {
+  static uint32_t version() { return 0x9bef8cf6; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcWirePlanes> {
+  static uint32_t version() { return 0x4949ddaa; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcSectorT0offset> {
+  static uint32_t version() { return 0x9dbb831b; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcHighVoltages> {
+  static uint32_t version() { return 0x60bba2da; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcCorrection> {
+  static uint32_t version() { return 0x5886dc41; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<g2t_track> {
+  static uint32_t version() { return 0x55315f7c; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<TpcEffectivedX> {
+  static uint32_t version() { return 0xd5389127; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcSCGL> {
+  static uint32_t version() { return 0xb0cca98a; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcHVPlanes> {
+  static uint32_t version() { return 0x5cc0e0ea; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcAltroParams> {
+  static uint32_t version() { return 0x95c5bb5d; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcGridLeak> {
+  static uint32_t version() { return 0xfe79f627; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<g2t_vertex> {
+  static uint32_t version() { return 0xbad631b8; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<TpcAvgCurrent> {
+  static uint32_t version() { return 0x6345fc71; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<spaceChargeCor> {
+  static uint32_t version() { return 0xe531f0e2; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcEffectiveGeom> {
+  static uint32_t version() { return 0xecafcc37; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<TpcResponseSimulator> {
+  static uint32_t version() { return 0xe1e25377; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<ResponseSimulator> {
+  static uint32_t version() { return 0xd66b60a4; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcElectronics> {
+  static uint32_t version() { return 0x0fde054b; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<Survey> {
+  static uint32_t version() { return 0x1f83b891; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<MagFactor> {
+  static uint32_t version() { return 0xcb1d9499; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<TpcAvgPowerSupply> {
+  static uint32_t version() { return 0x96d2d504; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcAnodeHV> {
+  static uint32_t version() { return 0xbd41cdc7; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcPadGainT0> {
+  static uint32_t version() { return 0xad14f8c4; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<asic_thresholds> {
+  static uint32_t version() { return 0x64f9e759; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcDimensions> {
+  static uint32_t version() { return 0xff2691eb; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcGas> {
+  static uint32_t version() { return 0x04ec5f3e; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<trgTimeOffset> {
+  static uint32_t version() { return 0x7441efa5; }
+};
+}
+
+
+namespace tpcrs {
+template<>
+struct BinaryCodec<tpcPadrowT0> {
+  static uint32_t version() { return 0x6e7b255d; }
+};
+}
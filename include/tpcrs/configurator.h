@@ -1,15 +1,160 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "yaml-cpp/yaml.h"
 #include "tpcrs/config_type.h"
 #include "tpcrs/config_yaml.h"
+#include "tpcrs/config_binary.h"
+
+
+// The chairs available via Configurator::C()
+struct StTpcOuterSectorPosition;
+struct StTpcSuperSectorPosition;
+struct St_TpcAdcCorrectionBC;
+struct St_TpcAdcCorrectionMDF;
+struct St_TpcAvgCurrentC;
+struct St_TpcAvgPowerSupplyC;
+struct St_TpcCurrentCorrectionC;
+struct St_TpcDriftDistOxygenC;
+struct St_TpcEdgeC;
+struct St_TpcEffectivedXC;
+struct St_TpcLengthCorrectionBC;
+struct St_TpcLengthCorrectionMDF;
+struct St_TpcMultiplicityC;
+struct St_TpcPadCorrectionMDF;
+struct St_TpcPhiDirectionC;
+struct St_TpcRowQC;
+struct St_TpcSecRowBC;
+struct St_TpcSecRowCC;
+struct St_TpcSpaceChargeC;
+struct St_TpcTanLC;
+struct St_TpcZCorrectionBC;
+struct St_TpcZDCC;
+struct St_TpcdChargeC;
+struct St_TpcdXCorrectionBC;
+struct St_TpcrChargeC;
+struct St_spaceChargeCorR1C;
+struct St_spaceChargeCorR2C;
+struct St_tpcFieldCageShortC;
+struct St_tpcGainCorrectionC;
+struct St_tpcGasTemperatureC;
+struct St_tpcGridLeakC;
+struct St_tpcMethaneInC;
+struct St_tpcPressureBC;
+struct St_tpcSCGLC;
+struct St_tpcTimeDependenceC;
+struct St_tpcWaterOutC;
 
 
 namespace tpcrs {
 
+namespace detail { class MappedFile; }
+
+struct IConfigStruct;
+
+template<typename... Ts> struct TypeList {};
+
+/// The position of type T in a TypeList known at compile time
+template<typename T, typename List> struct TypeIndex;
+
+template<typename T, typename... Ts>
+struct TypeIndex<T, TypeList<T, Ts...>> : std::integral_constant<size_t, 0> {};
+
+template<typename T, typename U, typename... Ts>
+struct TypeIndex<T, TypeList<U, Ts...>> : std::integral_constant<size_t, 1 + TypeIndex<T, TypeList<Ts...>>::value> {};
+
+/// True if type T is in a TypeList
+template<typename T, typename List> struct TypeContains;
+
+template<typename T>
+struct TypeContains<T, TypeList<>> : std::false_type {};
+
+template<typename T, typename U, typename... Ts>
+struct TypeContains<T, TypeList<U, Ts...>> :
+  std::integral_constant<bool, std::is_same<T, U>::value || TypeContains<T, TypeList<Ts...>>::value> {};
+
+template<typename List> struct TypeCount;
+
+template<typename... Ts>
+struct TypeCount<TypeList<Ts...>> : std::integral_constant<size_t, sizeof...(Ts)> {};
+
+/// The structs available via Configurator::S()
+using ConfigStructTypes = TypeList<
+  trigDetSums,
+  asic_thresholds,
+  ResponseSimulator,
+  tpcAltroParams,
+  tpcAnodeHVavg,
+  tpcCalibResolutions,
+  tpcDriftVelocity,
+  tpcEffectiveGeom,
+  tpcElectronics,
+  tpcGas,
+  tpcHighVoltages,
+  tpcOmegaTau,
+  tpcPadGainT0,
+  tpcPadrowT0,
+  tpcSectorT0offset,
+  TpcResponseSimulator,
+  trgTimeOffset,
+  tpcDimensions,
+  tpcGlobalPosition,
+  tpcPadPlanes,
+  tpcWirePlanes,
+  MagFactor,
+  starClockOnl,
+  tss_tsspar
+>;
+
+using ConfigChairTypes = TypeList<
+  StTpcOuterSectorPosition,
+  StTpcSuperSectorPosition,
+  St_TpcAdcCorrectionBC,
+  St_TpcAdcCorrectionMDF,
+  St_TpcAvgCurrentC,
+  St_TpcAvgPowerSupplyC,
+  St_TpcCurrentCorrectionC,
+  St_TpcDriftDistOxygenC,
+  St_TpcEdgeC,
+  St_TpcEffectivedXC,
+  St_TpcLengthCorrectionBC,
+  St_TpcLengthCorrectionMDF,
+  St_TpcMultiplicityC,
+  St_TpcPadCorrectionMDF,
+  St_TpcPhiDirectionC,
+  St_TpcRowQC,
+  St_TpcSecRowBC,
+  St_TpcSecRowCC,
+  St_TpcSpaceChargeC,
+  St_TpcTanLC,
+  St_TpcZCorrectionBC,
+  St_TpcZDCC,
+  St_TpcdChargeC,
+  St_TpcdXCorrectionBC,
+  St_TpcrChargeC,
+  St_spaceChargeCorR1C,
+  St_spaceChargeCorR2C,
+  St_tpcFieldCageShortC,
+  St_tpcGainCorrectionC,
+  St_tpcGasTemperatureC,
+  St_tpcGridLeakC,
+  St_tpcMethaneInC,
+  St_tpcPressureBC,
+  St_tpcSCGLC,
+  St_tpcTimeDependenceC,
+  St_tpcWaterOutC
+>;
+
+
 template<typename Struct> std::string ConfigNodeName() { return "undefined"; };
 
 template<> std::string ConfigNodeName<trigDetSums>();
@@ -39,57 +184,308 @@ template<> std::string ConfigNodeName<tss_tsspar>();
 
 
 /**
- * Provides access to all configuration types and data loaded from a yaml file.
+ * Provides access to all configuration types and data loaded from a yaml file
+ * or from a binary snapshot of one.
+ *
+ * The structs in ConfigStructTypes and the chairs in ConfigChairTypes are
+ * decoded once at construction and stored in this Configurator. They are
+ * found by an index known at compile time, so the lookups are plain reads
+ * and any number of Configurators can be used concurrently. The chairs refer
+ * to their Configurator, which is therefore neither copied nor moved.
+ *
+ * A snapshot is memory-mapped and the struct rows are used in place, so the
+ * pages of large arrays are read only when the values are accessed.
+ *
+ * A Configurator can overlay a base configuration with a file holding only
+ * the replaced nodes. The rows of the other nodes are those of the base and
+ * are used by reference, so many run configurations differing in a few
+ * conditions share one copy of the geometry and the pad gains. So are the
+ * chairs of the base, which refer to the base, unless they depend on a
+ * replaced node.
  */
 class Configurator
 {
  public:
 
+  /**
+   * Loads the configuration from filename or, if empty, from cfgname.yaml
+   * found in the search paths. A file with the .bin extension is read as a
+   * snapshot written by WriteSnapshot().
+   */
   Configurator(std::string cfgname, std::string filename = "");
 
+  /**
+   * Loads the nodes replacing those of base from filename as above. The base
+   * is kept alive by this Configurator.
+   */
+  Configurator(std::shared_ptr<const Configurator> base, std::string cfgname, std::string filename = "");
+
+  ~Configurator();
+
+  Configurator(const Configurator&) = delete;
+  Configurator& operator=(const Configurator&) = delete;
+
   std::string Locate(std::string filename) const;
 
-  YAML::Node YAML(std::string taxon) const { return yaml[taxon]; }
+  /// Returns the yaml node of this configuration or, if missing, of the base
+  YAML::Node YAML(std::string taxon) const
+  {
+    return yaml[taxon] || !base_ ? yaml[taxon] : base_->YAML(taxon);
+  }
 
   template<typename Chair>
   Chair& C() const
   {
-    static Chair c(*this);
+    return static_cast<Chair&>(*chairs_[TypeIndex<Chair, ConfigChairTypes>::value]);
+  }
+
+  /// Throws if the configuration does not have a node for the struct
+  template<typename Struct>
+  const Struct& S(int i = 0) const
+  {
+    const RowSpan<Struct>& rows = std::get<TypeIndex<Struct, ConfigStructTypes>::value>(structs_);
 
-    if (this != &c.cfg_)
-      c = Chair(*this);
+    if (rows.size == 0)
+      throw std::runtime_error("Configurator: No " + ConfigNodeName<Struct>() + " in " + name);
 
-    return c;
+    return rows.data[i];
   }
 
+  /**
+   * Returns true if the rows of the struct or chair are the same object in
+   * both configurations, e.g. if neither overlays the node of a common base.
+   * The quantities derived from the rows can then be reused.
+   */
+  template<typename T>
+  bool Shares(const Configurator& other) const
+  {
+    return Shares<T>(other, TypeContains<T, ConfigStructTypes>());
+  }
+
+  /**
+   * Returns true if each of the structs and chairs Ts has the same rows in
+   * both configurations, i.e. the rows are shared or equal byte by byte.
+   * Unlike Shares() it also finds the unchanged rows of configurations loaded
+   * independently.
+   */
+  template<typename... Ts>
+  bool Same(const Configurator& other) const
+  {
+    bool same[] = {true, Same<Ts>(other, TypeContains<Ts, ConfigStructTypes>())...};
+
+    for (bool s : same)
+      if (!s) return false;
+
+    return true;
+  }
+
+  /// Returns a copy of the rows at the node or no rows if it is not configured
   template<typename Struct>
-  const Struct& S(int i = 0) const
+  std::vector<Struct> Rows(const std::string& node) const
   {
-    static std::vector<Struct> rows;
-    static std::string name{ConfigNodeName<Struct>()};
-  
-    if (rows.size()) {
-      return rows[i];
-    }
-    else {
-      try {
-        rows.push_back( YAML(name).as<Struct>() );
-      } catch (std::exception& e) {
-        rows = YAML(name).as< std::vector<Struct> >();
-      }
+    if (!HasNode(node))
+      return base_ ? base_->Rows<Struct>(node) : std::vector<Struct>();
+
+    if (snapshot_) {
+      size_t n_rows = 0;
+      const Struct* rows = static_cast<const Struct*>(
+        SnapshotRows(node, BinaryCodec<Struct>::version(), sizeof(Struct), n_rows));
+      return std::vector<Struct>(rows, rows + n_rows);
     }
-  
-    return rows[i];
+
+    return Decode<Struct>(node);
+  }
+
+  /**
+   * Returns a copy of the rows of the chair or no rows if it is not
+   * configured. The rows of the chairs in ConfigChairTypes were decoded at
+   * construction, the others are decoded from the node.
+   */
+  template<typename Chair, typename Struct>
+  std::vector<Struct> ChairRows(const std::string& node) const
+  {
+    return ChairRows<Chair, Struct>(node, TypeContains<Chair, ConfigChairTypes>());
   }
 
+  /**
+   * Returns the content of the node in a form suitable for hashing or an
+   * empty string if the node is not configured. The form depends on whether
+   * the configuration was loaded from yaml or from a snapshot.
+   */
+  std::string Serialized(const std::string& node) const;
+
+  /**
+   * Writes the structs and the chairs present in this configuration to a
+   * binary snapshot at path. The nodes of the base are included. Returns
+   * false if the file cannot be written.
+   */
+  bool WriteSnapshot(const std::string& path) const;
+
  private:
 
+  /// Rows decoded from yaml, stored in a snapshot, or those of the base
+  template<typename Struct>
+  struct RowSpan
+  {
+    RowSpan() : data(nullptr), size(0), decoded() {}
+
+    const Struct* data;
+    size_t size;
+
+    /// The storage of the rows decoded from yaml
+    std::shared_ptr<const void> decoded;
+  };
+
+  template<typename List> struct Store;
+
+  template<typename... Structs>
+  struct Store<TypeList<Structs...>> { using type = std::tuple<RowSpan<Structs>...>; };
+
+  template<typename Chair, typename Struct>
+  std::vector<Struct> ChairRows(const std::string&, std::true_type) const
+  {
+    const RowSpan<void>& rows = chair_rows_[TypeIndex<Chair, ConfigChairTypes>::value];
+    const Struct* data = static_cast<const Struct*>(rows.data);
+    return std::vector<Struct>(data, data + rows.size);
+  }
+
+  template<typename Chair, typename Struct>
+  std::vector<Struct> ChairRows(const std::string& node, std::false_type) const
+  {
+    return Rows<Struct>(node);
+  }
+
+  template<typename Struct>
+  bool Shares(const Configurator& other, std::true_type) const
+  {
+    return std::get<TypeIndex<Struct, ConfigStructTypes>::value>(structs_).data ==
+           std::get<TypeIndex<Struct, ConfigStructTypes>::value>(other.structs_).data;
+  }
+
+  template<typename Chair>
+  bool Shares(const Configurator& other, std::false_type) const
+  {
+    return chair_rows_[TypeIndex<Chair, ConfigChairTypes>::value].data ==
+           other.chair_rows_[TypeIndex<Chair, ConfigChairTypes>::value].data;
+  }
+
+  template<typename Struct>
+  bool Same(const Configurator& other, std::true_type) const
+  {
+    const RowSpan<Struct>& rows = std::get<TypeIndex<Struct, ConfigStructTypes>::value>(structs_);
+    const RowSpan<Struct>& other_rows = std::get<TypeIndex<Struct, ConfigStructTypes>::value>(other.structs_);
+    return SameRows(rows.data, rows.size, other_rows.data, other_rows.size, sizeof(Struct));
+  }
+
+  template<typename Chair>
+  bool Same(const Configurator& other, std::false_type) const
+  {
+    const RowSpan<void>& rows = chair_rows_[TypeIndex<Chair, ConfigChairTypes>::value];
+    const RowSpan<void>& other_rows = other.chair_rows_[TypeIndex<Chair, ConfigChairTypes>::value];
+    return SameRows(rows.data, rows.size, other_rows.data, other_rows.size, sizeof(typename Chair::struct_type));
+  }
+
+  static bool SameRows(const void* rows, size_t n_rows, const void* other_rows, size_t n_other_rows, size_t row_size)
+  {
+    return n_rows == n_other_rows && (rows == other_rows || n_rows == 0 ||
+                                      std::memcmp(rows, other_rows, n_rows * row_size) == 0);
+  }
+
+  template<typename... Structs> void DecodeStructs(TypeList<Structs...>);
+  template<typename... Chairs> void DecodeChairs(TypeList<Chairs...>);
+  template<typename... Chairs> void CreateChairs(TypeList<Chairs...>);
+
+  /// Returns true if the chair of the base can be used in this configuration
+  template<typename Chair, typename... Dependencies>
+  bool ReusesBaseChair(TypeList<Dependencies...>) const
+  {
+    bool shares[] = {base_ && Shares<Chair>(*base_), (base_ && Shares<Dependencies>(*base_))...};
+
+    for (bool s : shares)
+      if (!s) return false;
+
+    return true;
+  }
+
+  /**
+   * Sets rows to the rows of the node in this configuration or, if missing,
+   * to base_rows
+   */
+  template<typename Struct, typename Span>
+  void DecodeRows(const std::string& node, Span& rows, const Span* base_rows)
+  {
+    if (!HasNode(node)) {
+      if (base_rows) rows = *base_rows;
+      return;
+    }
+
+    if (snapshot_) {
+      rows.data = static_cast<decltype(rows.data)>(
+        SnapshotRows(node, BinaryCodec<Struct>::version(), sizeof(Struct), rows.size));
+    } else {
+      std::shared_ptr<std::vector<Struct>> decoded(new std::vector<Struct>(Decode<Struct>(node)));
+      rows.data = decoded->data();
+      rows.size = decoded->size();
+      rows.decoded = decoded;
+    }
+  }
+
+  /**
+   * Decodes the struct or the sequence of structs at the node. The rows are
+   * value-initialized first so that their padding is zero and equal rows
+   * compare equal byte by byte in Same()
+   */
+  template<typename Struct>
+  std::vector<Struct> Decode(const std::string& node) const
+  {
+    YAML::Node values = yaml[node];
+    std::vector<Struct> rows(values.IsSequence() ? values.size() : 1);
+
+    for (size_t i = 0; i < rows.size(); i++) {
+      YAML::Node value = values.IsSequence() ? values[i] : values;
+
+      if (!YAML::convert<Struct>::decode(value, rows[i]))
+        throw YAML::TypedBadConversion<Struct>(value.Mark());
+    }
+
+    return rows;
+  }
+
+  /// Returns true if the node is configured in this layer
+  bool HasNode(const std::string& node) const;
+
+  /// Validates the header and the table of contents of a mapped snapshot
+  void MapSnapshot(const std::string& path);
+
+  /**
+   * Returns the rows of the node in the snapshot and sets n_rows. Returns
+   * null if the node is not in the snapshot and throws if it was written with
+   * a different version or size of the struct.
+   */
+  const void* SnapshotRows(const std::string& node, uint32_t version, size_t struct_size, size_t& n_rows) const;
+
   /// A unique name associated with this Configurator
   std::string name;
 
   std::vector<std::string> search_paths;
 
   YAML::Node yaml;
+
+  std::unique_ptr<detail::MappedFile> snapshot_;
+
+  /// The configuration overlaid by this one
+  std::shared_ptr<const Configurator> base_;
+
+  /// The rows of every struct in ConfigStructTypes. Empty if not configured
+  Store<ConfigStructTypes>::type structs_;
+
+  /// The rows of every chair in ConfigChairTypes. Empty if not configured
+  std::vector<RowSpan<void>> chair_rows_;
+
+  /// An instance of every chair in ConfigChairTypes. The chairs of the base
+  /// are shared unless this configuration replaces their nodes or the ones
+  /// they depend on
+  std::vector<std::shared_ptr<IConfigStruct>> chairs_;
 };
 
 }
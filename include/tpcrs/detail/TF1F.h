@@ -7,15 +7,15 @@ class TF1F : public TF1
 {
  public:
 #if ROOT_VERSION_CODE < 393216 /* = ROOT_VERSION(6,0,0) */
-  TF1F() : TF1()     {fNpx       = 200;}
+  TF1F() : TF1(), fSaveL(nullptr)     {fNpx       = 200;}
   TF1F(const char* name, const char* formula, double xmin = 0, double xmax = 1) :
-    TF1(name, formula, xmin, xmax), fdX(-1), fStep(-1) {fNpx       = 200;}
+    TF1(name, formula, xmin, xmax), fdX(-1), fStep(-1), fSaveL(nullptr) {fNpx       = 200;}
   TF1F(const char* name, double xmin, double xmax, int npar) :
-    TF1(name, xmin, xmax, npar), fdX(-1), fStep(-1) {fNpx       = 200;}
+    TF1(name, xmin, xmax, npar), fdX(-1), fStep(-1), fSaveL(nullptr) {fNpx       = 200;}
   TF1F(const char* name, void* fcn, double xmin, double xmax, int npar) :
-    TF1(name, fcn, xmin, xmax, npar), fdX(-1), fStep(-1) {fNpx       = 200;}
+    TF1(name, fcn, xmin, xmax, npar), fdX(-1), fStep(-1), fSaveL(nullptr) {fNpx       = 200;}
   TF1F(const char* name, double (*fcn)(double*, double*), double xmin = 0, double xmax = 1, int npar = 0) :
-    TF1(name, fcn, xmin, xmax, npar), fdX(-1), fStep(-1) {fNpx       = 200;};
+    TF1(name, fcn, xmin, xmax, npar), fdX(-1), fStep(-1), fSaveL(nullptr) {fNpx       = 200;};
 #else /* ROOT 6 */
   TF1F();
   TF1F(const char* name, const char* formula, double xmin = 0, double xmax = 1);
@@ -30,7 +30,7 @@ class TF1F : public TF1
   // MemFn.
   template <class PtrObj, typename MemFn>
   TF1F(const char* name, const  PtrObj &p, MemFn memFn, double xmin, double xmax, int npar, int ndim, const char* c1, const char* c2) :
-    TF1(name, p, memFn, xmin, xmax, npar, c1, c2)
+    TF1(name, p, memFn, xmin, xmax, npar, c1, c2), fSaveL(nullptr)
   {
     fNpx = 200;
   }
@@ -38,7 +38,7 @@ class TF1F : public TF1
   // and returning a double.
   template <typename Func>
   TF1F(const char* name, Func f, double xmin, double xmax, int npar, const char* tmp  ) :
-    TF1(name, f, xmin, xmax, npar, tmp)
+    TF1(name, f, xmin, xmax, npar, tmp), fSaveL(nullptr)
   {
     fNpx = 200;
   }
@@ -47,10 +47,24 @@ class TF1F : public TF1
   virtual void Save(double xmin, double xmax, double ymin, double ymax, double zmin, double zmax);
   double GetSaveL(double x) const;
   double GetSaveL(int N, double x, double* y) const;
+
+  /// Returns the values tabulated by Save() used by GetSaveL()
+  const double* GetSaveData() const { return fSaveL ? fSaveL : &fSave[0]; }
+  int GetSaveSize() const { return fNpx + 1; }
+  double GetSaveXmin() const { return fXmin; }
+  double GetSaveXmax() const { return fXmax; }
+
+  /// Uses the GetSaveSize() values tabulated on [xmin, xmax] by an earlier
+  /// call to Save() instead of evaluating the function. The values are not
+  /// copied and must outlive this object
+  void SetSaveData(double xmin, double xmax, const double* values);
  protected:
   double fXmin;
   double fXmax;
   double fdX;
   int    fStep;
 
+  /// External table of saved values. If null the TF1::fSave values are used
+  const double* fSaveL;
+
 };
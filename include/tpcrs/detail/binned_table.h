@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "TH1.h"
+#include "TRandom.h"
+
+#include "tpcrs/detail/table_cache.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * A one-dimensional histogram copied from a ROOT TH1 into plain arrays. The
+ * lookups reproduce the results of TH1::Interpolate and TH1::GetRandom but do
+ * not modify the object and accept any random number generator, so a table can
+ * be shared by concurrent threads.
+ */
+class BinnedTable
+{
+ public:
+
+  BinnedTable() : n_bins_(0), x_min_(0), x_max_(0) {}
+
+  explicit BinnedTable(const TH1& hist) :
+    n_bins_(hist.GetNbinsX()),
+    x_min_(hist.GetXaxis()->GetXmin()),
+    x_max_(hist.GetXaxis()->GetXmax()),
+    edges_(),
+    centers_(n_bins_),
+    contents_(n_bins_),
+    integral_(n_bins_ + 1, 0)
+  {
+    // Variable bin edges are kept only when the axis is not uniform
+    if (hist.GetXaxis()->GetXbins()->GetSize()) {
+      const double* edges = hist.GetXaxis()->GetXbins()->GetArray();
+      edges_.assign(edges, edges + n_bins_ + 1);
+    }
+
+    for (int i = 0; i < n_bins_; i++) {
+      centers_[i]  = hist.GetXaxis()->GetBinCenter(i + 1);
+      contents_[i] = hist.GetBinContent(i + 1);
+      integral_[i + 1] = integral_[i] + (contents_[i] >= 0 ? contents_[i] : 0);
+    }
+
+    for (int i = 1; i <= n_bins_; i++)
+      integral_[i] /= integral_[n_bins_];
+  }
+
+  /// Appends the table to values in the layout read by Restore()
+  void Store(std::vector<double>& values) const
+  {
+    values.push_back(n_bins_);
+    values.push_back(x_min_);
+    values.push_back(x_max_);
+
+    for (const std::vector<double>* v : {&edges_, &centers_, &contents_, &integral_}) {
+      values.push_back(v->size());
+      values.insert(values.end(), v->begin(), v->end());
+    }
+  }
+
+  /// Reads a table written by Store(). Returns false if the cache is too short
+  bool Restore(TableCache& cache)
+  {
+    double n_bins;
+
+    if (!cache.Read(n_bins) || !cache.Read(x_min_) || !cache.Read(x_max_))
+      return false;
+
+    n_bins_ = n_bins;
+
+    for (std::vector<double>* v : {&edges_, &centers_, &contents_, &integral_}) {
+      double size;
+      const double* values = cache.Read(size) ? cache.Read(size_t(size)) : nullptr;
+
+      if (!values) return false;
+
+      v->assign(values, values + size_t(size));
+    }
+
+    return true;
+  }
+
+  int n_bins() const { return n_bins_; }
+
+  /// Returns the content of the bin (numbered from 0)
+  double content(int bin) const { return contents_[bin]; }
+
+  double low_edge(int bin) const
+  {
+    return edges_.empty() ? x_min_ + bin * bin_width() : edges_[bin];
+  }
+
+  double width(int bin) const
+  {
+    return edges_.empty() ? bin_width() : edges_[bin + 1] - edges_[bin];
+  }
+
+  /// Returns the bin containing x. Values outside the axis are clamped to the
+  /// first and last bin
+  int FindBin(double x) const
+  {
+    if (x < x_min_) return 0;
+    if (x >= x_max_) return n_bins_ - 1;
+
+    if (edges_.empty())
+      return std::min(static_cast<int>(n_bins_ * (x - x_min_) / (x_max_ - x_min_)), n_bins_ - 1);
+
+    return std::upper_bound(edges_.begin(), edges_.end(), x) - edges_.begin() - 1;
+  }
+
+  /// Linear interpolation between the centers of adjacent bins. For a uniform
+  /// axis the bin is found by direct indexing
+  double Interpolate(double x) const
+  {
+    if (x <= centers_.front()) return contents_.front();
+    if (x >= centers_.back())  return contents_.back();
+
+    int bin = FindBin(x);
+
+    if (x <= centers_[bin]) bin--;
+
+    double x0 = centers_[bin], x1 = centers_[bin + 1];
+    double y0 = contents_[bin], y1 = contents_[bin + 1];
+
+    return y0 + (x - x0) * ((y1 - y0) / (x1 - x0));
+  }
+
+  /// Samples the histogram by a binary search over the cumulative
+  /// distribution
+  double GetRandom(TRandom& random) const
+  {
+    double r = random.Rndm();
+
+    // The last bin whose lower cumulative value does not exceed r, as found by
+    // TMath::BinarySearch
+    auto iter = std::lower_bound(integral_.begin(), integral_.begin() + n_bins_, r);
+    int bin = iter - integral_.begin() - (iter != integral_.begin() + n_bins_ && *iter == r ? 0 : 1);
+    double x = low_edge(bin);
+
+    if (r > integral_[bin])
+      x += width(bin) * (r - integral_[bin]) / (integral_[bin + 1] - integral_[bin]);
+
+    return x;
+  }
+
+ private:
+
+  double bin_width() const { return (x_max_ - x_min_) / n_bins_; }
+
+  int n_bins_;
+  double x_min_;
+  double x_max_;
+
+  /// Bin edges of a non-uniform axis. Empty for a uniform one
+  std::vector<double> edges_;
+  std::vector<double> centers_;
+  std::vector<double> contents_;
+
+  /// Normalized cumulative sum of the bin contents
+  std::vector<double> integral_;
+};
+
+
+/**
+ * Walker's alias table built with Vose's algorithm to sample a binned
+ * distribution in constant time. A single uniform number selects both the bin
+ * and the position within the bin. Throws if the distribution has no bin
+ * with positive content.
+ */
+class AliasTable
+{
+ public:
+
+  AliasTable() {}
+
+  explicit AliasTable(const BinnedTable& table) :
+    table_(table),
+    probability_(table.n_bins()),
+    alias_(table.n_bins())
+  {
+    int n = table.n_bins();
+    double sum = 0;
+
+    for (int i = 0; i < n; i++)
+      sum += std::max(table.content(i), 0.);
+
+    if (!(sum > 0))
+      throw std::runtime_error("AliasTable: The distribution has no positive content");
+
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+
+    for (int i = 0; i < n; i++) {
+      scaled[i] = std::max(table.content(i), 0.) * n / sum;
+      (scaled[i] < 1 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+      int s = small.back(); small.pop_back();
+      int l = large.back();
+
+      probability_[s] = scaled[s];
+      alias_[s] = l;
+
+      scaled[l] -= 1 - scaled[s];
+
+      if (scaled[l] < 1) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+
+    // The remaining bins are full up to the rounding errors
+    for (int i : large) { probability_[i] = 1; alias_[i] = i; }
+    for (int i : small) { probability_[i] = 1; alias_[i] = i; }
+  }
+
+  double GetRandom(TRandom& random) const
+  {
+    double u = random.Rndm() * probability_.size();
+    int column = std::min(static_cast<int>(u), static_cast<int>(probability_.size()) - 1);
+    double f = u - column;
+
+    // Reuse the fraction of the uniform number to place x within the bin
+    if (f < probability_[column])
+      return table_.low_edge(column) + table_.width(column) * f / probability_[column];
+
+    int bin = alias_[column];
+    return table_.low_edge(bin) + table_.width(bin) * (f - probability_[column]) / (1 - probability_[column]);
+  }
+
+ private:
+
+  BinnedTable table_;
+  std::vector<double> probability_;
+  std::vector<int> alias_;
+};
+
+} }
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tpcrs/tpcrs_core.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * Sparse storage for the charge simulated in a sector.
+ *
+ * The timebins of every pad are split into blocks of kBlockSize cells. A block
+ * is allocated from a pool when one of its cells is accessed for the first
+ * time, so only the blocks touched by the simulated electrons take memory and
+ * need to be reset or scanned. Pads are indexed sequentially within a sector,
+ * i.e. pad_index = DigiChannelMap::total_pads(row) + pad - 1.
+ *
+ * Within a block the charges and the track ids are stored in separate arrays
+ * so that consecutive timebins can be updated with vector instructions.
+ */
+class ChargeAccumulator
+{
+ public:
+
+  static constexpr int kBlockSize = 64;
+
+  struct Block
+  {
+    float charge[kBlockSize];
+    short track_id[kBlockSize];
+  };
+
+  /// Removes all charge. The memory is kept for reuse if the dimensions do
+  /// not change
+  void Reset(int n_pads, int n_timebins)
+  {
+    int n_blocks_per_pad = (n_timebins + kBlockSize - 1) / kBlockSize;
+
+    if (n_pads != n_pads_ || n_timebins != n_timebins_) {
+      n_pads_ = n_pads;
+      n_timebins_ = n_timebins;
+      n_blocks_per_pad_ = n_blocks_per_pad;
+      block_ids_.assign(n_pads_ * n_blocks_per_pad_, -1);
+    }
+    else {
+      for (int block_key : touched_) block_ids_[block_key] = -1;
+    }
+
+    touched_.clear();
+  }
+
+  /**
+   * Adds the outer product of the pad and time couplings to `n_pads`
+   * consecutive pads starting at `pad_index` and `n_timebins` consecutive
+   * timebins (counted from 0) starting at `timebin`. Only the products not less than
+   * `min_signal` are added, and the dominant track id of each cell is updated
+   * the same way as by SimulatedCharge's operator+=. A pad coupling set to NaN
+   * excludes the pad.
+   *
+   * Uses AVX-512 or AVX2 instructions when supported by the CPU.
+   */
+  void Deposit(int pad_index, int n_pads, const double* pad_couplings,
+               int timebin, int n_timebins, const double* time_couplings,
+               double min_signal, short track_id);
+
+  /// Returns the charge in the timebin of the pad
+  tpcrs::SimulatedCharge Get(int pad_index, int timebin) const
+  {
+    int block_id = block_ids_[pad_index * n_blocks_per_pad_ + timebin / kBlockSize];
+
+    if (block_id < 0)
+      return tpcrs::SimulatedCharge{0, 0};
+
+    const Block& block = blocks_[block_id];
+    return tpcrs::SimulatedCharge{block.charge[timebin % kBlockSize], block.track_id[timebin % kBlockSize]};
+  }
+
+  /// Sorts the allocated blocks by pad and timebin. Must be called before
+  /// iterating over the touched pads or cells
+  void Sort()
+  {
+    std::sort(touched_.begin(), touched_.end());
+  }
+
+  /// Returns the sorted list of pads with allocated blocks
+  std::vector<int> TouchedPads() const
+  {
+    std::vector<int> pads;
+
+    for (int block_key : touched_) {
+      int pad_index = block_key / n_blocks_per_pad_;
+      if (pads.empty() || pads.back() != pad_index)
+        pads.push_back(pad_index);
+    }
+
+    return pads;
+  }
+
+  /// Calls func(pad_index, timebin, charge) for every non-zero cell in the
+  /// order of pads and timebins
+  template<typename Func>
+  void ForEachNonZero(Func func) const
+  {
+    for (int block_key : touched_)
+    {
+      int pad_index = block_key / n_blocks_per_pad_;
+      int timebin   = block_key % n_blocks_per_pad_ * kBlockSize;
+      const Block& block = blocks_[block_ids_[block_key]];
+
+      for (int i = 0; i < kBlockSize && timebin + i < n_timebins_; ++i) {
+        if (block.charge[i] != 0)
+          func(pad_index, timebin + i, tpcrs::SimulatedCharge{block.charge[i], block.track_id[i]});
+      }
+    }
+  }
+
+ private:
+
+  /// Returns the block allocating it if needed
+  Block& GetBlock(int pad_index, int block_index)
+  {
+    int block_key = pad_index * n_blocks_per_pad_ + block_index;
+    int block_id = block_ids_[block_key];
+
+    if (block_id < 0)
+      block_id = Allocate(block_key);
+
+    return blocks_[block_id];
+  }
+
+  int Allocate(int block_key)
+  {
+    int block_id = static_cast<int>(touched_.size());
+
+    if (block_id == static_cast<int>(blocks_.size()))
+      blocks_.emplace_back();
+
+    std::fill(std::begin(blocks_[block_id].charge), std::end(blocks_[block_id].charge), 0.f);
+    std::fill(std::begin(blocks_[block_id].track_id), std::end(blocks_[block_id].track_id), 0);
+    block_ids_[block_key] = block_id;
+    touched_.push_back(block_key);
+
+    return block_id;
+  }
+
+  int n_pads_ = 0;
+  int n_timebins_ = 0;
+  int n_blocks_per_pad_ = 0;
+
+  /// Maps pad_index * n_blocks_per_pad_ + timebin / kBlockSize to the index in
+  /// blocks_ or -1 if not allocated
+  std::vector<int> block_ids_;
+
+  /// Pool of blocks. The first touched_.size() are in use
+  std::vector<Block> blocks_;
+
+  /// Keys of the allocated blocks
+  std::vector<int> touched_;
+};
+
+} }
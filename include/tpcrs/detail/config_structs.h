@@ -26,6 +26,13 @@ struct IConfigStruct
 template<typename Base_t, typename Chair_t, typename Struct_t>
 struct ConfigStruct : Base_t
 {
+  using struct_type = Struct_t;
+
+  /// The structs and chairs read through the Configurator besides the own
+  /// rows. A chair is shared with the base of an overlay that replaces none
+  /// of them
+  using dependencies = TypeList<>;
+
   Struct_t* Struct(int i=0) { return &rows_[i]; }
   Struct_t* Struct(int i=0) const { return const_cast<Struct_t*>(&rows_[i]); }
   virtual std::string GetName() const { return name; }
@@ -37,30 +44,17 @@ struct ConfigStruct : Base_t
 
  protected:
 
-  ConfigStruct(const Configurator& cfg) : rows_(), cfg_(cfg)
+  ConfigStruct(const Configurator& cfg) : rows_(cfg.ChairRows<Chair_t, Struct_t>(name)), cfg_(cfg)
   {
     // Deal with optionally present structs
-    if (!cfg_.YAML(name)) {
+    Base_t::is_missing = rows_.empty();
+
+    if (rows_.empty())
       rows_.push_back(Struct_t());
-      Base_t::is_missing = true;
-    } else {
-      try {
-        rows_.push_back( cfg_.YAML(name).template as< Struct_t >() );
-      } catch (std::exception& e) {
-        rows_ = cfg_.YAML(name).template as< std::vector<Struct_t> >();
-      }
-      Base_t::is_missing = false;
-    }
 
     Base_t::Initialize();
   }
 
-  void operator=(const ConfigStruct &other)
-  {
-    rows_ = other.rows_;
-    const_cast<Configurator&>(cfg_) = other.cfg_;
-  }
-
   std::vector<Struct_t> rows_;
 
   const Configurator& cfg_;
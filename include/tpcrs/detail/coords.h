@@ -1,11 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
 #include "TGeoMatrix.h"
 
+#include "tpcrs/detail/derived_geometry.h"
 #include "tpcrs/detail/struct_containers.h"
 
 
@@ -225,12 +229,70 @@ using StTpcLocalDirection = TCoordinate<3>;
 using StTpcLocalSectorCoordinate = TCoordinate<4>;
 using StTpcLocalSectorDirection = TCoordinate<5>;
 
+/**
+ * An affine transformation master = R * local + t stored as the columns and
+ * the rows of R and the translation t, each padded to four doubles. A point
+ * is transformed in either direction with a few vector operations. The
+ * arithmetic is the same as in TGeoMatrix, so the results are identical.
+ */
+struct PackedTransform
+{
+  double col[3][4];
+  double row[3][4];
+  double t[4];
+
+  PackedTransform() = default;
+  explicit PackedTransform(const TGeoHMatrix& m);
+
+  const double* GetTranslation() const { return t; }
+
+  void LocalToMaster(const double* l, double* m) const
+  {
+    for (int i = 0; i < 3; i++)
+      m[i] = t[i] + l[0] * col[0][i] + l[1] * col[1][i] + l[2] * col[2][i];
+  }
+
+  void MasterToLocal(const double* m, double* l) const
+  {
+    double mt0 = m[0] - t[0];
+    double mt1 = m[1] - t[1];
+    double mt2 = m[2] - t[2];
+
+    for (int i = 0; i < 3; i++)
+      l[i] = mt0 * row[0][i] + mt1 * row[1][i] + mt2 * row[2][i];
+  }
+
+  void LocalToMasterVect(const double* l, double* m) const
+  {
+    for (int i = 0; i < 3; i++)
+      m[i] = l[0] * col[0][i] + l[1] * col[1][i] + l[2] * col[2][i];
+  }
+
+  void MasterToLocalVect(const double* m, double* l) const
+  {
+    for (int i = 0; i < 3; i++)
+      l[i] = m[0] * row[0][i] + m[1] * row[1][i] + m[2] * row[2][i];
+  }
+};
+
+
 // pad              => sector12       =>   subsector => sector => tpc      => global
 // TpcPadCoordinate => TpcSectL => TpcSectLAligned => TpcLocal => Global
 struct CoordTransform
 {
   CoordTransform(const tpcrs::Configurator& cfg);
 
+  /// Uses the geometry table shared with other components
+  CoordTransform(const tpcrs::Configurator& cfg, std::shared_ptr<const tpcrs::detail::DerivedGeometry> geom);
+
+  /**
+   * Same as above but reuses the sector rotations of prev if the survey
+   * structs they are computed from are the same in cfg and in the
+   * configuration of prev, which must still exist
+   */
+  CoordTransform(const tpcrs::Configurator& cfg, std::shared_ptr<const tpcrs::detail::DerivedGeometry> geom,
+                 const CoordTransform& prev);
+
   // Raw Data <--> Tpc Local Sector Coordinates
   void local_sector_to_hardware(const StTpcLocalSectorCoordinate &a, StTpcPadCoordinate &b) const;
   void hardware_to_local_sector(const StTpcPadCoordinate &a, StTpcLocalSectorCoordinate &b) const;
@@ -279,8 +341,37 @@ struct CoordTransform
     b.row = row;
   }
 
-  double ZToTime(double z, int sector, int row, int pad = 0) const;
-  double TimeToZ(double tb, int sector, int row, int pad = 0) const;
+  /**
+   * Batch versions of the conversions above for n coordinates. The affine
+   * transformations are vectorized, and the results are identical to those
+   * of the single coordinate versions. global_to_local sets only the
+   * positions leaving the sector and row of the results to the caller.
+   */
+  void local_sector_to_hardware(const StTpcLocalSectorCoordinate* a, StTpcPadCoordinate* b, size_t n) const;
+  void hardware_to_local_sector(const StTpcPadCoordinate* a, StTpcLocalSectorCoordinate* b, size_t n) const;
+  void local_sector_to_local(const StTpcLocalSectorCoordinate* a, StTpcLocalCoordinate* b, size_t n) const;
+  void local_to_local_sector(const StTpcLocalCoordinate* a, StTpcLocalSectorCoordinate* b, size_t n) const;
+  void local_to_global(const StTpcLocalCoordinate* a, StGlobalCoordinate* b, size_t n) const;
+  void global_to_local(const StGlobalCoordinate* a, StTpcLocalCoordinate* b, size_t n) const;
+
+  double ZToTime(double z, int sector, int row, int pad = 0) const
+  {
+    const TimeConversion& c = time_conversion(sector, row);
+    double time = z / c.drift_velocity;
+    return (time - c.t0) / timebin_width_ - c.t0_offset;
+  }
+
+  double TimeToZ(double tb, int sector, int row, int pad = 0) const
+  {
+    const TimeConversion& c = time_conversion(sector, row);
+    double tbx = tb + c.t0_offset;
+    double time = c.t0 + tbx * timebin_width_;
+    return c.drift_velocity * time;
+  }
+
+  /// Batch versions of ZToTime and TimeToZ for n values in the same sector and row
+  void ZToTime(const double* z, double* tb, size_t n, int sector, int row) const;
+  void TimeToZ(const double* tb, double* z, size_t n, int sector, int row) const;
 
   // Raw Data (pad row timebin or drift L From tpc local sector Coordinates
   int YToRow(double y, int sector) const;
@@ -319,33 +410,77 @@ struct CoordTransform
                               };
 
   const tpcrs::Configurator& cfg_;
+  std::shared_ptr<const tpcrs::detail::DerivedGeometry> geom_;
   double timebin_width_;
   double z_inner_offset_;
   double z_outer_offset_;
 
-  TGeoHMatrix tpc2global_;
-  std::vector<TGeoHMatrix> sector_rotations_;
+  PackedTransform tpc2global_;
+
+  /// kTotalTpcSectorRotaions transformations for every sector
+  std::vector<PackedTransform> sector_rotations_;
+
+  /// Boundaries between pad rows along the local sector y axis. The n-th row
+  /// spans from row_radii_[n-1] to row_radii_[n]
+  std::vector<double> row_radii_;
+
+  /// The inverse width of the buckets dividing the rows along y. A bucket is
+  /// not wider than the narrowest row
+  double row_inv_step_;
+
+  /// The number of row boundaries not greater than the lower edge of each
+  /// bucket
+  std::vector<int> row_buckets_;
+
+  /// Constants of the conversion between z and time for a sector and row
+  struct TimeConversion
+  {
+    /// The sum of the trigger, electronics, and padrow T0 in us
+    double t0;
+    /// The sector T0 offset in time bins
+    double t0_offset;
+    /// The drift velocity in cm/us
+    double drift_velocity;
+  };
+
+  /// TimeConversion for every sector and row
+  std::vector<TimeConversion> time_conversions_;
 
   void SetTpcRotations();
+  void InitRowRadii();
+  void InitTimeConversions();
+
+  /// Rows beyond the last one use the constants of the last row
+  const TimeConversion& time_conversion(int sector, int row) const
+  {
+    int n_rows = geom_->n_rows();
+    return time_conversions_[(sector - 1) * n_rows + std::min(row, n_rows) - 1];
+  }
+
+  /// Returns the row of a or the one found from the position if it is invalid
+  int LocalRow(const StTpcLocalCoordinate &a) const;
+
+  /// The part of the time offset common to all sectors and rows in us
+  double TriggerT0() const;
+
+  const PackedTransform &TpcRot(int sector, int k)      const {return sector_rotations_[kTotalTpcSectorRotaions*(sector - 1) + k];}
+  const PackedTransform &SupS2Tpc(int sector = 1)       const {return TpcRot(sector, kSupS2Tpc);}
+  const PackedTransform &SupS2Glob(int sector = 1)      const {return TpcRot(sector, kSupS2Glob);}
+  const PackedTransform &SubSInner2SupS(int sector = 1) const {return TpcRot(sector, kSubSInner2SupS);}
+
+  const PackedTransform &SubSOuter2SupS(int sector = 1) const {return TpcRot(sector, kSubSOuter2SupS);}
+  const PackedTransform &SubSInner2Tpc(int sector = 1)  const {return TpcRot(sector, kSubSInner2Tpc);}
+  const PackedTransform &SubSOuter2Tpc(int sector = 1)  const {return TpcRot(sector, kSubSOuter2Tpc);}
+  const PackedTransform &SubSInner2Glob(int sector = 1) const {return TpcRot(sector, kSubSInner2Glob);}
+  const PackedTransform &SubSOuter2Glob(int sector = 1) const {return TpcRot(sector, kSubSOuter2Glob);}
+
+  const PackedTransform &PadInner2SupS(int sector = 1)  const {return TpcRot(sector, kPadInner2SupS);}
+  const PackedTransform &PadOuter2SupS(int sector = 1)  const {return TpcRot(sector, kPadOuter2SupS);}
+  const PackedTransform &PadInner2Tpc(int sector = 1)   const {return TpcRot(sector, kPadInner2Tpc);}
+  const PackedTransform &PadOuter2Tpc(int sector = 1)   const {return TpcRot(sector, kPadOuter2Tpc);}
+  const PackedTransform &PadInner2Glob(int sector = 1)  const {return TpcRot(sector, kPadInner2Glob);}
+  const PackedTransform &PadOuter2Glob(int sector = 1)  const {return TpcRot(sector, kPadOuter2Glob);}
 
-  const TGeoHMatrix &TpcRot(int sector, int k)      const {return sector_rotations_[kTotalTpcSectorRotaions*(sector - 1) + k];}
-  const TGeoHMatrix &SupS2Tpc(int sector = 1)       const {return TpcRot(sector, kSupS2Tpc);}
-  const TGeoHMatrix &SupS2Glob(int sector = 1)      const {return TpcRot(sector, kSupS2Glob);}
-  const TGeoHMatrix &SubSInner2SupS(int sector = 1) const {return TpcRot(sector, kSubSInner2SupS);}
-
-  const TGeoHMatrix &SubSOuter2SupS(int sector = 1) const {return TpcRot(sector, kSubSOuter2SupS);}
-  const TGeoHMatrix &SubSInner2Tpc(int sector = 1)  const {return TpcRot(sector, kSubSInner2Tpc);}
-  const TGeoHMatrix &SubSOuter2Tpc(int sector = 1)  const {return TpcRot(sector, kSubSOuter2Tpc);}
-  const TGeoHMatrix &SubSInner2Glob(int sector = 1) const {return TpcRot(sector, kSubSInner2Glob);}
-  const TGeoHMatrix &SubSOuter2Glob(int sector = 1) const {return TpcRot(sector, kSubSOuter2Glob);}
-
-  const TGeoHMatrix &PadInner2SupS(int sector = 1)  const {return TpcRot(sector, kPadInner2SupS);}
-  const TGeoHMatrix &PadOuter2SupS(int sector = 1)  const {return TpcRot(sector, kPadOuter2SupS);}
-  const TGeoHMatrix &PadInner2Tpc(int sector = 1)   const {return TpcRot(sector, kPadInner2Tpc);}
-  const TGeoHMatrix &PadOuter2Tpc(int sector = 1)   const {return TpcRot(sector, kPadOuter2Tpc);}
-  const TGeoHMatrix &PadInner2Glob(int sector = 1)  const {return TpcRot(sector, kPadInner2Glob);}
-  const TGeoHMatrix &PadOuter2Glob(int sector = 1)  const {return TpcRot(sector, kPadOuter2Glob);}
-
-  const TGeoHMatrix &Pad2Tpc (int sector = 1, int row = 1)  const {return TpcRot(sector, tpcrs::IsInner(row, cfg_) ? kPadInner2Tpc  : kPadOuter2Tpc );}
-  const TGeoHMatrix &Pad2Glob(int sector = 1, int row = 1)  const {return TpcRot(sector, tpcrs::IsInner(row, cfg_) ? kPadInner2Glob : kPadOuter2Glob);}
+  const PackedTransform &Pad2Tpc (int sector = 1, int row = 1)  const {return TpcRot(sector, geom_->is_inner(row) ? kPadInner2Tpc  : kPadOuter2Tpc );}
+  const PackedTransform &Pad2Glob(int sector = 1, int row = 1)  const {return TpcRot(sector, geom_->is_inner(row) ? kPadInner2Glob : kPadOuter2Glob);}
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TPCRS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+
+namespace tpcrs { namespace detail {
+
+/// The instruction sets of the vectorized kernels
+enum class Simd : int { kScalar, kAvx2, kAvx512 };
+
+/// Returns true if the CPU supports AVX2 and it is allowed by SetMaxSimd()
+bool HasAvx2();
+
+/// Returns true if the CPU supports AVX-512F, VL, and BW and they are allowed
+/// by SetMaxSimd()
+bool HasAvx512();
+
+/**
+ * Limits the instruction sets used by the kernels selected afterwards, e.g.
+ * to compare the vectorized and scalar results. By default all instruction
+ * sets supported by the CPU are used.
+ */
+void SetMaxSimd(Simd simd);
+
+} }
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "tpcrs/configurator.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * Read-only table of quantities derived from the configuration for every pad
+ * row and sector. The values are computed once at construction so that the hot
+ * loops do not go through the Configurator or evaluate the gain corrections
+ * for every electron. Rows and sectors are numbered from 1.
+ */
+class DerivedGeometry
+{
+ public:
+
+  DerivedGeometry(const tpcrs::Configurator& cfg);
+
+  int n_sectors() const { return n_sectors_; }
+  int n_rows() const { return n_rows_; }
+
+  bool is_inner(int row) const { return rows_[row - 1].is_inner; }
+
+  /// Distance from the center of the TPC to the row along the local sector y axis
+  double radius(int row) const { return rows_[row - 1].radius; }
+
+  int n_pads(int row) const { return rows_[row - 1].n_pads; }
+
+  double pad_pitch(int row) const { return rows_[row - 1].pad_pitch; }
+
+  /// Total number of pads in the sector rows preceding the row
+  int pad_offset(int row) const { return rows_[row - 1].pad_offset; }
+
+  /// Gas gain correction for the anode voltage
+  float base_gain(int sector, int row) const { return sector_rows_[index(sector, row)].base_gain; }
+
+  /// Padrow T0 in us
+  float t0(int sector, int row) const { return sector_rows_[index(sector, row)].t0; }
+
+  /// Sector T0 offset in time bins
+  float t0_offset(int sector, int row) const { return sector_rows_[index(sector, row)].t0_offset; }
+
+  /// Drift velocity in cm/s
+  float drift_velocity(int sector) const { return drift_velocities_[sector - 1]; }
+
+ private:
+
+  struct Row
+  {
+    bool is_inner;
+    int n_pads;
+    int pad_offset;
+    double radius;
+    double pad_pitch;
+  };
+
+  struct SectorRow
+  {
+    float base_gain;
+    float t0;
+    float t0_offset;
+  };
+
+  int index(int sector, int row) const { return (sector - 1) * n_rows_ + row - 1; }
+
+  int n_sectors_;
+  int n_rows_;
+
+  std::vector<Row> rows_;
+  std::vector<SectorRow> sector_rows_;
+  std::vector<float> drift_velocities_;
+};
+
+} }
@@ -4,6 +4,7 @@
 
 #include "tpcrs/configurator.h"
 #include "tpcrs/tpcrs_core.h"
+#include "tpcrs/detail/charge_accumulator.h"
 
 
 namespace tpcrs { namespace detail {
@@ -18,20 +19,46 @@ class Digitizer
     digi_(cfg)
   {}
 
+  /// Uses a copy of the channel map built for cfg
+  Digitizer(const tpcrs::Configurator& cfg, const tpcrs::DigiChannelMap& digi) :
+    cfg_(cfg),
+    digi_(digi)
+  {}
+
+  template<typename InputIt, typename OutputIt>
+  OutputIt Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitized) const
+  {
+    return Digitize(first_ch, last_ch, digitized, *gRandom);
+  }
+
   template<typename InputIt, typename OutputIt>
-  OutputIt Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitized) const;
+  OutputIt Digitize(unsigned int sector, InputIt first_ch, InputIt last_ch, OutputIt digitized) const
+  {
+    return Digitize(sector, first_ch, last_ch, digitized, *gRandom);
+  }
 
+  /// Same as above but the pedestal noise is sampled with the provided
+  /// generator
   template<typename InputIt, typename OutputIt>
-  OutputIt Digitize(unsigned int sector, InputIt first_ch, InputIt last_ch, OutputIt digitized) const;
+  OutputIt Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitized, TRandom& random) const;
+
+  template<typename InputIt, typename OutputIt>
+  OutputIt Digitize(unsigned int sector, InputIt first_ch, InputIt last_ch, OutputIt digitized, TRandom& random) const;
+
+  /// Digitizes the charge accumulated in a sector. The accumulator must be
+  /// sorted. Pads without any charge are digitized only if `all_pads` is true,
+  /// otherwise the pedestal noise is not simulated for them
+  template<typename OutputIt>
+  OutputIt Digitize(unsigned int sector, const ChargeAccumulator& charges, OutputIt digitized, TRandom& random, bool all_pads = true) const;
 
  private:
 
   void SimulateAltro(std::vector<short>::iterator first, std::vector<short>::iterator last, bool cancel_tail) const;
   void SimulateAsic(std::vector<short>& ADC) const;
 
-  int ChargeToAdc(float charge, double gain, double ped, double pedRMS) const
+  int ChargeToAdc(float charge, double gain, double ped, double pedRMS, TRandom& random) const
   {
-    int adc = int(charge / gain + gRandom->Gaus(ped, pedRMS) - ped);
+    int adc = int(charge / gain + random.Gaus(ped, pedRMS) - ped);
     // Zero negative values
     adc = adc & ~(adc >> 31);
     // Select minimum between adc and 1023, i.e. overflow at 1023
@@ -45,30 +72,33 @@ class Digitizer
 
 
 template<typename InputIt, typename OutputIt>
-OutputIt Digitizer::Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitized) const
+OutputIt Digitizer::Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitized, TRandom& random) const
 {
-  static DigiChannelMap digi(cfg_, 0);
+  // Channels in all sectors
+  const DigiChannel first_channel{1, 1, 1, 1};
+  const DigiChannel last_channel{unsigned(digi_.n_sectors), unsigned(digi_.n_rows),
+                                 unsigned(digi_.n_pads(digi_.n_rows)), unsigned(digi_.n_timebins)};
 
   double pedRMS = cfg_.S<TpcResponseSimulator>().AveragePedestalRMSX;
   double ped = cfg_.S<TpcResponseSimulator>().AveragePedestal;
 
   auto ch_charge = first_ch;
-  std::vector<short> ADCs_(digi.n_timebins, 0);
-  std::vector<short> IDTs_(digi.n_timebins, 0);
+  std::vector<short> ADCs_(digi_.n_timebins, 0);
+  std::vector<short> IDTs_(digi_.n_timebins, 0);
 
-  for (auto ch = digi.first(); !(digi.last() < ch); )
+  for (auto ch = first_channel; !(last_channel < ch); )
   {
     double gain = cfg_.S<tpcPadGainT0>().Gain[ch.sector-1][ch.row-1][ch.pad-1];
 
     // Go to the next pad
     if (gain <= 0) {
-      digi.next_pad(ch);
+      digi_.next_pad(ch);
       continue;
     }
 
-    if (ch < ch_charge->channel || ch_charge == last_ch)
+    if (ch_charge == last_ch || ch < ch_charge->channel)
     { // digitize zero signal and continue
-      ADCs_[ch.timebin-1] = ChargeToAdc(0, gain, ped, pedRMS);
+      ADCs_[ch.timebin-1] = ChargeToAdc(0, gain, ped, pedRMS, random);
       IDTs_[ch.timebin-1] = ch_charge->track_id;
     }
     else if (ch_charge->channel < ch)
@@ -80,24 +110,24 @@ OutputIt Digitizer::Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitiz
     else // equal channels
     {
       // digitize non-zero signal from ch_charge
-      ADCs_[ch.timebin-1] = ChargeToAdc(ch_charge->charge, gain, ped, pedRMS);
+      ADCs_[ch.timebin-1] = ChargeToAdc(ch_charge->charge, gain, ped, pedRMS, random);
       IDTs_[ch.timebin-1] = ch_charge->track_id;
       ++ch_charge;
     }
 
     // Pad boundary
-    if (ch.timebin == digi.n_timebins)
+    if (ch.timebin == digi_.n_timebins)
     {
       SimulateAltro(std::begin(ADCs_), std::end(ADCs_), true);
 
-      for (unsigned int tb = 1; tb != digi.n_timebins; ++tb)
+      for (unsigned int tb = 1; tb != digi_.n_timebins; ++tb)
       {
         if (ADCs_[tb-1] == 0) continue;
         *digitized = tpcrs::DigiHit{ch.sector, ch.row, ch.pad, tb, ADCs_[tb-1], IDTs_[tb-1]};
       }
     }
 
-    digi.next(ch);
+    digi_.next(ch);
   }
 
   return digitized;
@@ -105,7 +135,7 @@ OutputIt Digitizer::Digitize(InputIt first_ch, InputIt last_ch, OutputIt digitiz
 
 
 template<typename InputIt, typename OutputIt>
-OutputIt Digitizer::Digitize(unsigned int sector, InputIt first_ch, InputIt last_ch, OutputIt digitized) const
+OutputIt Digitizer::Digitize(unsigned int sector, InputIt first_ch, InputIt last_ch, OutputIt digitized, TRandom& random) const
 {
   double pedRMS = cfg_.S<TpcResponseSimulator>().AveragePedestalRMSX;
   double ped = cfg_.S<TpcResponseSimulator>().AveragePedestal;
@@ -126,7 +156,7 @@ OutputIt Digitizer::Digitize(unsigned int sector, InputIt first_ch, InputIt last
     }
 
     for (int i=0; i != digi_.n_timebins; ++i, ++ch_charge, ++adcs_iter)
-      *adcs_iter = ChargeToAdc(ch_charge->charge, gain, ped, pedRMS);
+      *adcs_iter = ChargeToAdc(ch_charge->charge, gain, ped, pedRMS, random);
   }
 
   for (auto adcs_iter = ADCs_.begin(); adcs_iter != ADCs_.end(); adcs_iter += digi_.n_timebins)
@@ -142,7 +172,56 @@ OutputIt Digitizer::Digitize(unsigned int sector, InputIt first_ch, InputIt last
     if (*adcs_iter == 0) continue;
     *digitized = tpcrs::DigiHit{sector, ch->row, ch->pad, ch->timebin, *adcs_iter, ch_charge->track_id};
   }
+
+  return digitized;
 }
 
 
+template<typename OutputIt>
+OutputIt Digitizer::Digitize(unsigned int sector, const ChargeAccumulator& charges, OutputIt digitized, TRandom& random, bool all_pads) const
+{
+  double pedRMS = cfg_.S<TpcResponseSimulator>().AveragePedestalRMSX;
+  double ped = cfg_.S<TpcResponseSimulator>().AveragePedestal;
+
+  std::vector<short> ADCs_(digi_.n_timebins, 0);
+  std::vector<short> IDTs_(digi_.n_timebins, 0);
+
+  auto digitize_pad = [&](int pad_index)
+  {
+    const DigiChannel& first_ch = digi_.channels[pad_index * digi_.n_timebins];
+
+    double gain = cfg_.S<tpcPadGainT0>().Gain[sector-1][first_ch.row-1][first_ch.pad-1];
+
+    if (gain <= 0) return;
+
+    for (int tb = 0; tb != digi_.n_timebins; ++tb)
+    {
+      tpcrs::SimulatedCharge charge = charges.Get(pad_index, tb);
+      ADCs_[tb] = ChargeToAdc(charge.charge, gain, ped, pedRMS, random);
+      IDTs_[tb] = charge.track_id;
+    }
+
+    SimulateAltro(std::begin(ADCs_), std::end(ADCs_), true);
+
+    for (int tb = 0; tb != digi_.n_timebins; ++tb)
+    {
+      if (ADCs_[tb] == 0) continue;
+      *digitized = tpcrs::DigiHit{sector, first_ch.row, first_ch.pad, unsigned(tb + 1), ADCs_[tb], IDTs_[tb]};
+    }
+  };
+
+  if (all_pads) {
+    int n_pads = digi_.total_timebins() / digi_.n_timebins;
+
+    for (int pad_index = 0; pad_index != n_pads; ++pad_index)
+      digitize_pad(pad_index);
+  }
+  else {
+    for (int pad_index : charges.TouchedPads())
+      digitize_pad(pad_index);
+  }
+
+  return digitized;
+}
+
 } }
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
 #include "tpcrs/configurator.h"
+#include "tpcrs/detail/coords.h"
 #include "tpcrs/detail/enum_bitset.h"
 #include "struct_containers.h"
 
@@ -12,8 +18,8 @@ struct DistorterConfigurator
 {
   DistorterConfigurator(const tpcrs::Configurator& cfg)
   {
-    double cathode_voltage    = cfg.S<tpcHighVoltages>().cathode * 1000;
-    double gated_grid_voltage = cfg.S<tpcHighVoltages>().gatedGridRef;
+    cathode_voltage    = cfg.S<tpcHighVoltages>().cathode * 1000;
+    gated_grid_voltage = cfg.S<tpcHighVoltages>().gatedGridRef;
 
     double tensorV1 = cfg.S<tpcOmegaTau>().tensorV1;
     double tensorV2 = cfg.S<tpcOmegaTau>().tensorV2;
@@ -35,7 +41,7 @@ struct DistorterConfigurator
     // to Z and ExB
 
     // Electric Field (V/cm) Magnitude
-    double electric_field = std::abs((cathode_voltage - gated_grid_voltage) / readout_plane_z);
+    electric_field = std::abs((cathode_voltage - gated_grid_voltage) / readout_plane_z);
 
     // Nominal value of magnetic field
     double mag_field_z = cfg.S<ResponseSimulator>().nominal_magnetic_field;
@@ -51,6 +57,9 @@ struct DistorterConfigurator
 
   // Z location of TPC readout plane (absolute value in cm)
   double readout_plane_z;
+  double cathode_voltage;
+  double gated_grid_voltage;
+  double electric_field;
   double omega_tau;
   double const_0;
   double const_1;
@@ -63,45 +72,356 @@ class Distorter
  public:
 
   enum class Distortions : unsigned {
-    kMagneticField = 1
+    kMagneticField = 1,
+    /// Uniform space charge scaled by spaceChargeCor
+    kSpaceCharge = 2,
+    /// Space charge falling as 1/r^2 scaled by spaceChargeCorR2
+    kSpaceChargeR2 = 3,
+    /// Sheets of charge leaking through the gating grid given by tpcGridLeak
+    /// relative to the 1/r^2 space charge
+    kGridLeak = 4,
+    /// Shorted rings in the field cages listed in tpcFieldCageShort
+    kShortedRing = 5,
+    /// The 1/r^2 space charge and the grid leak in every sector parameterized
+    /// by tpcSCGL as functions of the luminosity
+    kSpaceChargeGridLeak = 6
   };
 
   using EnabledDistortions = BitSet<Distortions>;
 
-  Distorter(const tpcrs::Configurator& cfg, EnabledDistortions distortions = 0) :
+  /// Deviation of the tabulated distortions from the integrated ones in cm
+  struct TableAccuracy
+  {
+    double max;
+    double rms;
+    int n_points;
+  };
+
+  /**
+   * The displacements due to the enabled static distortions, i.e. all but
+   * kMagneticField, are computed at construction and combined into a single
+   * table. Applying them takes the same time however many are enabled.
+   */
+  Distorter(const tpcrs::Configurator& cfg, EnabledDistortions distortions = EnabledDistortions()) :
     cfg_(cfg),
     distortions_(distortions),
-    dcfg_(cfg)
-  {}
+    dcfg_(cfg),
+    table_(),
+    static_()
+  {
+    if (HasStaticDistortions()) InitStaticDistortions();
+  }
+
+  /**
+   * Same as above with the distortions enabled in prev. The static
+   * distortions and the table of prev are reused if the structs they are
+   * computed from are the same in cfg and in the configuration of prev, which
+   * must still exist.
+   */
+  Distorter(const tpcrs::Configurator& cfg, const Distorter& prev);
+
+  /// Returns true if Distort() interpolates a table computed by Tabulate()
+  bool tabulated() const { return !table_.empty(); }
+
+  /**
+   * Tabulates the sum of all enabled distortions in both halves of the TPC on
+   * a Cartesian grid with nodes spaced by about `step` cm. Afterwards,
+   * Distort() interpolates the table instead of integrating along the drift
+   * path of every point, and the field passed to it is ignored for points
+   * within the table.
+   */
+  template<typename MagField>
+  void Tabulate(const MagField& mag_field, double step);
+
+  /**
+   * Compares the tabulated distortion with the one computed for every point
+   * by Distort() without a table at `n_points` random points in the sensitive
+   * volume of the TPC.
+   */
+  template<typename MagField>
+  TableAccuracy CheckTable(const MagField& mag_field, int n_points = 10000) const;
 
   template<typename Vec3, typename MagField>
   Vec3 Distort(Vec3 p, int sector, const MagField& mag_field) const;
 
  private:
 
+  /// Applies the enabled distortions without the table
+  template<typename Vec3, typename MagField>
+  Vec3 DistortPoint(Vec3 p, int sector, const MagField& mag_field) const;
+
+  /**
+   * The displacement (dx, dy) due to the enabled distortions at the nodes of
+   * a regular grid in x, y, and |z| for each half of the TPC
+   */
+  struct Table
+  {
+    double xy0;
+    double xy_step;
+    double z_step;
+    int n_xy;
+    int n_z;
+    /// Indexed by [half][iz][iy][ix][component]
+    std::vector<float> values;
+
+    bool empty() const { return values.empty(); }
+
+    /// Returns false if the point is outside the grid
+    bool Interpolate(double x, double y, double z, int half, double& dx, double& dy) const;
+  };
+
+  /**
+   * The radial displacement of the electrons drifting from (r, |z|) to the
+   * readout plane due to the perturbation of the electric field by static
+   * charges and potentials, tabulated for each half of the TPC. The ExB
+   * rotation in the magnetic field is applied afterwards. The grid leak
+   * parameterized per sector is kept separately with a scale for every
+   * sector.
+   */
+  struct StaticDistortion
+  {
+    double r0;
+    double dr;
+    double dz;
+    int n_r;
+    int n_z;
+    /// Indexed by [iz][ir]
+    std::vector<double> symmetric[2];
+    std::vector<double> grid_leak[2];
+    double grid_leak_scale[24];
+
+    /// Returns the value at (r, z) or the one at the nearest edge of the grid
+    double Interpolate(const std::vector<double>& values, double r, double z) const;
+  };
+
   const tpcrs::Configurator& cfg_;
 
   EnabledDistortions distortions_;
 
   DistorterConfigurator dcfg_;
 
+  Table table_;
+
+  StaticDistortion static_;
+
+  bool HasStaticDistortions() const;
+
+  /// Returns true if the drift constants and the enabled static distortions
+  /// would be computed from the same structs in other
+  bool SameInputs(const tpcrs::Configurator& other) const;
+
+  /// Solves for the potentials of all static distortions and integrates
+  /// their radial fields along the drift paths
+  void InitStaticDistortions();
+
+  /// Adds the static distortions to the nodes of the table
+  void TabulateStaticDistortions();
+
+  /// Displacement of a point in half of the TPC due to the static distortions
+  void StaticDisplacement(double x, double y, double z, int half, double& dx, double& dy) const;
+
   /** Distortion due to the shape of the magnetic field */
   template<typename Vec3, typename MagField>
   Vec3 DistortDueMagneticField(Vec3 p, int sector, const MagField& mag_field) const;
+
+  /// Direction of the drift path projected on the x-y plane per unit of z
+  template<typename MagField>
+  void DriftSlope(const MagField& mag_field, const Coords& p, double& sx, double& sy) const;
 };
 
 
+inline
+bool Distorter::Table::Interpolate(double x, double y, double z, int half, double& dx, double& dy) const
+{
+  double u = (x - xy0) / xy_step;
+  double v = (y - xy0) / xy_step;
+  double w = z / z_step;
+
+  if (!(u >= 0 && u <= n_xy - 1 && v >= 0 && v <= n_xy - 1 && w >= 0 && w <= n_z - 1))
+    return false;
+
+  int ix = std::min(static_cast<int>(u), n_xy - 2);
+  int iy = std::min(static_cast<int>(v), n_xy - 2);
+  int iz = std::min(static_cast<int>(w), n_z - 2);
+
+  u -= ix;
+  v -= iy;
+  w -= iz;
+
+  const float* node = &values[2 * (((half * n_z + iz) * n_xy + iy) * n_xy + ix)];
+  size_t y_stride = 2 * n_xy;
+  size_t z_stride = 2 * n_xy * n_xy;
+
+  double d[2];
+
+  for (int c = 0; c < 2; c++) {
+    const float* n = node + c;
+    double d00 = n[0]                   + u * (n[2]                   - n[0]);
+    double d10 = n[y_stride]            + u * (n[y_stride + 2]        - n[y_stride]);
+    double d01 = n[z_stride]            + u * (n[z_stride + 2]        - n[z_stride]);
+    double d11 = n[z_stride + y_stride] + u * (n[z_stride + y_stride + 2] - n[z_stride + y_stride]);
+    double d0 = d00 + v * (d10 - d00);
+    double d1 = d01 + v * (d11 - d01);
+    d[c] = d0 + w * (d1 - d0);
+  }
+
+  dx = d[0];
+  dy = d[1];
+
+  return true;
+}
+
+
+template<typename MagField>
+void Distorter::DriftSlope(const MagField& mag_field, const Coords& p, double& sx, double& sy) const
+{
+  auto B = mag_field.ValueAt(p);
+
+  if (std::abs(B.z) > 0.001) {
+    sx = (dcfg_.const_2 * B.x - dcfg_.const_1 * B.y) / B.z;
+    sy = (dcfg_.const_2 * B.y + dcfg_.const_1 * B.x) / B.z;
+  } else {
+    sx = sy = 0;
+  }
+}
+
+
+/**
+ * The drift paths of all nodes with the same x and y start at the same point
+ * of the readout plane. Thus, the displacements along a column of nodes are
+ * obtained by a single integration from the readout plane to the central
+ * membrane. Every interval between nodes is integrated with Simpson's rule in
+ * steps of at most 1 cm as in DistortDueMagneticField().
+ */
+template<typename MagField>
+void Distorter::Tabulate(const MagField& mag_field, double step)
+{
+  table_.values.clear();
+
+  double radius = cfg_.S<tpcDimensions>().tpcOuterRadius;
+  double z_max = dcfg_.readout_plane_z;
+
+  table_.n_xy = static_cast<int>(std::ceil(2 * radius / step)) + 1;
+  table_.n_z  = static_cast<int>(std::ceil(z_max / step)) + 1;
+  table_.xy0 = -radius;
+  table_.xy_step = 2 * radius / (table_.n_xy - 1);
+  table_.z_step = z_max / (table_.n_z - 1);
+  table_.values.assign(2 * 2 * table_.n_z * table_.n_xy * table_.n_xy, 0);
+
+  if (HasStaticDistortions()) TabulateStaticDistortions();
+
+  if (!distortions_.test(Distortions::kMagneticField)) return;
+
+  int n_sub = static_cast<int>(std::ceil(table_.z_step / 2));
+
+  for (int half = 0; half < 2; half++) {
+    int sign = half == 0 ? +1 : -1;
+    // Going backwards from the readout plane
+    double h = -sign * table_.z_step / n_sub;
+
+    for (int iy = 0; iy < table_.n_xy; iy++) {
+      for (int ix = 0; ix < table_.n_xy; ix++) {
+        Coords p{table_.xy0 + ix * table_.xy_step, table_.xy0 + iy * table_.xy_step, sign * z_max};
+        double sx, sy;
+        DriftSlope(mag_field, p, sx, sy);
+
+        for (int iz = table_.n_z - 2; iz >= 0; iz--) {
+          for (int i = 0; i < n_sub; i++) {
+            double z = p.z;
+            double sx_mid, sy_mid, sx_end, sy_end;
+            DriftSlope(mag_field, Coords{p.x + h / 2 * sx, p.y + h / 2 * sy, z + h / 2}, sx_mid, sy_mid);
+            DriftSlope(mag_field, Coords{p.x + h * sx_mid, p.y + h * sy_mid, z + h}, sx_end, sy_end);
+
+            p.x += h / 6 * (sx + 4 * sx_mid + sx_end);
+            p.y += h / 6 * (sy + 4 * sy_mid + sy_end);
+            p.z = z + h;
+            DriftSlope(mag_field, p, sx, sy);
+          }
+
+          float* node = &table_.values[2 * (((half * table_.n_z + iz) * table_.n_xy + iy) * table_.n_xy + ix)];
+          node[0] += p.x - (table_.xy0 + ix * table_.xy_step);
+          node[1] += p.y - (table_.xy0 + iy * table_.xy_step);
+        }
+      }
+    }
+  }
+}
+
+
+template<typename MagField>
+Distorter::TableAccuracy Distorter::CheckTable(const MagField& mag_field, int n_points) const
+{
+  const tpcDimensions& dims = cfg_.S<tpcDimensions>();
+
+  std::mt19937 engine(2345);
+  std::uniform_real_distribution<double> r2(dims.tpcInnerRadius * dims.tpcInnerRadius,
+                                            dims.tpcOuterRadius * dims.tpcOuterRadius);
+  std::uniform_real_distribution<double> phi(0, 2 * M_PI);
+  std::uniform_real_distribution<double> z(0, dcfg_.readout_plane_z);
+
+  TableAccuracy accuracy{0, 0, 0};
+
+  for (int i = 0; i < n_points && !table_.empty(); i++) {
+    double r = std::sqrt(r2(engine));
+    double angle = phi(engine);
+    int half = i % 2;
+    // Sectors 1 to 12 are in the first half and 13 to 24 in the second one
+    int sector = half == 0 ? 1 : 13;
+    Coords p{r * std::cos(angle), r * std::sin(angle), (half == 0 ? 1 : -1) * z(engine)};
+
+    double dx, dy;
+    if (!table_.Interpolate(p.x, p.y, std::abs(p.z), half, dx, dy)) continue;
+
+    Coords exact = DistortPoint(p, sector, mag_field);
+    double d = std::hypot(p.x + dx - exact.x, p.y + dy - exact.y);
+
+    accuracy.max = std::max(accuracy.max, d);
+    accuracy.rms += d * d;
+    accuracy.n_points++;
+  }
+
+  if (accuracy.n_points > 0)
+    accuracy.rms = std::sqrt(accuracy.rms / accuracy.n_points);
+
+  return accuracy;
+}
+
+
 template<typename Vec3, typename MagField>
 Vec3 Distorter::Distort(Vec3 p, int sector, const MagField& mag_field) const
 {
   if (distortions_.none()) return p;
 
+  int half = DetectorSide(sector, cfg_) == TPC::Half::first ? 0 : 1;
+  double dx, dy;
+
+  // Points on the other side of the central membrane are not tabulated
+  if (!table_.empty() && (half == 0) == (p.z >= 0) &&
+      table_.Interpolate(p.x, p.y, std::abs(p.z), half, dx, dy))
+    return Vec3{p.x + dx, p.y + dy, p.z};
+
+  return DistortPoint(p, sector, mag_field);
+}
+
+
+template<typename Vec3, typename MagField>
+Vec3 Distorter::DistortPoint(Vec3 p, int sector, const MagField& mag_field) const
+{
   Vec3 p_prime = p;
 
   if ( distortions_.test(Distortions::kMagneticField) ) {
     p_prime = DistortDueMagneticField(p, sector, mag_field);
   }
 
+  int half = DetectorSide(sector, cfg_) == TPC::Half::first ? 0 : 1;
+
+  if (HasStaticDistortions() && (half == 0) == (p.z >= 0)) {
+    double dx, dy;
+    StaticDisplacement(p.x, p.y, std::abs(p.z), half, dx, dy);
+    p_prime.x += dx;
+    p_prime.y += dy;
+  }
+
   return p_prime;
 }
 
@@ -2,6 +2,7 @@
 
 #include <bitset>
 #include <limits>
+#include <type_traits>
 
 namespace tpcrs { namespace detail {
 
@@ -19,32 +20,35 @@ class BitSet<Enum, true>
 
  public:
 
+  /// An empty set. The enumerators are bit indices, so there is no
+  /// conversion from an integer mask
   BitSet() = default;
   BitSet(const BitSet& other) : bits(other.bits) {}
-  BitSet(ue_t val) : bits(val) {}
 
-  BitSet operator| (Enum value) const { BitSet result = *this; result.bits |= 1 << static_cast<ue_t>(value); return result; }
-  BitSet operator& (Enum value) const { BitSet result = *this; result.bits &= 1 << static_cast<ue_t>(value); return result; }
-  BitSet operator^ (Enum value) const { BitSet result = *this; result.bits ^= 1 << static_cast<ue_t>(value); return result; }
+  BitSet operator| (Enum value) const { BitSet result = *this; result.bits |= mask(value); return result; }
+  BitSet operator& (Enum value) const { BitSet result = *this; result.bits &= mask(value); return result; }
+  BitSet operator^ (Enum value) const { BitSet result = *this; result.bits ^= mask(value); return result; }
   BitSet operator~ ()           const { BitSet result = *this; result.bits.flip(); return result; }
 
-  BitSet& operator|= (Enum value) { bits |= 1 << static_cast<ue_t>(value); return *this; }
-  BitSet& operator&= (Enum value) { bits &= 1 << static_cast<ue_t>(value); return *this; }
-  BitSet& operator^= (Enum value) { bits ^= 1 << static_cast<ue_t>(value); return *this; }
+  BitSet& operator|= (Enum value) { bits |= mask(value); return *this; }
+  BitSet& operator&= (Enum value) { bits &= mask(value); return *this; }
+  BitSet& operator^= (Enum value) { bits ^= mask(value); return *this; }
 
   bool any() const { return bits.any(); }
   bool all() const { return bits.all(); }
   bool none() const { return bits.none(); }
   operator bool() const { return any(); }
 
-  bool test(Enum value) const { return bits.test(1 << static_cast<ue_t>(value)); }
-  void set(Enum value) { bits.set(1 << static_cast<ue_t>(value)); }
-  void unset(Enum value) { bits.reset(1 << static_cast<ue_t>(value)); }
+  bool test(Enum value) const { return bits.test(static_cast<ue_t>(value)); }
+  void set(Enum value) { bits.set(static_cast<ue_t>(value)); }
+  void unset(Enum value) { bits.reset(static_cast<ue_t>(value)); }
 
  private:
 
   const static size_t N = std::numeric_limits<ue_t>::digits;
 
+  static std::bitset<N> mask(Enum value) { return std::bitset<N>().set(static_cast<ue_t>(value)); }
+
   std::bitset<N> bits;
 };
 
@@ -53,7 +57,7 @@ template<typename Enum>
 typename std::enable_if<std::is_enum<Enum>::value, BitSet<Enum>>::type
 operator| (Enum left, Enum right)
 {
-  return BitSet<Enum>(left) | right;
+  return (BitSet<Enum>() | left) | right;
 }
 
 
@@ -61,7 +65,7 @@ template<typename Enum>
 typename std::enable_if<std::is_enum<Enum>::value, BitSet<Enum>>::type
 operator& (Enum left, Enum right)
 {
-  return BitSet<Enum>(left) & right;
+  return (BitSet<Enum>() | left) & right;
 }
 
 
@@ -69,7 +73,7 @@ template<typename Enum>
 typename std::enable_if<std::is_enum<Enum>::value, BitSet<Enum>>::type
 operator^ (Enum left, Enum right)
 {
-  return BitSet<Enum>(left) ^ right;
+  return (BitSet<Enum>() | left) ^ right;
 }
 
 
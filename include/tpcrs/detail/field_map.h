@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tpcrs/detail/mapped_file.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * Ascending coordinates of the nodes along one axis of a grid. Finds the cell
+ * containing a value in constant time: directly for equidistant nodes and via
+ * a table of buckets not wider than the smallest cell otherwise.
+ */
+class GridAxis
+{
+ public:
+
+  GridAxis() : nodes_(nullptr), n_nodes_(0), uniform_(true), x0_(0), inv_step_(0), buckets_() {}
+
+  GridAxis(const float* nodes, int n_nodes);
+
+  /**
+   * Returns the index of the last node not greater than x limited to [0,
+   * n_nodes - 2], i.e. the lower node of the cell used for a linear
+   * interpolation. The result is the same as that of MagField::Search followed
+   * by the clamping of the index.
+   */
+  int FindCell(float x) const
+  {
+    if (!(x >= nodes_[0])) return 0;
+    if (x >= nodes_[n_nodes_ - 2]) return n_nodes_ - 2;
+
+    int i = static_cast<int>((x - x0_) * inv_step_);
+
+    if (!uniform_)
+      i = buckets_[std::min(i, static_cast<int>(buckets_.size()) - 1)];
+
+    i = std::min(i, n_nodes_ - 2);
+
+    // Correct for the rounding without branches. A bucket contains at most
+    // one node unless the number of buckets was limited
+    i -= x < nodes_[i];
+    i += x >= nodes_[i + 1];
+
+    while (x >= nodes_[i + 1]) i++;
+
+    return i;
+  }
+
+ private:
+
+  const float* nodes_;
+  int n_nodes_;
+
+  bool uniform_;
+  float x0_;
+
+  /// The inverse width of the cells of a uniform axis or of the buckets
+  float inv_step_;
+
+  /// The cell containing the lower edge of each bucket
+  std::vector<int> buckets_;
+};
+
+
+/**
+ * Magnetic field components tabulated on a grid in r, z, and phi. A 2D map
+ * has a single phi node and no Bphi component. The values are stored as in the
+ * text maps, i.e. in gauss and cm, with phi converted to radians. The
+ * components of a node are interleaved, i.e. (Br, Bz) or (Br, Bz, Bphi), and
+ * the nodes are indexed by [phi][z][r].
+ *
+ * A map is read either from a text .dat file or from a binary file written by
+ * WriteBinary(). The binary file is memory-mapped and used in place.
+ */
+class FieldMap
+{
+ public:
+
+  /**
+   * Returns the map read from the file at path. Every file is read once per
+   * process and the map is shared by all callers. Binary maps are recognized
+   * by the .bin extension. Returns null if the file cannot be read.
+   */
+  static std::shared_ptr<const FieldMap> Get(const std::string& path);
+
+  static std::unique_ptr<FieldMap> ReadText(const std::string& path);
+  static std::unique_ptr<FieldMap> ReadBinary(const std::string& path);
+
+  bool WriteBinary(const std::string& path) const;
+
+  int n_r() const { return n_r_; }
+  int n_z() const { return n_z_; }
+  int n_phi() const { return n_phi_; }
+
+  const float* r() const { return r_; }
+  const float* z() const { return z_; }
+  const float* phi() const { return phi_; }
+
+  const GridAxis& r_axis() const { return r_axis_; }
+  const GridAxis& z_axis() const { return z_axis_; }
+  const GridAxis& phi_axis() const { return phi_axis_; }
+
+  /// The number of field components: 2 for a 2D map and 3 for a 3D one
+  int n_components() const { return n_components_; }
+
+  /// Returns the interleaved field components at the node
+  const float* B(int i_phi, int i_z, int i_r) const
+  {
+    return B_ + ((i_phi * n_z_ + i_z) * n_r_ + i_r) * n_components_;
+  }
+
+ private:
+
+  FieldMap();
+
+  /// Points the arrays to consecutive blocks of values and sets up the axes
+  void Assign(const float* values);
+
+  int n_r_;
+  int n_z_;
+  int n_phi_;
+  int n_components_;
+
+  const float* r_;
+  const float* z_;
+  const float* phi_;
+  const float* B_;
+
+  GridAxis r_axis_;
+  GridAxis z_axis_;
+  GridAxis phi_axis_;
+
+  /// Storage of a map read from a text file
+  std::vector<float> values_;
+
+  /// Storage of a map read from a binary file
+  std::unique_ptr<MappedFile> file_;
+};
+
+} }
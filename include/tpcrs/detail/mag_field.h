@@ -1,5 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "tpcrs/detail/field_map.h"
+
 
 namespace tpcrs { namespace detail {
 
@@ -30,8 +38,10 @@ class MagField
     double r = std::sqrt(p.x*p.x + p.y*p.y);
     double z = p.z;
 
+    const FieldMap& map = *map_2d_;
+
     // within map
-    if (z >= ZList[0] && z <= ZList[nZ - 1] && r <= Radius[nR - 1])
+    if (z >= map.z()[0] && z <= map.z()[map.n_z() - 1] && r <= map.r()[map.n_r() - 1])
     {
       InterpolateField2D(r, z, Br_value, Bz_value);
 
@@ -46,19 +56,93 @@ class MagField
     return B;
   }
 
+  /**
+   * Evaluates the field at n points. The result for every point is the same as
+   * that of ValueAt(Vec3) but the interpolation is vectorized across points
+   */
+  template<typename Vec3>
+  void ValueAt(const Vec3* points, size_t n, Vec3* values) const
+  {
+    double x[kBatchSize], y[kBatchSize], z[kBatchSize];
+    double Bx[kBatchSize], By[kBatchSize], Bz[kBatchSize];
+
+    for (size_t first = 0; first < n; first += kBatchSize) {
+      size_t m = std::min<size_t>(kBatchSize, n - first);
+
+      for (size_t i = 0; i < m; i++) {
+        x[i] = points[first + i].x;
+        y[i] = points[first + i].y;
+        z[i] = points[first + i].z;
+      }
+
+      ValueAt(m, x, y, z, Bx, By, Bz);
+
+      for (size_t i = 0; i < m; i++) {
+        values[first + i] = Vec3{};
+        values[first + i].x = Bx[i];
+        values[first + i].y = By[i];
+        values[first + i].z = Bz[i];
+      }
+    }
+  }
+
+  /// Evaluates the field at n points given and returned as separate arrays
+  /// of Cartesian components
+  void ValueAt(size_t n, const double* x, const double* y, const double* z,
+               double* Bx, double* By, double* Bz) const;
+
   void GetFieldValue3D(const float x[3], float B[3]) const;
 
+  /// Evaluates the 3D field at n points. The result for every point is the
+  /// same as that of GetFieldValue3D(const float*, float*)
+  void GetFieldValue3D(size_t n, const float* x, const float* y, const float* z,
+                       float* Bx, float* By, float* Bz) const;
+
+  /// Evaluates the 3D field at n points with the components of Vec3 converted
+  /// to float. Same as GetFieldValue3D(const float*, float*) for every point
+  template<typename Vec3>
+  void GetFieldValue3D(const Vec3* points, size_t n, Vec3* values) const
+  {
+    float x[kBatchSize], y[kBatchSize], z[kBatchSize];
+    float Bx[kBatchSize], By[kBatchSize], Bz[kBatchSize];
+
+    for (size_t first = 0; first < n; first += kBatchSize) {
+      size_t m = std::min<size_t>(kBatchSize, n - first);
+
+      for (size_t i = 0; i < m; i++) {
+        x[i] = points[first + i].x;
+        y[i] = points[first + i].y;
+        z[i] = points[first + i].z;
+      }
+
+      GetFieldValue3D(m, x, y, z, Bx, By, Bz);
+
+      for (size_t i = 0; i < m; i++) {
+        values[first + i] = Vec3{};
+        values[first + i].x = Bx[i];
+        values[first + i].y = By[i];
+        values[first + i].z = Bz[i];
+      }
+    }
+  }
+
   static void Search(int N, const float Xarray[], float x, int &low);
   static float Interpolate(const float Xarray[], const float Yarray[], int order, const float x);
+  static float Interpolate(const float Xarray[], float y0, float y1, const float x);
 
  private:
 
+  /// The number of points interpolated at once by the batch methods
+  static const int kBatchSize = 64;
+
   void ReadField();
+
+  /// Returns the shared map from the binary file if it is present and valid
+  /// or else from the text one
+  std::shared_ptr<const FieldMap> LoadMap(const std::string& name) const;
   void InterpolateField2D(double r, double z, double &Br_value, double &Bz_value) const;
   void InterpolateField3D(float r, float z, float phi, float &Br_value, float &Bz_value, float &Bphi_value) const;
 
-  enum ESmFSizes {nZ = 57, nR = 28, nPhi = 37};
-
   const tpcrs::Configurator& cfg_;
 
   MagFieldType field_type_;
@@ -66,10 +150,10 @@ class MagField
   /// Defined by the value of MagFactor.ScaleFactor in Configurator
   double scale_factor_;
 
-  float Bz[nZ][nR], Br[nZ][nR] ;
-  float Radius[nR], ZList[nZ] ;
-  float Bz3D[nPhi][nZ][nR], Br3D[nPhi][nZ][nR], Bphi3D[nPhi][nZ][nR] ;
-  float R3D[nR], Z3D[nZ], Phi3D[nPhi] ;
+  /// The maps are immutable and shared by all instances using the same files.
+  /// With a constant field the 3D map is the 2D one
+  std::shared_ptr<const FieldMap> map_2d_;
+  std::shared_ptr<const FieldMap> map_3d_;
 };
 
 } }
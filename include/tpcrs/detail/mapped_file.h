@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * A read-only memory mapping of an entire file. The mapping is released when
+ * the object is destroyed.
+ */
+class MappedFile
+{
+ public:
+
+  /// Maps the file at path. If the file cannot be mapped data() is null
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return static_cast<const char*>(data_); }
+  size_t size() const { return size_; }
+
+ private:
+
+  void* data_;
+  size_t size_;
+};
+
+} }
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "TRandom.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * Counter-based pseudo random number generator Philox4x32-10 introduced in
+ * J. K. Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11.
+ *
+ * Every block of four 32-bit random numbers is a bijection of a 128-bit counter
+ * parametrized by a 64-bit key. Here the key is the seed and the counter is
+ * composed of a stream id given by three numbers plus the index of the block
+ * within the stream. Hence, a stream can be (re)started in any order without
+ * generating the preceding numbers, and the numbers drawn from it depend only
+ * on the seed and the stream id.
+ *
+ * The class implements the TRandom interface so that it can be used with all
+ * distributions provided by ROOT.
+ */
+class Philox : public TRandom
+{
+ public:
+
+  using Block = std::array<uint32_t, 4>;
+  using Key   = std::array<uint32_t, 2>;
+
+  explicit Philox(uint64_t seed = 0) : TRandom(), key_(), counter_(), block_(), next_(4)
+  {
+    SetKey(seed);
+  }
+
+  /// Sets the key and restarts the current stream
+  void SetKey(uint64_t seed)
+  {
+    key_ = {static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)};
+    counter_[0] = 0;
+    next_ = 4;
+  }
+
+  /// Overrides TRandom::SetSeed so the seed always sets the key
+  void SetSeed(ULong_t seed = 0)
+  {
+    SetKey(seed);
+  }
+
+  /// Starts the stream identified by three arbitrary numbers
+  void SetStream(uint32_t a, uint32_t b, uint32_t c)
+  {
+    counter_ = {0, c, b, a};
+    next_ = 4;
+  }
+
+  uint32_t Next()
+  {
+    if (next_ == 4) {
+      block_ = Generate(counter_, key_);
+      counter_[0]++;
+      next_ = 0;
+    }
+
+    return block_[next_++];
+  }
+
+  /// Returns a uniformly distributed number in the interval (0, 1)
+  double Rndm()
+  {
+    return (Next() + 0.5) * (1. / 4294967296.);
+  }
+
+  /// Older ROOT versions declare a Rndm with a dummy argument
+  double Rndm(int) { return Rndm(); }
+
+  void RndmArray(int n, float* array)
+  {
+    for (int i = 0; i < n; ++i) array[i] = Rndm();
+  }
+
+  void RndmArray(int n, double* array)
+  {
+    for (int i = 0; i < n; ++i) array[i] = Rndm();
+  }
+
+  /// Philox4x32 with 10 rounds
+  static Block Generate(Block counter, Key key)
+  {
+    for (int round = 0; round < 10; ++round) {
+      if (round) {
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+      }
+
+      uint64_t product0 = uint64_t(0xD2511F53) * counter[0];
+      uint64_t product1 = uint64_t(0xCD9E8D57) * counter[2];
+
+      counter = {
+        static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+        static_cast<uint32_t>(product1),
+        static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+        static_cast<uint32_t>(product0)
+      };
+    }
+
+    return counter;
+  }
+
+ private:
+
+  Key key_;
+
+  /// The last three words identify the stream, the first one counts blocks
+  Block counter_;
+
+  /// The current block of random numbers and the index of the next unused one
+  Block block_;
+  int next_;
+};
+
+} }
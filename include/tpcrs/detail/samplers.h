@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cmath>
+
+#include "TRandom.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * Samples the gamma distribution with the given shape and scale truncated to
+ * the interval [0, max] using the method of G. Marsaglia and W. W. Tsang, "A
+ * simple method for generating gamma variables", ACM TOMS 26 (2000) 363.
+ *
+ * The Polya distribution of the gas gain is a gamma distribution with the
+ * scale equal to the inverse of the shape.
+ */
+class GammaSampler
+{
+ public:
+
+  GammaSampler(double shape = 1, double scale = 1, double max = HUGE_VAL) :
+    shape_(shape),
+    scale_(scale),
+    max_(max),
+    d_((shape < 1 ? shape + 1 : shape) - 1. / 3),
+    c_(1 / std::sqrt(9 * d_))
+  {
+  }
+
+  double GetRandom(TRandom& random) const
+  {
+    double x;
+
+    // Rejecting the values above max preserves the shape of the distribution
+    do { x = scale_ * Standard(random); } while (x > max_);
+
+    return x;
+  }
+
+ private:
+
+  /// Returns a gamma variable with the unit scale
+  double Standard(TRandom& random) const
+  {
+    while (true) {
+      double z = random.Gaus(0, 1);
+      double v = 1 + c_ * z;
+
+      if (v <= 0) continue;
+
+      v = v * v * v;
+      double u = random.Rndm();
+
+      if (u < 1 - 0.0331 * z * z * z * z || std::log(u) < 0.5 * z * z + d_ * (1 - v + std::log(v))) {
+        // A sample for shape + 1 is scaled by U^(1/shape) when the shape is below 1
+        return shape_ < 1 ? d_ * v * std::pow(random.Rndm(), 1 / shape_) : d_ * v;
+      }
+    }
+  }
+
+  double shape_;
+  double scale_;
+  double max_;
+
+  /// Constants of the method for the effective shape >= 1
+  double d_;
+  double c_;
+};
+
+
+/**
+ * Samples the energy needed to create an ion pair, as given by Simulator::Ec,
+ * using the analytic inverse of its cumulative distribution. The density is
+ * flat between W/2 and W and falls as (W/x)^4 up to 3.064 W.
+ */
+class EcSampler
+{
+ public:
+
+  EcSampler(double W = 1) :
+    W_(W),
+    flat_(W / 2),
+    total_(flat_ + W / 3 * (1 - 1 / std::pow(3.064, 3)))
+  {
+  }
+
+  double GetRandom(TRandom& random) const
+  {
+    double t = total_ * random.Rndm();
+
+    if (t < flat_) return W_ / 2 + t;
+
+    return W_ / std::cbrt(1 - 3 * (t - flat_) / W_);
+  }
+
+ private:
+
+  double W_;
+
+  /// The integrals of the flat part and of the whole density
+  double flat_;
+  double total_;
+};
+
+} }
@@ -1,20 +1,36 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 #include <utility>
 
+#include "RVersion.h"
 #include "TH1.h"
 #include "TRandom.h"
 
 #include "tpcrs/tpcrs_core.h"
+#include "tpcrs/detail/binned_table.h"
+#include "tpcrs/detail/charge_accumulator.h"
 #include "tpcrs/detail/coords.h"
+#include "tpcrs/detail/derived_geometry.h"
+#include "tpcrs/detail/samplers.h"
+#include "tpcrs/detail/table_cache.h"
 #include "tpcrs/detail/digitizer.h"
 #include "tpcrs/detail/distorter.h"
 #include "tpcrs/detail/mag_field.h"
+#include "tpcrs/detail/philox.h"
 #include "tpcrs/detail/TF1F.h"
 #include "tpcrs/detail/track_helix.h"
 
 
+class StTpcdEdxCorrection;
+
+
 namespace tpcrs { namespace detail {
 
 
@@ -22,7 +38,91 @@ class Simulator
 {
  public:
 
-  Simulator(const tpcrs::Configurator& cfg);
+  class Context;
+
+  struct Options
+  {
+    /**
+     * With `n_threads` > 1 the sectors are simulated and digitized
+     * concurrently using up to `n_threads` threads including the calling one.
+     * The output is identical to the serial one. This requires a context with
+     * the counter-based generator. The sequential generator draws the random
+     * numbers of all sectors from one stream, so with it, e.g. in the calls
+     * without an explicit context, the sectors are processed serially.
+     */
+    unsigned int n_threads;
+
+    /**
+     * If false, only pads receiving some simulated charge are digitized and
+     * the pedestal noise alone cannot produce a signal elsewhere. This
+     * considerably reduces the time spent in digitization of low occupancy
+     * events.
+     */
+    bool digitize_empty_pads;
+
+    /**
+     * If true, the energy of primary clusters is drawn from an alias table in
+     * constant time instead of by a binary search over the cumulative dN/dE
+     * distribution. The distribution is the same, but a given random number
+     * maps to a different energy, so the output differs from the reference.
+     */
+    bool alias_sampling;
+
+    /**
+     * If true, the Polya gas gain and the ionization energy Ec are drawn with
+     * closed-form samplers, i.e. the Marsaglia-Tsang method and the analytic
+     * inverse of the cumulative distribution, instead of TF1::GetRandom. They
+     * work with any generator and ROOT version but, as with alias_sampling,
+     * change the output with respect to the reference.
+     */
+    bool closed_form_sampling;
+
+    /**
+     * If not empty, the response tables computed at construction, i.e. the
+     * shaper, pad response, and charge fraction functions, the dN/dE and
+     * dN/dx distributions, and the gain variations, are written to a file in
+     * this directory. The file name includes a hash of the configuration the
+     * tables depend on, so later constructions with the same configuration
+     * map the file instead of recomputing the tables. Update() recomputes
+     * the tables that depend on the configuration without the cache.
+     */
+    std::string cache_dir;
+
+    /**
+     * The distortions applied to the simulated hits. None by default. The
+     * static ones, i.e. the space charge, grid leak, and shorted rings, are
+     * solved for at construction.
+     */
+    Distorter::EnabledDistortions distortions;
+
+    /**
+     * If positive, the sum of the enabled distortions is tabulated at
+     * construction on a grid with nodes spaced by this distance in cm, and
+     * the hits are distorted by a trilinear interpolation of the table
+     * instead of an integration along the drift path of every hit. The table
+     * is computed with the field map from the configuration, and its
+     * deviation from the distortions computed for every hit is logged. A table with a step of 2 cm
+     * takes about 70 MB of memory and a few seconds to compute.
+     */
+    double distortion_table_step;
+
+    Options() : n_threads(1), digitize_empty_pads(true), alias_sampling(false), closed_form_sampling(false),
+      cache_dir(), distortions(), distortion_table_step(0) {}
+  };
+
+  Simulator(const tpcrs::Configurator& cfg, const Options& options = Options());
+  ~Simulator();
+
+  /**
+   * Switches to cfg, e.g. the configuration of the next run, keeping the
+   * options. Only the tables derived from the structs that differ between cfg
+   * and the current configuration are recomputed. For example, the gain
+   * variations and the shapers are recomputed only if the anode voltages
+   * change and the sector rotations only if the survey does. The current
+   * configuration must exist during the call and cfg as long as the
+   * simulator is used. Must not be called concurrently with the simulation.
+   */
+  void Update(const tpcrs::Configurator& cfg);
 
   template<typename InputIt, typename OutputIt>
   OutputIt Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized) const;
@@ -30,16 +130,22 @@ class Simulator
   template<typename InputIt, typename OutputIt, typename MagField>
   OutputIt Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized, const MagField& mag_field) const;
 
+  template<typename InputIt, typename OutputIt, typename MagField>
+  OutputIt Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized, const MagField& mag_field, Context& context) const;
+
   template<typename InputIt, typename OutputIt>
   OutputIt Distort(InputIt first_hit, InputIt last_hit, OutputIt distorted) const;
 
   template<typename InputIt, typename OutputIt>
   OutputIt Simulate(InputIt first_hit, InputIt last_hit, OutputIt charges) const;
 
+  template<typename InputIt, typename OutputIt, typename MagField>
+  OutputIt Simulate(InputIt first_hit, InputIt last_hit, OutputIt charges, const MagField& mag_field, Context& context) const;
+
  private:
 
   template<typename InputIt, typename OutputIt1, typename OutputIt2, typename MagField>
-  void Simulate(InputIt first_hit, InputIt last_hit, OutputIt1 charges, OutputIt2 digitized, const MagField& mag_field) const;
+  void Simulate(InputIt first_hit, InputIt last_hit, OutputIt1 charges, OutputIt2 digitized, const MagField& mag_field, Context& context) const;
 
   struct TrackSegment {
     int charge;
@@ -56,8 +162,16 @@ class Simulator
     TrackHelix track;
   };
 
-  using ChargeContainer = std::vector<tpcrs::SimulatedCharge>;
-  using TrackSegments   = std::vector<TrackSegment>;
+  using TrackSegments = std::vector<TrackSegment>;
+
+  /// A range of consecutive segments in the same sector
+  struct SectorSegments {
+    unsigned int sector;
+    TrackSegments::const_iterator first;
+    TrackSegments::const_iterator last;
+    /// Index of the first segment in the event
+    unsigned int index;
+  };
 
   enum InOut {kInner = 0, kOuter = 1};
 
@@ -68,9 +182,13 @@ class Simulator
 
   enum {kPadMax = 32, kTimeBacketMax = 64};
 
-  const tpcrs::Configurator& cfg_;
-  const CoordTransform transform_;
+  const tpcrs::Configurator* cfg_;
+  std::shared_ptr<const DerivedGeometry> geom_;
+  std::unique_ptr<const CoordTransform> transform_;
   tpcrs::DigiChannelMap digi_;
+  std::unique_ptr<const Distorter> distorter_;
+  std::unique_ptr<const Digitizer> digitizer_;
+  std::unique_ptr<const StTpcdEdxCorrection> dEdx_correction_;
 
   static double shapeEI(double* x, double* par = 0);
   static double shapeEI(double t, double t0, double tau_I, double tau_C);
@@ -110,7 +228,43 @@ class Simulator
   double GetNoPrimaryClusters(double betaGamma, int charge) const;
 
   template<typename OutputIt1, typename OutputIt2>
-  void SimulateCharge(const TrackSegments& segments, OutputIt1 charges, OutputIt2 digitized) const;
+  void SimulateCharge(const TrackSegments& segments, OutputIt1 charges, OutputIt2 digitized, Context& context) const;
+
+  template<typename OutputIt1, typename OutputIt2>
+  void SimulateChargeParallel(const std::vector<SectorSegments>& groups, OutputIt1 charges, OutputIt2 digitized, Context& context) const;
+
+  template<typename OutputIt1, typename OutputIt2>
+  void SimulateSector(const SectorSegments& group, OutputIt1 charges, OutputIt2 digitized, Context& context) const;
+
+  std::vector<SectorSegments> GroupBySector(const TrackSegments& segments) const;
+
+  /// Returns true if the sectors can be simulated concurrently with the
+  /// context, i.e. if its generator is counter-based. Warns once otherwise
+  bool SimulatesInParallel(const Context& context) const;
+
+  /// Properties of the electrons in a cluster stored as separate arrays so that
+  /// the transport of all electrons can be vectorized
+  struct ElectronBatch
+  {
+    /// Random draws: gas gain, transverse and longitudinal diffusion
+    std::vector<double> gain, rx, ry, rz;
+    /// Position after diffusion
+    std::vector<double> x, y, z;
+    /// Position at the readout plane
+    std::vector<double> readout_x, readout_y, readout_z;
+    std::vector<char> missed_readout, is_ground_wire;
+    std::vector<int> row_min, row_max;
+
+    void resize(size_t n)
+    {
+      for (auto v : {&gain, &rx, &ry, &rz, &x, &y, &z, &readout_x, &readout_y, &readout_z})
+        v->resize(n);
+      missed_readout.resize(n);
+      is_ground_wire.resize(n);
+      row_min.resize(n);
+      row_max.resize(n);
+    }
+  };
 
   template<typename InputIt, typename OutputIt, typename MagField>
   TrackSegments CreateTrackSegments(InputIt first_hit, InputIt last_hit, OutputIt distorted, const MagField& mag_field) const;
@@ -118,23 +272,23 @@ class Simulator
   template<typename OutputIt, typename MagField>
   TrackSegment CreateTrackSegment(const tpcrs::SimulatedHit& hit, OutputIt distorted, const MagField& mag_field) const;
 
-  double CalcBaseGain(int sector, int row) const;
-  double CalcLocalGain(const TrackSegment& segment) const;
+  double CalcBaseGain(int sector, int row, TRandom& random) const;
+  double CalcLocalGain(const TrackSegment& segment, TRandom& random) const;
 
   void SignalFromSegment(const TrackSegment& segment,
-    double gain_local,
-    ChargeContainer& binned_charge, int& nP, double& dESum, double& dSSum) const;
+    double gain_local, Context& context, int& nP, double& dESum, double& dSSum) const;
 
   void LoopOverElectronsInCluster(
-    const std::vector<float>& rs, const TrackSegment& segment, ChargeContainer& binned_charge,
+    const std::vector<float>& rs, const TrackSegment& segment, Context& context,
     double xRange, Coords xyzC, double gain_local) const;
 
   void GenerateSignal(const TrackSegment &segment, Coords at_readout, int rowMin, int rowMax,
-                      const TF1F* shaper, ChargeContainer& binned_charge, double gain_local_gas) const;
+                      const TF1F* shaper, Context& context, double gain_local_gas) const;
 
-  std::vector<float> NumberOfElectronsInCluster(const TF1& heed, float dE, float& dEr) const;
+  std::vector<float> NumberOfElectronsInCluster(const TF1& heed, float dE, float& dEr, TRandom& random) const;
 
-  Coords TransportToReadout(const Coords c, double omega_tau, bool& missed_readout, bool& is_ground_wire) const;
+  /// Snaps the electrons in [first, last) to the anode wires
+  void TransportToReadout(ElectronBatch& electrons, size_t first, size_t last, double omega_tau) const;
 
   double dEdxCorrection(const TrackSegment &segment) const;
 
@@ -151,6 +305,32 @@ class Simulator
 
   void InitAlphaGainVariations(double t0IO[2]);
 
+  /// Computes the pad response and charge fraction functions for all sectors
+  void InitPadResponses();
+
+  /// Computes the gain variations and the shaper functions for all sectors
+  void InitShaperResponses();
+
+  /// Computes the shaper, pad response, and charge fraction functions, the
+  /// gain variations, and loads the dN/dE and dN/dx distributions
+  void InitResponseTables();
+
+  /// Same as InitResponseTables() but uses the tables saved in the cache
+  /// directory if any
+  void SetupResponseTables();
+
+  /// Sets up the Polya and Ec distributions of the gas gain and ionization
+  void InitGainSamplers();
+
+  /// Hash of the configuration and input files the response tables depend on
+  uint64_t ResponseTablesKey() const;
+
+  /// Uses the response tables from a cache file. Returns false if the file
+  /// does not exist or does not match the key
+  bool LoadResponseTables(const std::string& path, uint64_t key);
+
+  void SaveResponseTables(const std::string& path, uint64_t key) const;
+
   static TF1 fgTimeShape3[2];
   static TF1 fgTimeShape0[2];
 
@@ -159,13 +339,14 @@ class Simulator
 
   /// The number of primary electrons per unit length as a function of
   /// beta*gamma
-  TH1D  dNdx_;
-  TH1D  dNdx_log10_;
+  BinnedTable  dNdx_;
+  BinnedTable  dNdx_log10_;
 
   /// A probability distribution for energy lost by primary electrons.
   /// Can be parameterized as
   /// dE = TpcResponseSimulator.W * gRandom->Poisson(TpcResponseSimulator.Cluster);
-  TH1D  dNdE_log10_;
+  BinnedTable  dNdE_log10_;
+  AliasTable   dNdE_log10_alias_;
 
   std::array<std::vector<TF1F>, 2>  mShaperResponses;
   std::vector<TF1F>  mChargeFraction;
@@ -173,22 +354,104 @@ class Simulator
   std::vector<TF1F>  mPolya;
   TF1    mHeed;
 
+  /// Closed-form alternatives to mPolya and mHeed
+  GammaSampler polya_samplers_[2];
+  EcSampler ec_sampler_;
+
   std::vector<double> alpha_gain_variations_;
+
+  /// Mapped cache file holding the saved values of the response functions
+  std::unique_ptr<TableCache> table_cache_;
+
+  /// Counts calls made without an explicit context. Used to seed the random
+  /// number generator of the implicit per-call context
+  mutable std::atomic<unsigned int> n_calls_;
+
+  /// Set when the fallback to the serial processing has been reported
+  mutable std::atomic<bool> serial_fallback_reported_;
+
+  Options options_;
+};
+
+
+/**
+ * Holds the state modified while simulating a set of hits: the random number
+ * generator and the scratch buffers for the electrons of a cluster and the
+ * charge binned in a sector. The Simulator itself is not modified by
+ * Digitize/Simulate/Distort, so a single instance can be shared by many
+ * threads as long as each of them passes its own Context. The context can be
+ * reused between calls to avoid reallocating the buffers.
+ *
+ * The seed identifies an event. With the default counter-based generator the
+ * random numbers for every track segment and for the noise in every sector
+ * are drawn from independent streams keyed by (seed, sector, track id,
+ * segment index). Thus, the output does not depend on the order in which the
+ * segments and sectors are processed. The sequential generator is TRandom3
+ * producing a single stream as in the original STAR code. It is used by the
+ * calls without an explicit context to reproduce the reference output.
+ *
+ * Prior to ROOT 6.24 TF1::GetRandom can only sample with the global gRandom. In
+ * this case the sequential context uses gRandom too, and concurrent calls are
+ * not safe.
+ */
+class Simulator::Context
+{
+ public:
+
+  enum class Generator { kCounterBased, kSequential };
+
+  explicit Context(uint64_t seed = 2345, Generator generator = Generator::kCounterBased);
+
+  /// Sets the seed for the next event
+  void SetSeed(uint64_t seed);
+
+  TRandom& random() { return *random_; }
+
+ private:
+
+  friend class Simulator;
+
+  /// Switches the counter-based generator to the stream identified by the
+  /// arguments. Has no effect on the sequential generator
+  void SetStream(unsigned int sector, int track_id, unsigned int segment);
+
+  /// Track id reserved for the stream used to digitize a sector
+  static constexpr int kNoiseStream = -1;
+
+  uint64_t seed_;
+
+  Generator generator_;
+
+  std::unique_ptr<TRandom> engine_;
+  TRandom* random_;
+  Philox* philox_;
+
+  ChargeAccumulator binned_charge_;
+
+  ElectronBatch electrons_;
 };
 
 
 template<typename InputIt, typename OutputIt>
 OutputIt Simulator::Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized) const
 {
-  return Digitize(first_hit, last_hit, digitized, MagField(cfg_));
+  return Digitize(first_hit, last_hit, digitized, MagField(*cfg_));
 }
 
 
 template<typename InputIt, typename OutputIt, typename MagField>
 OutputIt Simulator::Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized, const MagField& mag_field) const
+{
+  Context context(2345 + n_calls_++, Context::Generator::kSequential);
+  return Digitize(first_hit, last_hit, digitized, mag_field, context);
+}
+
+
+template<typename InputIt, typename OutputIt, typename MagField>
+OutputIt Simulator::Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized, const MagField& mag_field, Context& context) const
 {
   std::vector<tpcrs::SimulatedChargeChannel> dummy;
-  Simulate(first_hit, last_hit, std::back_inserter(dummy), digitized, mag_field);
+  Simulate(first_hit, last_hit, std::back_inserter(dummy), digitized, mag_field, context);
   return digitized;
 }
 
@@ -196,27 +459,35 @@ OutputIt Simulator::Digitize(InputIt first_hit, InputIt last_hit, OutputIt digit
 template<typename InputIt, typename OutputIt>
 OutputIt Simulator::Distort(InputIt first_hit, InputIt last_hit, OutputIt distorted) const
 {
-  TrackSegments dummy = CreateTrackSegments(first_hit, last_hit, distorted, MagField(cfg_));
+  TrackSegments dummy = CreateTrackSegments(first_hit, last_hit, distorted, MagField(*cfg_));
   return distorted;
 }
 
 
 template<typename InputIt, typename OutputIt>
 OutputIt Simulator::Simulate(InputIt first_hit, InputIt last_hit, OutputIt charges) const
+{
+  Context context(2345 + n_calls_++, Context::Generator::kSequential);
+  return Simulate(first_hit, last_hit, charges, MagField(*cfg_), context);
+}
+
+
+template<typename InputIt, typename OutputIt, typename MagField>
+OutputIt Simulator::Simulate(InputIt first_hit, InputIt last_hit, OutputIt charges, const MagField& mag_field, Context& context) const
 {
   std::vector<tpcrs::DigiHit> dummy;
-  Simulate(first_hit, last_hit, charges, std::back_inserter(dummy), MagField(cfg_));
+  Simulate(first_hit, last_hit, charges, std::back_inserter(dummy), mag_field, context);
   return charges;
 }
 
 
 template<typename InputIt, typename OutputIt1, typename OutputIt2, typename MagField>
-void Simulator::Simulate(InputIt first_hit, InputIt last_hit, OutputIt1 charges, OutputIt2 digitized, const MagField& mag_field) const
+void Simulator::Simulate(InputIt first_hit, InputIt last_hit, OutputIt1 charges, OutputIt2 digitized, const MagField& mag_field, Context& context) const
 {
   std::vector<tpcrs::DistortedHit> dummy;
   TrackSegments segments = CreateTrackSegments(first_hit, last_hit, std::back_inserter(dummy), mag_field);
 
-  SimulateCharge(segments, charges, digitized);
+  SimulateCharge(segments, charges, digitized, context);
 }
 
 
@@ -245,9 +516,9 @@ Simulator::TrackSegment Simulator::CreateTrackSegment(const tpcrs::SimulatedHit&
   StTpcLocalSectorCoordinate coorS;
   // GlobalCoord -> LocalSectorCoord. This transformation can result in a row
   // that is not the same as (volId % 100)
-  transform_.global_to_local_sector(xyzG, coorS, sector, 0);
+  transform_->global_to_local_sector(xyzG, coorS, sector, 0);
   StTpcLocalCoordinate coorLT;  // before distortions
-  transform_.global_to_local(xyzG, coorLT, sector, coorS.row);
+  transform_->global_to_local(xyzG, coorLT, sector, coorS.row);
 
   // Get magnetic field at the hit position
   auto B_field = mag_field.ValueAt( Coords{hit.x, hit.y, hit.z});
@@ -257,44 +528,43 @@ Simulator::TrackSegment Simulator::CreateTrackSegment(const tpcrs::SimulatedHit&
   StGlobalDirection dirG{pxyzG.unit()}; // XXX Why scale the momentum?
   // TODO: Remove cast to float when new reference is introduced for tests
   StGlobalDirection BG{float(B_field.x), float(B_field.y), float(B_field.z)};
-  transform_.global_to_local_sector_dir( dirG, segment.dirLS, sector, coorS.row);
-  transform_.global_to_local_sector_dir(   BG, segment.BLS,   sector, coorS.row);
+  transform_->global_to_local_sector_dir( dirG, segment.dirLS, sector, coorS.row);
+  transform_->global_to_local_sector_dir(   BG, segment.BLS,   sector, coorS.row);
 
   // Distortions
-  static Distorter distorter(cfg_);
-  coorLT.position = distorter.Distort(coorLT.position, coorLT.sector, mag_field);
-  transform_.local_to_global(coorLT, xyzG);
+  coorLT.position = distorter_->Distort(coorLT.position, coorLT.sector, mag_field);
+  transform_->local_to_global(coorLT, xyzG);
 
-  transform_.local_to_local_sector(coorLT, segment.coorLS);
+  transform_->local_to_local_sector(coorLT, segment.coorLS);
 
   *distorted = tpcrs::DistortedHit{
     xyzG.position.x, xyzG.position.y, xyzG.position.z,
     dirG.position.x, dirG.position.y, dirG.position.z
   };
 
-  double driftLength = segment.coorLS.position.z + hit.tof * tpcrs::DriftVelocity(sector, cfg_);
+  double driftLength = segment.coorLS.position.z + hit.tof * geom_->drift_velocity(sector);
 
   if (driftLength > -1.0 && driftLength <= 0) {
-    if ((!tpcrs::IsInner(coorS.row, cfg_) && driftLength > - cfg_.S<tpcWirePlanes>().outerSectorAnodeWirePadSep) ||
-        ( tpcrs::IsInner(coorS.row, cfg_) && driftLength > - cfg_.S<tpcWirePlanes>().innerSectorAnodeWirePadSep))
+    if ((!geom_->is_inner(coorS.row) && driftLength > - cfg_->S<tpcWirePlanes>().outerSectorAnodeWirePadSep) ||
+        ( geom_->is_inner(coorS.row) && driftLength > - cfg_->S<tpcWirePlanes>().innerSectorAnodeWirePadSep))
       driftLength = std::abs(driftLength);
   }
 
   segment.coorLS.position.z = driftLength;
-  transform_.local_sector_to_hardware(segment.coorLS, segment.Pad);
+  transform_->local_sector_to_hardware(segment.coorLS, segment.Pad);
 
   // Magnetic field BField must be in kilogauss
   // kilogauss = 1e-1*tesla = 1e-1*(volt*second/meter2) = 1e-1*(1e-6*1e-3*1/1e4) = 1e-14
   segment.track = TrackHelix(segment.dirLS.position, segment.coorLS.position, segment.BLS.position.z * 1e-14, segment.charge);
   // Propagate track to the middle of the pad row plane defined by the
   // nominal center point and the normal in this sector coordinate system
-  double s = segment.track.pathLength({0, tpcrs::RadialDistanceAtRow(segment.Pad.row, cfg_), 0}, {0, 1, 0});
+  double s = segment.track.pathLength({0, geom_->radius(segment.Pad.row), 0}, {0, 1, 0});
   // Save updated hit position based on the new track crossing the middle of pad row
   segment.Pad2 = segment.Pad;
   segment.coorLS2 = segment.coorLS;
   if (s != TrackHelix::NoSolution) {
     segment.coorLS2.position = {segment.track.at(s).x, segment.track.at(s).y, segment.track.at(s).z};
-    transform_.local_sector_to_hardware(segment.coorLS2, segment.Pad2);
+    transform_->local_sector_to_hardware(segment.coorLS2, segment.Pad2);
   }
 
   return segment;
@@ -302,66 +572,114 @@ Simulator::TrackSegment Simulator::CreateTrackSegment(const tpcrs::SimulatedHit&
 
 
 template<typename OutputIt1, typename OutputIt2>
-void Simulator::SimulateCharge(const TrackSegments& segments, OutputIt1 charges, OutputIt2 digitized) const
+void Simulator::SimulateCharge(const TrackSegments& segments, OutputIt1 charges, OutputIt2 digitized, Context& context) const
 {
-  static Digitizer digitizer(cfg_);
+  std::vector<SectorSegments> groups = GroupBySector(segments);
+
+  if (options_.n_threads > 1 && SimulatesInParallel(context)) {
+    SimulateChargeParallel(groups, charges, digitized, context);
+    return;
+  }
 
-  static int nCalls = 0;
-  gRandom->SetSeed(2345 + nCalls++);
+  for (const SectorSegments& group : groups)
+    SimulateSector(group, charges, digitized, context);
+}
 
-  ChargeContainer binned_charge(digi_.total_timebins(), {0, 0});
 
-  // Fill container with zero suppressed charges
-  auto suppress_zeros = [this](unsigned sector, ChargeContainer::const_iterator first, ChargeContainer::const_iterator last, OutputIt1 charges)
+/**
+ * Sectors are independent and processed by a pool of threads picking them one
+ * by one. The output for each sector is buffered and copied in the order of
+ * the input, so the result is the same as if the sectors were processed
+ * serially.
+ */
+template<typename OutputIt1, typename OutputIt2>
+void Simulator::SimulateChargeParallel(const std::vector<SectorSegments>& groups, OutputIt1 charges, OutputIt2 digitized, Context& context) const
+{
+  std::vector< std::vector<tpcrs::SimulatedChargeChannel> > sector_charges(groups.size());
+  std::vector< std::vector<tpcrs::DigiHit> > sector_digits(groups.size());
+
+  std::atomic<size_t> next_group(0);
+
+  auto worker = [&](Context& worker_context)
   {
-    DigiChannel channel{sector, 1, 1, 1};
-    while (first != last) {
-      if (first->charge != 0) {
-        *charges = {channel, first->charge, first->track_id};
-        ++charges;
-      }
-      ++first;
-      digi_.next(channel);
+    for (size_t i = next_group++; i < groups.size(); i = next_group++)
+    {
+      SimulateSector(groups[i], std::back_inserter(sector_charges[i]), std::back_inserter(sector_digits[i]), worker_context);
     }
   };
 
-  auto reset_at_boundary = [this, suppress_zeros](unsigned sector, ChargeContainer& binned_charge, OutputIt1 charges, OutputIt2 digitized)
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,24,0)
+  size_t n_workers = std::min(static_cast<size_t>(options_.n_threads), groups.size());
+#else
+  // ROOT samples with gRandom only, see Simulator::Context
+  size_t n_workers = 1;
+#endif
+
+  std::vector<Context> worker_contexts;
+  worker_contexts.reserve(n_workers);
+  for (size_t i = 0; i < n_workers; ++i)
+    worker_contexts.emplace_back(context.seed_, context.generator_);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < n_workers; ++i)
+    threads.emplace_back(worker, std::ref(worker_contexts[i]));
+
+  if (n_workers > 0) worker(worker_contexts[0]);
+
+  for (std::thread& thread : threads)
+    thread.join();
+
+  for (size_t i = 0; i < groups.size(); ++i)
   {
-    suppress_zeros(sector, begin(binned_charge), end(binned_charge), charges);
-    digitizer.Digitize(sector, begin(binned_charge), end(binned_charge), digitized);
-    ChargeContainer(digi_.total_timebins(), {0, 0}).swap(binned_charge);
-  };
+    std::copy(begin(sector_charges[i]), end(sector_charges[i]), charges);
+    std::copy(begin(sector_digits[i]), end(sector_digits[i]), digitized);
+  }
+}
+
+
+template<typename OutputIt1, typename OutputIt2>
+void Simulator::SimulateSector(const SectorSegments& group, OutputIt1 charges, OutputIt2 digitized, Context& context) const
+{
+  ChargeAccumulator& binned_charge = context.binned_charge_;
+  binned_charge.Reset(digi_.total_timebins() / digi_.n_timebins, digi_.n_timebins);
+
+  unsigned int index = group.index;
 
-  for (auto segment_iter = begin(segments); segment_iter != end(segments); ++segment_iter)
+  for (auto segment_iter = group.first; segment_iter != group.last; ++segment_iter, ++index)
   {
-    auto segment = *segment_iter;
-    unsigned curr_sector =      segment_iter ->simu_hit.volume_id % 10000 / 100;
-    unsigned next_sector = next(segment_iter)->simu_hit.volume_id % 10000 / 100;
+    const TrackSegment& segment = *segment_iter;
 
-    bool boundary = next_sector != curr_sector;
+    context.SetStream(group.sector, segment.simu_hit.track_id, index);
 
     if (segment.charge == 0 || segment.Pad.timeBucket < 0 || segment.Pad.timeBucket > digi_.n_timebins)
-    {
-      if (boundary) reset_at_boundary(curr_sector, binned_charge, charges, digitized);
       continue;
-    }
 
     // Calculate local gain corrected for dE/dx
-    double gain_local = CalcLocalGain(segment);
+    double gain_local = CalcLocalGain(segment, context.random());
     if (gain_local == 0)
-    {
-      if (boundary) reset_at_boundary(curr_sector, binned_charge, charges, digitized);
       continue;
-    }
 
     int nP = 0;
     double dESum = 0;
     double dSSum = 0;
 
-    SignalFromSegment(segment, gain_local, binned_charge, nP, dESum, dSSum);
-
-    if (boundary) reset_at_boundary(curr_sector, binned_charge, charges, digitized);
+    SignalFromSegment(segment, gain_local, context, nP, dESum, dSSum);
   }
+
+  binned_charge.Sort();
+
+  // Fill container with zero suppressed charges
+  binned_charge.ForEachNonZero([&](int pad_index, int timebin, const tpcrs::SimulatedCharge& charge)
+  {
+    DigiChannel channel = digi_.channels[pad_index * digi_.n_timebins + timebin];
+    channel.sector = group.sector;
+    *charges = {channel, charge.charge, charge.track_id};
+    ++charges;
+  });
+
+  // Unsorted input may give several groups in the same sector
+  context.SetStream(group.sector, Context::kNoiseStream, group.index);
+  digitizer_->Digitize(group.sector, binned_charge, digitized, context.random(), options_.digitize_empty_pads);
 }
 
 
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include "TArrayF.h"
 #include "TArrayD.h"
 #include "TGeoMatrix.h"
 #include "TMath.h"
-#include "TF1.h"
 
 #include "tpcrs/tpcrs_core.h"
 #include "config_structs.h"
@@ -21,9 +23,17 @@ bool IsInner(int row, const Configurator& cfg);
 TPC::Half DetectorSide(int sector, const Configurator& cfg);
 double RadialDistanceAtRow(int row, const Configurator& cfg);
 
+/// Returns the rate of the luminosity detector selected by the calibration tables
+double ScalerRate(const trigDetSums& scalers, int detector);
+
 }
 
 
+/**
+ * Multivariate polynomial parameterizations in up to two variables. The
+ * polynomial of every row is tabulated on a regular grid when the table is
+ * loaded and Eval() interpolates the grid linearly in each variable.
+ */
 struct St_MDFCorrectionC : tpcrs::IConfigStruct {
   virtual MDFCorrection* Struct(int i = 0) const = 0;
   enum EMDFPolyType {
@@ -32,14 +42,7 @@ struct St_MDFCorrectionC : tpcrs::IConfigStruct {
     kLegendre
   };
 
-  St_MDFCorrectionC();
-
-  void Initialize()
-  {
-    unsigned int N = GetNRows();
-    fFunc = new TF1*[N];
-    memset(fFunc, 0, N*sizeof(TF1*));
-  }
+  void Initialize();
 
   unsigned char 	idx(int k = 0)        	const {return Struct(k)->idx;}
   unsigned char 	nrows(int k = 0) 	        const {return Struct(k)->nrows;}
@@ -52,16 +55,33 @@ struct St_MDFCorrectionC : tpcrs::IConfigStruct {
   double* 	XMax(int k = 0)       	const {return Struct(k)->XMax;}
   double* 	Coefficients(int k = 0) 	const {return Struct(k)->Coefficients;}
   double* 	CoefficientsRMS(int k = 0) 	const {return Struct(k)->CoefficientsRMS;}
+  /// Interpolates the tabulated parameterization in row k at x clamped to the range of the row
   double      Eval(int k = 0, double *x = 0) const;
   double      Eval(int k, double x0, double x1) const;
+  /// Evaluates the polynomial in row k exactly at x
+  double      EvalPolynomial(int k, const double *x) const;
   double      EvalError(int k = 0, double *x = 0) const;
-  static double MDFunc(double *x = 0, double *p = 0);
-  static St_MDFCorrectionC *fgMDFCorrectionC;
- protected:
-  virtual ~St_MDFCorrectionC();
  private:
-  double EvalFactor(int k = 0, int p = 0, double x = 0) const;
-  TF1         **fFunc;
+  /// The struct holds the ranges of at most two variables
+  static const int kMaxVariables = 2;
+
+  /// Values of the parameterization of a row at the nodes of a regular grid
+  struct Grid {
+    int n_vars;
+    /// Number of intervals along each variable
+    int n[kMaxVariables];
+    double x_min[kMaxVariables];
+    double x_max[kMaxVariables];
+    /// Indexed by [x1][x0]
+    std::vector<double> values;
+  };
+
+  /// Evaluates the basis functions of variable j in row k at the scaled y up to the largest power used
+  void EvalBasis(int k, int j, double y, double *basis) const;
+
+  std::vector<Grid> fGrids;
+  /// The largest power of each variable in each row
+  std::vector<std::array<int, kMaxVariables>> fMaxPowers;
 };
 
 
@@ -97,6 +117,7 @@ struct St_spaceChargeCorC : tpcrs::IConfigStruct {
 struct St_spaceChargeCorR1C : tpcrs::ConfigStruct<St_spaceChargeCorC, St_spaceChargeCorR1C, spaceChargeCor>
 {
   St_spaceChargeCorR1C(const tpcrs::Configurator& cfg) : tpcrs::ConfigStruct<St_spaceChargeCorC, St_spaceChargeCorR1C, spaceChargeCor>(cfg) {}
+  using dependencies = tpcrs::TypeList<MagFactor, trigDetSums>;
   double getSpaceChargeCorrection(){return  St_spaceChargeCorC::getSpaceChargeCorrection(cfg_.S<MagFactor>().ScaleFactor);}
   double getSpaceChargeCoulombs(){return St_spaceChargeCorC::getSpaceChargeCoulombs(cfg_);}
 };
@@ -104,6 +125,7 @@ struct St_spaceChargeCorR1C : tpcrs::ConfigStruct<St_spaceChargeCorC, St_spaceCh
 struct St_spaceChargeCorR2C : tpcrs::ConfigStruct<St_spaceChargeCorC, St_spaceChargeCorR2C, spaceChargeCor>
 {
   St_spaceChargeCorR2C(const tpcrs::Configurator& cfg) : tpcrs::ConfigStruct<St_spaceChargeCorC, St_spaceChargeCorR2C, spaceChargeCor>(cfg) {}
+  using dependencies = tpcrs::TypeList<MagFactor, trigDetSums>;
   double getSpaceChargeCorrection(){return  St_spaceChargeCorC::getSpaceChargeCorrection(cfg_.S<MagFactor>().ScaleFactor);}
   double getSpaceChargeCoulombs(){return St_spaceChargeCorC::getSpaceChargeCoulombs(cfg_);}
 };
@@ -158,6 +180,7 @@ struct St_tpcAnodeHVC : tpcrs::ConfigStruct<tpcrs::IConfigStruct, St_tpcAnodeHVC
 struct St_TpcAvgCurrentC : tpcrs::ConfigStruct<tpcrs::IConfigStruct, St_TpcAvgCurrentC, TpcAvgCurrent>
 {
   St_TpcAvgCurrentC(const tpcrs::Configurator& cfg) : tpcrs::ConfigStruct<tpcrs::IConfigStruct, St_TpcAvgCurrentC, TpcAvgCurrent>(cfg) {}
+  using dependencies = tpcrs::TypeList<St_TpcAvgPowerSupplyC>;
   static int  ChannelFromSocket(int socket);
   float       AvCurrent(int sector = 1, int channel = 1);
   float       AvCurrRow(int sector = 1, int row = 1) {return AvCurrent(sector, tpcrs::ChannelFromRow(row));}
@@ -169,6 +192,7 @@ struct St_TpcAvgCurrentC : tpcrs::ConfigStruct<tpcrs::IConfigStruct, St_TpcAvgCu
 struct St_TpcAvgPowerSupplyC : tpcrs::ConfigStruct<tpcrs::IConfigStruct, St_TpcAvgPowerSupplyC, TpcAvgPowerSupply>
 {
   St_TpcAvgPowerSupplyC(const tpcrs::Configurator& cfg) : tpcrs::ConfigStruct<tpcrs::IConfigStruct, St_TpcAvgPowerSupplyC, TpcAvgPowerSupply>(cfg) {}
+  using dependencies = tpcrs::TypeList<tpcPadPlanes>;
   float* 	Current(int i = 0) 	const {return Struct(i)->Current;}
   float* 	Charge(int i = 0) 	const {return Struct(i)->Charge;}
   float* 	Voltage(int i = 0) 	const {return Struct(i)->Voltage;}
@@ -203,6 +227,8 @@ struct St_tpcCorrectionC : tpcrs::IConfigStruct
   double 	max(int i = 0) 	const {return Struct(i)->max;}
   double* 	a(int i = 0) 	        const {return Struct(i)->a;}
   double CalcCorrection(int i, double x, double z = 0, int NparMax = -1) const;
+  /// Evaluates the correction in row i at n values of x
+  void CalcCorrection(int i, const double* x, double* result, int n, double z = 0, int NparMax = -1) const;
   double SumSeries(tpcCorrection* cor, double x, double z = 0, int NparMax = -1) const;
 };
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tpcrs/detail/mapped_file.h"
+
+
+namespace tpcrs { namespace detail {
+
+
+/**
+ * A versioned binary file holding a sequence of doubles identified by a 64-bit
+ * key. The file is memory-mapped when read so that the tables stored in it can
+ * be used in place. A file with a different format version or key, or a
+ * truncated one, is treated as missing.
+ */
+class TableCache
+{
+ public:
+
+  /// Incremented whenever the layout of the stored tables changes
+  static const uint32_t kVersion = 1;
+
+  /// Maps the file at path if it has the expected version and key
+  TableCache(const std::string& path, uint64_t key);
+
+  TableCache(const TableCache&) = delete;
+  TableCache& operator=(const TableCache&) = delete;
+
+  bool valid() const { return data_ != nullptr; }
+
+  /// Returns a pointer to the next n values or null if there are fewer left
+  const double* Read(size_t n);
+
+  /// Reads a single value into x. Returns false if there are no values left
+  bool Read(double& x);
+
+  /// Writes the values to a file at path atomically. Returns false on failure
+  static bool Write(const std::string& path, uint64_t key, const std::vector<double>& values);
+
+  /// FNV-1a hash of the bytes continuing from the given hash value
+  static uint64_t Hash(const void* bytes, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+  static uint64_t Hash(const std::string& str, uint64_t hash = 14695981039346656037ULL)
+  {
+    return Hash(str.data(), str.size(), hash);
+  }
+
+ private:
+
+  std::unique_ptr<MappedFile> file_;
+
+  const double* data_;
+  size_t size_;
+  size_t position_;
+};
+
+} }
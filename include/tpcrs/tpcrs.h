@@ -16,6 +16,31 @@ class MagField : detail::MagField
 
   template<typename Vec3>
   Vec3 ValueAt(Vec3 p) const { return detail::MagField::ValueAt(p); }
+
+  /// Evaluates the field at n points
+  template<typename Vec3>
+  void ValueAt(const Vec3* points, size_t n, Vec3* values) const { detail::MagField::ValueAt(points, n, values); }
+
+  void ValueAt(size_t n, const double* x, const double* y, const double* z,
+               double* Bx, double* By, double* Bz) const
+  {
+    detail::MagField::ValueAt(n, x, y, z, Bx, By, Bz);
+  }
+
+  /// Evaluates the 3D field map at a point in single precision
+  void ValueAt3D(const float x[3], float B[3]) const { detail::MagField::GetFieldValue3D(x, B); }
+
+  /// Evaluates the 3D field map at n points. The components are converted to
+  /// float, and the result for every point is the same as that of
+  /// ValueAt3D(const float*, float*)
+  template<typename Vec3>
+  void ValueAt3D(const Vec3* points, size_t n, Vec3* values) const { detail::MagField::GetFieldValue3D(points, n, values); }
+
+  void ValueAt3D(size_t n, const float* x, const float* y, const float* z,
+                 float* Bx, float* By, float* Bz) const
+  {
+    detail::MagField::GetFieldValue3D(n, x, y, z, Bx, By, Bz);
+  }
 };
 
 
@@ -23,7 +48,15 @@ class Simulator : detail::Simulator
 {
  public:
 
-  Simulator(const tpcrs::Configurator& cfg) : detail::Simulator(cfg) {}
+  /// Per-call state: random number generator and scratch buffers. Use one
+  /// context per thread to share a Simulator between threads. The context
+  /// seed, set at construction or with Context::SetSeed(), defines the random
+  /// numbers drawn for an event
+  using Context = detail::Simulator::Context;
+
+  using Options = detail::Simulator::Options;
+
+  Simulator(const tpcrs::Configurator& cfg, const Options& options = Options()) : detail::Simulator(cfg, options) {}
 
   template<typename InputIt, typename OutputIt>
   OutputIt Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized) const
@@ -37,6 +70,12 @@ class Simulator : detail::Simulator
     return detail::Simulator::Digitize(first_hit, last_hit, digitized, mag_field);
   }
 
+  template<typename InputIt, typename OutputIt, typename MagField>
+  OutputIt Digitize(InputIt first_hit, InputIt last_hit, OutputIt digitized, const MagField& mag_field, Context& context) const
+  {
+    return detail::Simulator::Digitize(first_hit, last_hit, digitized, mag_field, context);
+  }
+
   template<typename InputIt, typename OutputIt>
   OutputIt Distort(InputIt first_hit, InputIt last_hit, OutputIt distorted) const
   {
@@ -48,6 +87,16 @@ class Simulator : detail::Simulator
   {
     return detail::Simulator::Simulate(first_hit, last_hit, charges);
   }
+
+  template<typename InputIt, typename OutputIt, typename MagField>
+  OutputIt Simulate(InputIt first_hit, InputIt last_hit, OutputIt charges, const MagField& mag_field, Context& context) const
+  {
+    return detail::Simulator::Simulate(first_hit, last_hit, charges, mag_field, context);
+  }
+
+  /// Switches to the configuration of another run recomputing only the
+  /// tables that depend on the changed structs. See detail::Simulator::Update
+  void Update(const tpcrs::Configurator& cfg) { detail::Simulator::Update(cfg); }
 };
 
 
@@ -9,17 +9,29 @@ void TF1F::Save(double xmin, double xmax, double ymin, double ymax, double zmin,
   fStep = 20;
   fdX = 1. / fStep;
   fNpx = tpcrs::irint((fXmax - fXmin) / fdX);
+  fSaveL = nullptr;
   TF1::Save(xmin, xmax, ymin, ymax, zmin, zmax);
 }
 
 
+void TF1F::SetSaveData(double xmin, double xmax, const double* values)
+{
+  fXmin = xmin;
+  fXmax = xmax;
+  fStep = 20;
+  fdX = 1. / fStep;
+  fNpx = tpcrs::irint((fXmax - fXmin) / fdX);
+  fSaveL = values;
+}
+
+
 /// Get value corresponding to X in array of fSave values
 double TF1F::GetSaveL(double x) const
 {
   if (x < fXmin || x  > fXmax || fdX <= 0) return 0.;
 
   int bin = tpcrs::irint((x - fXmin) / fdX);
-  return fSave[bin];
+  return GetSaveData()[bin];
 }
 
 
@@ -29,11 +41,12 @@ double TF1F::GetSaveL(int N, double x, double* y) const
   //  memset(y, 0, N*sizeof(double));
   int bin     = tpcrs::irint((x - fXmin) / fdX);
   int i1 = 0;
+  const double* save = GetSaveData();
 
   while (bin < 0) {i1++; bin += fStep;}
 
   for (int i = i1; i < N && bin < GetNpx() - 3; i++, bin += fStep) {
-    y[i] = fSave[bin];
+    y[i] = save[bin];
   }
 
   return y[0];
@@ -41,9 +54,9 @@ double TF1F::GetSaveL(int N, double x, double* y) const
 
 
 #if ROOT_VERSION_CODE >= 393216 /* = ROOT_VERSION(6,0,0) */
-TF1F::TF1F(): TF1() {fNpx = 200;}
+TF1F::TF1F(): TF1(), fSaveL(nullptr) {fNpx = 200;}
 TF1F::TF1F(const char* name, const char* formula, double xmin, double xmax)
-  : TF1(name, formula, xmax, xmin) {fNpx = 200;}
+  : TF1(name, formula, xmax, xmin), fSaveL(nullptr) {fNpx = 200;}
 TF1F::TF1F(const char* name, double (*fcn)(double*, double*), double xmin, double xmax, int npar, int ndim)
-  : TF1(name, fcn, xmin, xmax, npar, ndim) {fNpx = 200;}
+  : TF1(name, fcn, xmin, xmax, npar, ndim), fSaveL(nullptr) {fNpx = 200;}
 #endif /* ROOT 6 */
@@ -0,0 +1,163 @@
+#include <algorithm>
+
+#include "tpcrs/detail/charge_accumulator.h"
+#include "tpcrs/detail/cpu_features.h"
+
+
+namespace tpcrs { namespace detail {
+
+namespace {
+
+/**
+ * Adds coupling * time_couplings[i] to charge[i] for every i < n where the
+ * product passes the min_signal cut and updates the dominant track id. The
+ * signal is computed in double and rounded to float exactly as in the scalar
+ * SimulatedCharge arithmetic so that all implementations give identical
+ * results.
+ */
+using DepositFunc = void (*)(float* charge, short* track_ids, int n, double coupling,
+                             const double* time_couplings, double min_signal, short track_id);
+
+
+void DepositScalar(float* charge, short* track_ids, int n, double coupling,
+                   const double* time_couplings, double min_signal, short track_id)
+{
+  for (int i = 0; i < n; ++i) {
+    double signal = coupling * time_couplings[i];
+
+    if (signal < min_signal) continue;
+
+    tpcrs::SimulatedCharge cell{charge[i], track_ids[i]};
+    cell += tpcrs::SimulatedCharge{static_cast<float>(signal), track_id};
+
+    charge[i] = cell.charge;
+    track_ids[i] = cell.track_id;
+  }
+}
+
+
+#ifdef TPCRS_X86_DISPATCH
+
+__attribute__((target("avx2")))
+void DepositAvx2(float* charge, short* track_ids, int n, double coupling,
+                 const double* time_couplings, double min_signal, short track_id)
+{
+  const __m256d coupling_v = _mm256_set1_pd(coupling);
+  const __m256d min_signal_v = _mm256_set1_pd(min_signal);
+  const __m128i track_id_v = _mm_set1_epi32(track_id);
+  const __m256i even_words = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d signal = _mm256_mul_pd(coupling_v, _mm256_loadu_pd(time_couplings + i));
+    __m256d pass_d = _mm256_cmp_pd(signal, min_signal_v, _CMP_GE_OQ);
+
+    if (_mm256_movemask_pd(pass_d) == 0) continue;
+
+    // Narrow the 64-bit lane mask to four 32-bit lanes
+    __m128 pass = _mm256_castps256_ps128(_mm256_castsi256_ps(
+      _mm256_permutevar8x32_epi32(_mm256_castpd_si256(pass_d), even_words)));
+
+    __m128 added = _mm_and_ps(_mm256_cvtpd_ps(signal), pass);
+    __m128 sum = _mm_add_ps(_mm_loadu_ps(charge + i), added);
+    _mm_storeu_ps(charge + i, sum);
+
+    __m128i ids = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(track_ids + i)));
+    __m128i other_track = _mm_xor_si128(_mm_cmpeq_epi32(ids, track_id_v), _mm_set1_epi32(-1));
+    __m128 dominant = _mm_cmplt_ps(sum, _mm_add_ps(added, added));
+    __m128i replace = _mm_and_si128(_mm_castps_si128(_mm_and_ps(pass, dominant)), other_track);
+
+    ids = _mm_blendv_epi8(ids, track_id_v, replace);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(track_ids + i), _mm_packs_epi32(ids, ids));
+  }
+
+  DepositScalar(charge + i, track_ids + i, n - i, coupling, time_couplings + i, min_signal, track_id);
+}
+
+
+__attribute__((target("avx512f,avx512vl,avx512bw")))
+void DepositAvx512(float* charge, short* track_ids, int n, double coupling,
+                   const double* time_couplings, double min_signal, short track_id)
+{
+  const __m512d coupling_v = _mm512_set1_pd(coupling);
+  const __m512d min_signal_v = _mm512_set1_pd(min_signal);
+  const __m128i track_id_v = _mm_set1_epi16(track_id);
+
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m512d signal = _mm512_mul_pd(coupling_v, _mm512_loadu_pd(time_couplings + i));
+    __mmask8 pass = _mm512_cmp_pd_mask(signal, min_signal_v, _CMP_GE_OQ);
+
+    if (pass == 0) continue;
+
+    __m256 added = _mm512_maskz_cvtpd_ps(pass, signal);
+    __m256 sum = _mm256_add_ps(_mm256_loadu_ps(charge + i), added);
+    _mm256_storeu_ps(charge + i, sum);
+
+    __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(track_ids + i));
+    __mmask8 replace = _mm256_mask_cmp_ps_mask(pass, sum, _mm256_add_ps(added, added), _CMP_LT_OQ);
+    replace = _mm_mask_cmpneq_epi16_mask(replace, ids, track_id_v);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(track_ids + i), _mm_mask_mov_epi16(ids, replace, track_id_v));
+  }
+
+  DepositScalar(charge + i, track_ids + i, n - i, coupling, time_couplings + i, min_signal, track_id);
+}
+
+#endif
+
+
+DepositFunc SelectDeposit()
+{
+#ifdef TPCRS_X86_DISPATCH
+  if (HasAvx512())
+    return DepositAvx512;
+
+  if (HasAvx2())
+    return DepositAvx2;
+#endif
+
+  return DepositScalar;
+}
+
+}
+
+
+void ChargeAccumulator::Deposit(int pad_index, int n_pads, const double* pad_couplings,
+                                int timebin, int n_timebins, const double* time_couplings,
+                                double min_signal, short track_id)
+{
+  if (n_pads <= 0 || n_timebins <= 0) return;
+
+  auto minmax = std::minmax_element(time_couplings, time_couplings + n_timebins);
+  DepositFunc deposit = SelectDeposit();
+
+  for (int p = 0; p < n_pads; ++p) {
+    double coupling = pad_couplings[p];
+
+    // Skip pads without a single product passing the cut so that no block is
+    // allocated for them. The check is exact because the product is monotonic
+    // in the time coupling
+    double peak = coupling * (coupling >= 0 ? *minmax.second : *minmax.first);
+
+    if (!(peak >= min_signal)) continue;
+
+    int tb = timebin;
+    const double* couplings = time_couplings;
+
+    while (tb < timebin + n_timebins) {
+      int offset = tb % kBlockSize;
+      int n = std::min(kBlockSize - offset, timebin + n_timebins - tb);
+      Block& block = GetBlock(pad_index + p, tb / kBlockSize);
+
+      deposit(block.charge + offset, block.track_id + offset, n, coupling, couplings, min_signal, track_id);
+
+      tb += n;
+      couplings += n;
+    }
+  }
+}
+
+} }
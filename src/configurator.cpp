@@ -1,13 +1,129 @@
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <sys/stat.h>
 
 #include "tpcrs/configurator.h"
+#include "tpcrs/detail/mapped_file.h"
+#include "tpcrs/detail/struct_containers.h"
 #include "config.h"
+#include "logger.h"
 
 namespace tpcrs {
 
+namespace {
+
+const char kMagic[8] = {'T', 'P', 'C', 'R', 'S', 'C', 'F', 'G'};
+
+const uint32_t kVersion = 1;
+
+/// Written in the native byte order to detect snapshots from a different platform
+const uint32_t kByteOrder = 0x01020304;
+
+/// The alignment of the rows of every struct in a snapshot
+const uint64_t kAlignment = 64;
+
+/// The table of contents follows the header
+struct Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t n_entries;
+  uint32_t reserved;
+};
+
+/// The rows of a struct stored in a snapshot as they are in memory
+struct Entry
+{
+  char node[64];
+  uint32_t version;
+  uint32_t struct_size;
+  uint64_t n_rows;
+  uint64_t offset;
+};
+
+
+/// Returns the entry of the node in a snapshot or null if it is missing
+const Entry* FindEntry(const detail::MappedFile& snapshot, const std::string& node)
+{
+  const Header* header = reinterpret_cast<const Header*>(snapshot.data());
+  const Entry* entries = reinterpret_cast<const Entry*>(snapshot.data() + sizeof(Header));
+
+  for (uint32_t i = 0; i < header->n_entries; i++) {
+    if (node == entries[i].node)
+      return &entries[i];
+  }
+
+  return nullptr;
+}
+
+
+bool EndsWith(const std::string& str, const std::string& suffix)
+{
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+/// The content of an entry to be written to a snapshot
+struct Block
+{
+  Entry entry;
+  std::string rows;
+};
+
+
+template<typename Struct>
+void AddBlock(const Configurator& cfg, const std::string& node, std::vector<Block>& blocks)
+{
+  for (const Block& block : blocks)
+    if (node == block.entry.node) return;
+
+  std::vector<Struct> rows = cfg.Rows<Struct>(node);
+
+  if (rows.empty()) return;
+
+  if (node.size() >= sizeof(Entry::node))
+    throw std::runtime_error("Configurator: Node name too long for a snapshot " + node);
+
+  Block block{};
+  std::strcpy(block.entry.node, node.c_str());
+  block.entry.version = BinaryCodec<Struct>::version();
+  block.entry.struct_size = sizeof(Struct);
+  block.entry.n_rows = rows.size();
+  block.rows.assign(reinterpret_cast<const char*>(rows.data()), rows.size() * sizeof(Struct));
+
+  blocks.push_back(block);
+}
+
+
+template<typename... Structs>
+void AddStructs(const Configurator& cfg, TypeList<Structs...>, std::vector<Block>& blocks)
+{
+  int unused[] = {0, (AddBlock<Structs>(cfg, ConfigNodeName<Structs>(), blocks), 0)...};
+  (void) unused;
+}
+
+
+template<typename... Chairs>
+void AddChairs(const Configurator& cfg, TypeList<Chairs...>, std::vector<Block>& blocks)
+{
+  int unused[] = {0, (AddBlock<typename Chairs::struct_type>(cfg, Chairs::name, blocks), 0)...};
+  (void) unused;
+}
+
+}
+
+
 Configurator::Configurator(std::string configname, std::string filename) :
-  name(configname)
+  Configurator(nullptr, configname, filename)
+{
+}
+
+
+Configurator::Configurator(std::shared_ptr<const Configurator> base, std::string configname, std::string filename) :
+  name(configname),
+  base_(base)
 {
   std::string paths(TPCRS_CONFIG_SEARCH_PATHS);
 
@@ -23,7 +139,186 @@ Configurator::Configurator(std::string configname, std::string filename) :
   if (filename.empty())
     filename = Locate(name + ".yaml");
 
-  yaml = YAML::LoadFile(filename);
+  if (EndsWith(filename, ".bin"))
+    MapSnapshot(filename);
+  else
+    yaml = YAML::LoadFile(filename);
+
+  DecodeStructs(ConfigStructTypes());
+  DecodeChairs(ConfigChairTypes());
+  CreateChairs(ConfigChairTypes());
+}
+
+
+Configurator::~Configurator() = default;
+
+
+/**
+ * Decodes the structs present in the configuration. A missing struct is
+ * reported only when it is requested.
+ */
+template<typename... Structs>
+void Configurator::DecodeStructs(TypeList<Structs...>)
+{
+  int unused[] = {0, (
+    DecodeRows<Structs>(ConfigNodeName<Structs>(), std::get<TypeIndex<Structs, ConfigStructTypes>::value>(structs_),
+                        base_ ? &std::get<TypeIndex<Structs, ConfigStructTypes>::value>(base_->structs_) : nullptr),
+    0)...
+  };
+  (void) unused;
+}
+
+
+template<typename... Chairs>
+void Configurator::DecodeChairs(TypeList<Chairs...>)
+{
+  chair_rows_.resize(TypeCount<ConfigChairTypes>::value);
+
+  int unused[] = {0, (
+    DecodeRows<typename Chairs::struct_type>(Chairs::name, chair_rows_[TypeIndex<Chairs, ConfigChairTypes>::value],
+                                             base_ ? &base_->chair_rows_[TypeIndex<Chairs, ConfigChairTypes>::value] : nullptr),
+    0)...
+  };
+  (void) unused;
+}
+
+
+/**
+ * Creates the chairs of the nodes replaced in this configuration and reuses
+ * the other ones of the base together with the values they derive from their
+ * rows at initialization. The chairs of optional structs missing in the
+ * configuration hold a zero row.
+ */
+template<typename... Chairs>
+void Configurator::CreateChairs(TypeList<Chairs...>)
+{
+  chairs_.resize(TypeCount<ConfigChairTypes>::value);
+
+  int unused[] = {0, (
+    chairs_[TypeIndex<Chairs, ConfigChairTypes>::value] =
+      ReusesBaseChair<Chairs>(typename Chairs::dependencies()) ?
+        base_->chairs_[TypeIndex<Chairs, ConfigChairTypes>::value] : std::make_shared<Chairs>(*this),
+    0)...
+  };
+  (void) unused;
+}
+
+
+void Configurator::MapSnapshot(const std::string& path)
+{
+  snapshot_.reset(new detail::MappedFile(path));
+
+  const char* data = snapshot_->data();
+  size_t size = snapshot_->size();
+
+  const Header* header = reinterpret_cast<const Header*>(data);
+
+  bool valid = data && size >= sizeof(Header) &&
+               std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion &&
+               header->byte_order == kByteOrder &&
+               header->n_entries <= (size - sizeof(Header)) / sizeof(Entry);
+
+  const Entry* entries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+
+  for (uint32_t i = 0; valid && i < header->n_entries; i++) {
+    const Entry& entry = entries[i];
+    valid = std::memchr(entry.node, '\0', sizeof(entry.node)) && entry.struct_size > 0 &&
+            entry.offset % kAlignment == 0 && entry.offset <= size &&
+            entry.n_rows <= (size - entry.offset) / entry.struct_size;
+  }
+
+  if (!valid)
+    throw std::runtime_error("Configurator: Invalid snapshot " + path);
+}
+
+
+bool Configurator::HasNode(const std::string& node) const
+{
+  return snapshot_ ? FindEntry(*snapshot_, node) != nullptr : static_cast<bool>(yaml[node]);
+}
+
+
+const void* Configurator::SnapshotRows(const std::string& node, uint32_t version, size_t struct_size, size_t& n_rows) const
+{
+  const Entry* entry = FindEntry(*snapshot_, node);
+
+  n_rows = 0;
+
+  if (!entry) return nullptr;
+
+  if (entry->version != version || entry->struct_size != struct_size)
+    throw std::runtime_error("Configurator: " + node + " in snapshot " + name + " has a different layout");
+
+  n_rows = entry->n_rows;
+  return snapshot_->data() + entry->offset;
+}
+
+
+std::string Configurator::Serialized(const std::string& node) const
+{
+  if (!HasNode(node))
+    return base_ ? base_->Serialized(node) : "";
+
+  if (!snapshot_)
+    return YAML::Dump(yaml[node]);
+
+  const Entry* entry = FindEntry(*snapshot_, node);
+
+  return std::string(snapshot_->data() + entry->offset, entry->n_rows * entry->struct_size);
+}
+
+
+bool Configurator::WriteSnapshot(const std::string& path) const
+{
+  std::vector<Block> blocks;
+
+  AddStructs(*this, ConfigStructTypes(), blocks);
+  AddChairs(*this, ConfigChairTypes(), blocks);
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrder;
+  header.n_entries = blocks.size();
+  header.reserved = 0;
+
+  uint64_t offset = sizeof(Header) + blocks.size() * sizeof(Entry);
+
+  for (Block& block : blocks) {
+    offset = (offset + kAlignment - 1) / kAlignment * kAlignment;
+    block.entry.offset = offset;
+    offset += block.rows.size();
+  }
+
+  FILE* file = std::fopen(path.c_str(), "wb");
+
+  if (!file) {
+    LOG_ERROR << "Configurator: Cannot create " << path << '\n';
+    return false;
+  }
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+  for (const Block& block : blocks)
+    ok = ok && std::fwrite(&block.entry, sizeof(Entry), 1, file) == 1;
+
+  const char padding[kAlignment] = {};
+  uint64_t position = sizeof(Header) + blocks.size() * sizeof(Entry);
+
+  for (const Block& block : blocks) {
+    size_t n_padding = block.entry.offset - position;
+
+    ok = ok && std::fwrite(padding, 1, n_padding, file) == n_padding &&
+         std::fwrite(block.rows.data(), 1, block.rows.size(), file) == block.rows.size();
+
+    position = block.entry.offset + block.rows.size();
+  }
+
+  ok = std::fclose(file) == 0 && ok;
+
+  if (!ok) LOG_ERROR << "Configurator: Cannot write " << path << '\n';
+
+  return ok;
 }
 
 
@@ -1,9 +1,12 @@
+#include <algorithm>
+
 #include "TGeoManager.h"
 #include "TVector3.h"
 #include "TString.h"
 
 #include "tpcrs/configurator.h"
 #include "tpcrs/detail/coords.h"
+#include "tpcrs/detail/cpu_features.h"
 #include "logger.h"
 #include "math_funcs.h"
 
@@ -39,15 +42,171 @@ Coords operator/(const Coords &c, double v)
 }
 
 
+PackedTransform::PackedTransform(const TGeoHMatrix& m)
+{
+  const double* r = m.GetRotationMatrix();
+  const double* tr = m.GetTranslation();
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      col[j][i] = r[3 * i + j];
+      row[j][i] = r[3 * j + i];
+    }
+    col[i][3] = row[i][3] = 0;
+    t[i] = tr[i];
+  }
+
+  t[3] = 0;
+}
+
+
+namespace {
+
+/// The direction of a batch transformation. kRotateTranslate applies
+/// LocalToMasterVect followed by the translation
+enum class TransformMode { kLocalToMaster, kMasterToLocal, kRotateTranslate };
+
+/**
+ * Transforms the positions of n coordinates by the corresponding transforms.
+ * The positions are the first members of the structures laid out with the
+ * given strides in bytes.
+ */
+using TransformFunc = void (*)(TransformMode mode, const PackedTransform* const* transforms, size_t n,
+                               const char* in, size_t in_stride, char* out, size_t out_stride);
+
+
+void TransformScalar(TransformMode mode, const PackedTransform* const* transforms, size_t n,
+                     const char* in, size_t in_stride, char* out, size_t out_stride)
+{
+  for (size_t i = 0; i < n; ++i, in += in_stride, out += out_stride) {
+    const double* a = reinterpret_cast<const double*>(in);
+    double* b = reinterpret_cast<double*>(out);
+    const PackedTransform& m = *transforms[i];
+
+    switch (mode) {
+    case TransformMode::kLocalToMaster:
+      m.LocalToMaster(a, b);
+      break;
+    case TransformMode::kMasterToLocal:
+      m.MasterToLocal(a, b);
+      break;
+    case TransformMode::kRotateTranslate:
+      double c[3];
+      m.LocalToMasterVect(a, c);
+      for (int k = 0; k < 3; k++) b[k] = m.t[k] + c[k];
+      break;
+    }
+  }
+}
+
+
+#ifdef TPCRS_X86_DISPATCH
+
+__attribute__((target("avx2")))
+void TransformAvx2(TransformMode mode, const PackedTransform* const* transforms, size_t n,
+                   const char* in, size_t in_stride, char* out, size_t out_stride)
+{
+  const __m256i mask = _mm256_set_epi64x(0, -1, -1, -1);
+
+  for (size_t i = 0; i < n; ++i, in += in_stride, out += out_stride) {
+    const double* a = reinterpret_cast<const double*>(in);
+    const PackedTransform& m = *transforms[i];
+    __m256d t = _mm256_loadu_pd(m.t);
+    __m256d b;
+
+    // The operations are ordered as in the scalar versions
+    if (mode == TransformMode::kMasterToLocal) {
+      __m256d mt0 = _mm256_set1_pd(a[0] - m.t[0]);
+      __m256d mt1 = _mm256_set1_pd(a[1] - m.t[1]);
+      __m256d mt2 = _mm256_set1_pd(a[2] - m.t[2]);
+      b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(mt0, _mm256_loadu_pd(m.row[0])),
+                                      _mm256_mul_pd(mt1, _mm256_loadu_pd(m.row[1]))),
+                        _mm256_mul_pd(mt2, _mm256_loadu_pd(m.row[2])));
+    }
+    else {
+      __m256d c0 = _mm256_mul_pd(_mm256_broadcast_sd(a + 0), _mm256_loadu_pd(m.col[0]));
+      __m256d c1 = _mm256_mul_pd(_mm256_broadcast_sd(a + 1), _mm256_loadu_pd(m.col[1]));
+      __m256d c2 = _mm256_mul_pd(_mm256_broadcast_sd(a + 2), _mm256_loadu_pd(m.col[2]));
+
+      if (mode == TransformMode::kLocalToMaster)
+        b = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(t, c0), c1), c2);
+      else
+        b = _mm256_add_pd(t, _mm256_add_pd(_mm256_add_pd(c0, c1), c2));
+    }
+
+    _mm256_maskstore_pd(reinterpret_cast<double*>(out), mask, b);
+  }
+}
+
+#endif
+
+
+TransformFunc SelectTransform()
+{
+#ifdef TPCRS_X86_DISPATCH
+  if (tpcrs::detail::HasAvx2())
+    return TransformAvx2;
+#endif
+
+  return TransformScalar;
+}
+
+/// The number of coordinates for which the transforms are looked up at once
+const size_t kBatchSize = 64;
+
+}
+
+
 CoordTransform::CoordTransform(const tpcrs::Configurator& cfg) :
+  CoordTransform(cfg, std::make_shared<const tpcrs::detail::DerivedGeometry>(cfg))
+{
+}
+
+
+CoordTransform::CoordTransform(const tpcrs::Configurator& cfg, std::shared_ptr<const tpcrs::detail::DerivedGeometry> geom) :
   cfg_(cfg),
+  geom_(geom),
   timebin_width_ (1e6 / cfg_.S<starClockOnl>().frequency),
   z_inner_offset_(cfg_.S<tpcEffectiveGeom>().z_inner_offset),
   z_outer_offset_(cfg_.S<tpcEffectiveGeom>().z_outer_offset),
-  tpc2global_("Tpc2Glob"),
-  sector_rotations_(12*2*kTotalTpcSectorRotaions)
+  tpc2global_(),
+  sector_rotations_(),
+  row_radii_(),
+  row_inv_step_(0),
+  row_buckets_(),
+  time_conversions_()
 {
   SetTpcRotations();
+  InitRowRadii();
+  InitTimeConversions();
+}
+
+
+CoordTransform::CoordTransform(const tpcrs::Configurator& cfg, std::shared_ptr<const tpcrs::detail::DerivedGeometry> geom,
+                               const CoordTransform& prev) :
+  cfg_(cfg),
+  geom_(geom),
+  timebin_width_ (1e6 / cfg_.S<starClockOnl>().frequency),
+  z_inner_offset_(cfg_.S<tpcEffectiveGeom>().z_inner_offset),
+  z_outer_offset_(cfg_.S<tpcEffectiveGeom>().z_outer_offset),
+  tpc2global_(),
+  sector_rotations_(),
+  row_radii_(),
+  row_inv_step_(0),
+  row_buckets_(),
+  time_conversions_()
+{
+  if (cfg_.Same<tpcGlobalPosition, tpcPadPlanes, tpcWirePlanes,
+                StTpcSuperSectorPosition, StTpcOuterSectorPosition>(prev.cfg_)) {
+    tpc2global_ = prev.tpc2global_;
+    sector_rotations_ = prev.sector_rotations_;
+  }
+  else {
+    SetTpcRotations();
+  }
+
+  InitRowRadii();
+  InitTimeConversions();
 }
 
 
@@ -56,11 +215,11 @@ void CoordTransform::local_sector_to_hardware(const StTpcLocalSectorCoordinate &
 {
   int row = a.row;
 
-  if (row < 1 || row > cfg_.S<tpcPadPlanes>().padRows)
+  if (row < 1 || row > geom_->n_rows())
     row = YToRow(a.position.y, a.sector);
 
   double probablePad = XToPad(a.position.x, a.sector, a.row);
-  double zoffset = (row > cfg_.S<tpcPadPlanes>().innerPadRows) ? z_outer_offset_ : z_inner_offset_;
+  double zoffset = geom_->is_inner(row) ? z_inner_offset_ : z_outer_offset_;
   double tb = ZToTime(a.position.z + zoffset, a.sector, row, probablePad);
 
   b = StTpcPadCoordinate{a.sector, row, probablePad, tb};
@@ -70,8 +229,8 @@ void CoordTransform::local_sector_to_hardware(const StTpcLocalSectorCoordinate &
 void CoordTransform::hardware_to_local_sector(const StTpcPadCoordinate &a, StTpcLocalSectorCoordinate &b) const
 {
   double x = PadToX(a.sector, a.row, a.pad);
-  double y = tpcrs::RadialDistanceAtRow(a.row, cfg_);
-  double zoffset =  (a.row > cfg_.S<tpcPadPlanes>().innerPadRows) ? z_outer_offset_ : z_inner_offset_;
+  double y = geom_->radius(a.row);
+  double zoffset = geom_->is_inner(a.row) ? z_inner_offset_ : z_outer_offset_;
   double z = TimeToZ(a.timeBucket, a.sector, a.row, a.pad) - zoffset;
   b = StTpcLocalSectorCoordinate{{x, y, z}, a.sector, a.row};
 }
@@ -79,13 +238,10 @@ void CoordTransform::hardware_to_local_sector(const StTpcPadCoordinate &a, StTpc
 
 double CoordTransform::XToPad(double x, int sector, int row) const
 {
-  if (row > cfg_.S<tpcPadPlanes>().padRows) row = cfg_.S<tpcPadPlanes>().padRows;
+  if (row > geom_->n_rows()) row = geom_->n_rows();
 
-  double pitch = (row <= cfg_.S<tpcPadPlanes>().innerPadRows) ?
-                         cfg_.S<tpcPadPlanes>().innerSectorPadPitch :
-                         cfg_.S<tpcPadPlanes>().outerSectorPadPitch;
-
-  int npads = tpcrs::NumberOfPads(row, cfg_);
+  double pitch = geom_->pad_pitch(row);
+  int npads = geom_->n_pads(row);
   double probablePad = (npads + 1.) / 2. - x / pitch;
 
   // CAUTION: pad cannot be <1
@@ -95,95 +251,128 @@ double CoordTransform::XToPad(double x, int sector, int row) const
 
 double CoordTransform::PadToX(int sector, int row, double pad) const      // x coordinate in sector 12
 {
-  if (row > cfg_.S<tpcPadPlanes>().padRows) row = cfg_.S<tpcPadPlanes>().padRows;
-
-  double pitch = (row <= cfg_.S<tpcPadPlanes>().innerPadRows) ?
-                         cfg_.S<tpcPadPlanes>().innerSectorPadPitch :
-                         cfg_.S<tpcPadPlanes>().outerSectorPadPitch;
+  if (row > geom_->n_rows()) row = geom_->n_rows();
 
-  int npads = tpcrs::NumberOfPads(row, cfg_);
+  double pitch = geom_->pad_pitch(row);
+  int npads = geom_->n_pads(row);
 
   return -pitch * (pad - (npads + 1.) / 2.);
 }
 
 
-double CoordTransform::TimeToZ(double tb, int sector, int row, int pad) const
+void CoordTransform::ZToTime(const double* z, double* tb, size_t n, int sector, int row) const
 {
-  if (row > cfg_.S<tpcPadPlanes>().padRows) row = cfg_.S<tpcPadPlanes>().padRows;
+  const TimeConversion& c = time_conversion(sector, row);
 
-  // TODO: Remove extra temporary when new reference is introduced for tests
-  float triggerTimeOffset = 1e-6 * cfg_.S<trgTimeOffset>().offset;
-  double trigT0 = triggerTimeOffset * 1e6; // units are s
-  double elecT0 = cfg_.S<tpcElectronics>().tZero;    // units are us
-  double sectT0 = cfg_.S<tpcPadrowT0>(sector-1).T0[row-1];  // units are us
-  double t0 = trigT0 + elecT0 + sectT0;
-  int l = sector;
+  for (size_t i = 0; i < n; ++i) {
+    double time = z[i] / c.drift_velocity;
+    tb[i] = (time - c.t0) / timebin_width_ - c.t0_offset;
+  }
+}
 
-  if (tpcrs::IsInner(row, cfg_)) l += 24;
 
-  double tbx = tb + cfg_.S<tpcSectorT0offset>().t0[l-1];
-  double time = t0 + tbx * timebin_width_;
+void CoordTransform::TimeToZ(const double* tb, double* z, size_t n, int sector, int row) const
+{
+  const TimeConversion& c = time_conversion(sector, row);
 
-  return tpcrs::DriftVelocity(sector, cfg_) * 1e-6 * time;
+  for (size_t i = 0; i < n; ++i) {
+    double tbx = tb[i] + c.t0_offset;
+    double time = c.t0 + tbx * timebin_width_;
+    z[i] = c.drift_velocity * time;
+  }
 }
 
 
-double CoordTransform::ZToTime(double z, int sector, int row, int pad) const
+double CoordTransform::TriggerT0() const
 {
-  if (row > cfg_.S<tpcPadPlanes>().padRows) row = cfg_.S<tpcPadPlanes>().padRows;
-
   // TODO: Remove extra temporary when new reference is introduced for tests
   float triggerTimeOffset = 1e-6 * cfg_.S<trgTimeOffset>().offset;
   double trigT0 = triggerTimeOffset * 1e6; // units are s
   double elecT0 = cfg_.S<tpcElectronics>().tZero;    // units are us
-  double sectT0 = cfg_.S<tpcPadrowT0>(sector-1).T0[row-1];  // units are us
-  double t0 = trigT0 + elecT0 + sectT0;
-  double time = z / (tpcrs::DriftVelocity(sector, cfg_) * 1e-6);
-  int l = sector;
+  return trigT0 + elecT0;
+}
+
+
+/**
+ * Returns the row containing y, i.e. the number of row boundaries not greater
+ * than y limited to [1, n_rows]. The bucket containing y gives the row up to
+ * a boundary within the bucket or one moved by the rounding of its edge.
+ */
+int CoordTransform::YToRow(double y, int sector) const
+{
+  int n_rows = row_radii_.size() - 1;
+
+  if (!(y >= row_radii_[0])) return 1;
+  if (y >= row_radii_[n_rows]) return n_rows;
+
+  int i = static_cast<int>((y - row_radii_[0]) * row_inv_step_);
+  int row = row_buckets_[std::min(i, static_cast<int>(row_buckets_.size()) - 1)];
+
+  row -= row > 1 && row_radii_[row - 1] > y;
 
-  if (tpcrs::IsInner(row, cfg_)) l += 24;
+  while (row_radii_[row] <= y) row++;
 
-  return (time - t0) / timebin_width_ - cfg_.S<tpcSectorT0offset>().t0[l-1];
+  return std::max(std::min(row, n_rows), 1);
 }
 
 
-int CoordTransform::YToRow(double y, int sector) const
+/**
+ * The constants keep the order of the operations of the original conversion
+ * rather than being folded into a single slope and offset, so the time buckets
+ * do not change in the last bits.
+ */
+void CoordTransform::InitTimeConversions()
 {
-  static int Nrows = 0;
-  static double* Radii = 0;
+  double trigger_t0 = TriggerT0();
 
-  if (Nrows != cfg_.S<tpcPadPlanes>().padRows) {
-    Nrows = cfg_.S<tpcPadPlanes>().padRows;
+  time_conversions_.resize(geom_->n_sectors() * geom_->n_rows());
 
-    if (Radii) delete [] Radii;
+  for (int sector = 1; sector <= geom_->n_sectors(); sector++) {
+    for (int row = 1; row <= geom_->n_rows(); row++) {
+      time_conversions_[(sector - 1) * geom_->n_rows() + row - 1] = TimeConversion{
+        trigger_t0 + geom_->t0(sector, row),
+        geom_->t0_offset(sector, row),
+        geom_->drift_velocity(sector) * 1e-6
+      };
+    }
+  }
+}
 
-    Radii = new double[Nrows + 1];
 
-    for (int i = 1; i <= Nrows + 1; i++) {
-      if (i == 1) {
-        Radii[i - 1] =  (3 * tpcrs::RadialDistanceAtRow(i, cfg_)
-                           - tpcrs::RadialDistanceAtRow(i + 1, cfg_)) / 2;
-      }
-      else if (i == Nrows + 1) {
-        Radii[i - 1] =  (3 * tpcrs::RadialDistanceAtRow(i - 1, cfg_)
-                           - tpcrs::RadialDistanceAtRow(i - 2, cfg_)) / 2;
-      }
-      else {
-        Radii[i - 1] = (tpcrs::RadialDistanceAtRow(i - 1, cfg_) +
-                        tpcrs::RadialDistanceAtRow(i, cfg_)) / 2;
-      }
+void CoordTransform::InitRowRadii()
+{
+  int n_rows = geom_->n_rows();
+
+  row_radii_.resize(n_rows + 1);
+
+  for (int i = 1; i <= n_rows + 1; i++) {
+    if (i == 1) {
+      row_radii_[i - 1] = (3 * geom_->radius(i) - geom_->radius(i + 1)) / 2;
+    }
+    else if (i == n_rows + 1) {
+      row_radii_[i - 1] = (3 * geom_->radius(i - 1) - geom_->radius(i - 2)) / 2;
+    }
+    else {
+      row_radii_[i - 1] = (geom_->radius(i - 1) + geom_->radius(i)) / 2;
     }
   }
 
-  // Based on the row position (i.e. "radius") perform a binary search for the
-  // row corresponding to the value of y
-  double* r_ptr = std::lower_bound(Radii, Radii + Nrows + 1, y);
-  int row = (r_ptr != Radii + Nrows + 1) && (*r_ptr == y) ? r_ptr - Radii + 1: r_ptr - Radii;
+  double range = row_radii_[n_rows] - row_radii_[0];
+  double min_step = range;
 
-  if (row <= 0) row = 1;
-  if (row > Nrows) row = Nrows;
+  for (int i = 1; i <= n_rows; i++)
+    min_step = std::min(min_step, row_radii_[i] - row_radii_[i - 1]);
 
-  return row;
+  int n_buckets = min_step > 0 ? std::min(static_cast<int>(std::ceil(range / min_step)), 4096) : 4096;
+  row_inv_step_ = n_buckets / range;
+
+  row_buckets_.resize(n_buckets);
+
+  for (int b = 0, n = 0; b < n_buckets; b++) {
+    double edge = row_radii_[0] + b / row_inv_step_;
+    while (n <= n_rows && row_radii_[n] <= edge) n++;
+    row_buckets_[b] = n;
+  }
 }
 
 
@@ -191,41 +380,132 @@ void CoordTransform::local_sector_to_local(const StTpcLocalSectorCoordinate &a,
 {
   int row = a.row;
 
-  if (row < 1 || row > cfg_.S<tpcPadPlanes>().padRows)
+  if (row < 1 || row > geom_->n_rows())
     row = YToRow(a.position.y, a.sector);
 
-  Coords xGG;
-  Pad2Tpc(a.sector, row).LocalToMasterVect(a.position.xyz(), xGG.xyz());
-  const double* trans = Pad2Tpc(a.sector, row).GetTranslation();
-  TGeoTranslation GG2TPC(trans[0], trans[1], trans[2]);
-  GG2TPC.LocalToMaster(xGG.xyz(), b.position.xyz());
+  const PackedTransform* m = &Pad2Tpc(a.sector, row);
+  TransformScalar(TransformMode::kRotateTranslate, &m, 1, reinterpret_cast<const char*>(a.position.xyz()), 0,
+                  reinterpret_cast<char*>(b.position.xyz()), 0);
 
   b.row = row;
   b.sector = a.sector;
 }
 
 
-void CoordTransform::local_to_local_sector(const StTpcLocalCoordinate &a, StTpcLocalSectorCoordinate &b) const
+int CoordTransform::LocalRow(const StTpcLocalCoordinate &a) const
 {
   int row = a.row;
 
-  if (row < 1 || row > cfg_.S<tpcPadPlanes>().padRows) {
+  if (row < 1 || row > geom_->n_rows()) {
     Coords xyzS;
     SupS2Tpc(a.sector).MasterToLocalVect(a.position.xyz(), xyzS.xyz());
     row = YToRow(xyzS.x, a.sector);
   }
 
-  const double* trans = Pad2Tpc(a.sector, row).GetTranslation();
-  TGeoTranslation GG2TPC(trans[0], trans[1], trans[2]);
-  Coords xGG;
-  GG2TPC.MasterToLocal(a.position.xyz(), xGG.xyz());
-  Pad2Tpc(a.sector, row).MasterToLocalVect(xGG.xyz(), b.position.xyz());
+  return row;
+}
+
+
+void CoordTransform::local_to_local_sector(const StTpcLocalCoordinate &a, StTpcLocalSectorCoordinate &b) const
+{
+  int row = LocalRow(a);
+
+  Pad2Tpc(a.sector, row).MasterToLocal(a.position.xyz(), b.position.xyz());
 
   b.row = row;
   b.sector = a.sector;
 }
 
 
+void CoordTransform::local_sector_to_hardware(const StTpcLocalSectorCoordinate* a, StTpcPadCoordinate* b, size_t n) const
+{
+  for (size_t i = 0; i < n; ++i)
+    local_sector_to_hardware(a[i], b[i]);
+}
+
+
+void CoordTransform::hardware_to_local_sector(const StTpcPadCoordinate* a, StTpcLocalSectorCoordinate* b, size_t n) const
+{
+  for (size_t i = 0; i < n; ++i)
+    hardware_to_local_sector(a[i], b[i]);
+}
+
+
+void CoordTransform::local_sector_to_local(const StTpcLocalSectorCoordinate* a, StTpcLocalCoordinate* b, size_t n) const
+{
+  const PackedTransform* transforms[kBatchSize];
+  TransformFunc transform = SelectTransform();
+
+  for (size_t first = 0; first < n; first += kBatchSize) {
+    size_t m = std::min(kBatchSize, n - first);
+
+    for (size_t i = 0; i < m; ++i) {
+      const StTpcLocalSectorCoordinate& c = a[first + i];
+      int row = c.row;
+
+      if (row < 1 || row > geom_->n_rows())
+        row = YToRow(c.position.y, c.sector);
+
+      transforms[i] = &Pad2Tpc(c.sector, row);
+      b[first + i].sector = c.sector;
+      b[first + i].row = row;
+    }
+
+    transform(TransformMode::kRotateTranslate, transforms, m,
+              reinterpret_cast<const char*>(a + first), sizeof(*a), reinterpret_cast<char*>(b + first), sizeof(*b));
+  }
+}
+
+
+void CoordTransform::local_to_local_sector(const StTpcLocalCoordinate* a, StTpcLocalSectorCoordinate* b, size_t n) const
+{
+  const PackedTransform* transforms[kBatchSize];
+  TransformFunc transform = SelectTransform();
+
+  for (size_t first = 0; first < n; first += kBatchSize) {
+    size_t m = std::min(kBatchSize, n - first);
+
+    for (size_t i = 0; i < m; ++i) {
+      const StTpcLocalCoordinate& c = a[first + i];
+      int row = LocalRow(c);
+
+      transforms[i] = &Pad2Tpc(c.sector, row);
+      b[first + i].sector = c.sector;
+      b[first + i].row = row;
+    }
+
+    transform(TransformMode::kMasterToLocal, transforms, m,
+              reinterpret_cast<const char*>(a + first), sizeof(*a), reinterpret_cast<char*>(b + first), sizeof(*b));
+  }
+}
+
+
+void CoordTransform::local_to_global(const StTpcLocalCoordinate* a, StGlobalCoordinate* b, size_t n) const
+{
+  const PackedTransform* transforms[kBatchSize];
+  TransformFunc transform = SelectTransform();
+  std::fill_n(transforms, kBatchSize, &tpc2global_);
+
+  for (size_t first = 0; first < n; first += kBatchSize) {
+    transform(TransformMode::kLocalToMaster, transforms, std::min(kBatchSize, n - first),
+              reinterpret_cast<const char*>(a + first), sizeof(*a), reinterpret_cast<char*>(b + first), sizeof(*b));
+  }
+}
+
+
+void CoordTransform::global_to_local(const StGlobalCoordinate* a, StTpcLocalCoordinate* b, size_t n) const
+{
+  const PackedTransform* transforms[kBatchSize];
+  TransformFunc transform = SelectTransform();
+  std::fill_n(transforms, kBatchSize, &tpc2global_);
+
+  for (size_t first = 0; first < n; first += kBatchSize) {
+    transform(TransformMode::kMasterToLocal, transforms, std::min(kBatchSize, n - first),
+              reinterpret_cast<const char*>(a + first), sizeof(*a), reinterpret_cast<char*>(b + first), sizeof(*b));
+  }
+}
+
+
 void CoordTransform::SetTpcRotations()
 {
   // Pad [== sector12 == localsector (SecL, ideal)] => subsector (SubS,local sector aligned) => flip => sector (SupS) => tpc => global
@@ -271,6 +551,14 @@ void CoordTransform::SetTpcRotations()
                         0, 0, -1};
   flip_matrix.SetRotation(Rotation);
 
+  // The transformations are composed in ROOT matrices and packed at the end
+  TGeoHMatrix tpc2global("Tpc2Glob");
+  std::vector<TGeoHMatrix> rotations(12*2*kTotalTpcSectorRotaions);
+
+  auto rot = [&rotations](int sector, int k) -> const TGeoHMatrix& {
+    return rotations[kTotalTpcSectorRotaions*(sector - 1) + k];
+  };
+
   for (int sector = 0; sector <= 24; sector++) {// loop over Tpc as whole, sectors, inner and outer subsectors
     int k;
     int k1 = kSupS2Tpc;
@@ -322,7 +610,7 @@ void CoordTransform::SetTpcRotations()
         }
 
         case kSupS2Glob:      // SupS => Tpc => Glob
-          rotA = tpc2global_ * SupS2Tpc(sector);
+          rotA = tpc2global * rot(sector, kSupS2Tpc);
           break;
 
         case kSubSInner2SupS:
@@ -334,20 +622,20 @@ void CoordTransform::SetTpcRotations()
           break;
 
         // (Subs[io] => SupS) => Tpc
-        case kSubSInner2Tpc:  rotA = SupS2Tpc(sector) * SubSInner2SupS(sector); break;
-        case kSubSOuter2Tpc:  rotA = SupS2Tpc(sector) * SubSOuter2SupS(sector); break;
+        case kSubSInner2Tpc:  rotA = rot(sector, kSupS2Tpc) * rot(sector, kSubSInner2SupS); break;
+        case kSubSOuter2Tpc:  rotA = rot(sector, kSupS2Tpc) * rot(sector, kSubSOuter2SupS); break;
         // Subs[io] => SupS => Tpc) => Glob
-        case kSubSInner2Glob: rotA = tpc2global_ * SubSInner2Tpc(sector);  break;
-        case kSubSOuter2Glob: rotA = tpc2global_ * SubSOuter2Tpc(sector);  break;
+        case kSubSInner2Glob: rotA = tpc2global * rot(sector, kSubSInner2Tpc);  break;
+        case kSubSOuter2Glob: rotA = tpc2global * rot(sector, kSubSOuter2Tpc);  break;
         // (Pad == SecL) => (SubS[io] => SupS)
-        case kPadInner2SupS:  rotA = SubSInner2SupS(sector); break;
-        case kPadOuter2SupS:  rotA = SubSOuter2SupS(sector); break;
+        case kPadInner2SupS:  rotA = rot(sector, kSubSInner2SupS); break;
+        case kPadOuter2SupS:  rotA = rot(sector, kSubSOuter2SupS); break;
         // (Pad == SecL) => (SubS[io] => SupS => Tpc)
-        case kPadInner2Tpc:   rotA = SupS2Tpc(sector) * PadInner2SupS(sector); break;
-        case kPadOuter2Tpc:   rotA = SupS2Tpc(sector) * PadOuter2SupS(sector); break;
+        case kPadInner2Tpc:   rotA = rot(sector, kSupS2Tpc) * rot(sector, kPadInner2SupS); break;
+        case kPadOuter2Tpc:   rotA = rot(sector, kSupS2Tpc) * rot(sector, kPadOuter2SupS); break;
         // (Pad == SecL) => (SubS[io] => SupS => Tpc => Glob)
-        case kPadInner2Glob:  rotA = tpc2global_ * PadInner2Tpc(sector); break;
-        case kPadOuter2Glob:  rotA = tpc2global_ * PadOuter2Tpc(sector); break;
+        case kPadInner2Glob:  rotA = tpc2global * rot(sector, kPadInner2Tpc); break;
+        case kPadOuter2Glob:  rotA = tpc2global * rot(sector, kPadOuter2Tpc); break;
 
         default:
           assert(0);
@@ -395,12 +683,18 @@ void CoordTransform::SetTpcRotations()
 
       if (sector == 0) {
         rotA.SetName("Tpc2Glob");
-        tpc2global_ = rotA;
+        tpc2global = rotA;
       }
       else {
         rotA.SetName(Form(names[k], sector));
-        sector_rotations_[kTotalTpcSectorRotaions*(sector - 1) + k] = rotA;
+        rotations[kTotalTpcSectorRotaions*(sector - 1) + k] = rotA;
       }
     }
   }
+
+  tpc2global_ = PackedTransform(tpc2global);
+  sector_rotations_.clear();
+
+  for (const TGeoHMatrix& m : rotations)
+    sector_rotations_.emplace_back(m);
 }
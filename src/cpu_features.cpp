@@ -0,0 +1,62 @@
+#include <atomic>
+
+#include "tpcrs/detail/cpu_features.h"
+
+
+namespace tpcrs { namespace detail {
+
+namespace {
+
+std::atomic<int> max_simd(static_cast<int>(Simd::kAvx512));
+
+
+/// The instruction sets supported by the CPU, queried once
+struct CpuSupport
+{
+  bool avx2 = false;
+  bool avx512 = false;
+
+  CpuSupport()
+  {
+#ifdef TPCRS_X86_DISPATCH
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+    avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw");
+#endif
+  }
+};
+
+
+const CpuSupport& Support()
+{
+  static const CpuSupport support;
+  return support;
+}
+
+
+bool Allowed(Simd simd)
+{
+  return max_simd.load(std::memory_order_relaxed) >= static_cast<int>(simd);
+}
+
+}
+
+
+bool HasAvx2()
+{
+  return Support().avx2 && Allowed(Simd::kAvx2);
+}
+
+
+bool HasAvx512()
+{
+  return Support().avx512 && Allowed(Simd::kAvx512);
+}
+
+
+void SetMaxSimd(Simd simd)
+{
+  max_simd.store(static_cast<int>(simd), std::memory_order_relaxed);
+}
+
+} }
@@ -137,217 +137,330 @@ CLEAR:
     LOG_ERROR << " \tTwo ADC corrections activated ? Keep active only AdcCorrectionMDF\n";
     corrections_[kAdcCorrection     ].Chair = 0;
   }
+
+  Compile();
 }
 
 
-int StTpcdEdxCorrection::dEdxCorrection(int sector, int row, dEdxY2_t &CdEdx)
+/**
+ * The factors of the corrections depending only on the run conditions, sector,
+ * and row are evaluated here once. They are still applied one by one in the
+ * order of the corrections so the result is the same as if they were
+ * evaluated for every cluster.
+ */
+void StTpcdEdxCorrection::Compile()
 {
-  if (CdEdx.F.dE <= 0.) CdEdx.F.dE = 1;
+  for (int k = kUncorrected + 1; k < kTpcLast; k++) {
+    if (!(options_ & (1u << k)) || !corrections_[k].Chair) continue;
+
+    Step step{k, Eval::kCluster, 0};
+
+    switch (k) {
+      case kTpcSecRowB:
+      case kTpcSecRowC:
+      case kTpcCurrentCorrection:
+      case kTpcRowQ:
+      case ktpcPressure:
+      case ktpcMethaneIn:
+      case ktpcGasTemperature:
+      case ktpcWaterOut:
+      case kTpcZDC:           step.eval = Eval::kConstant; break;
+      case kTpcEffectivedX:   step.eval = Eval::kConstantdX; break;
+      case kAdcCorrection:    step.eval = Eval::kAdc; break;
+      case kAdcCorrectionMDF: step.eval = Eval::kAdcMDF; break;
+      case kTpcdCharge:       step.eval = Eval::kdCharge; break;
+      case kdXCorrection:     step.eval = Eval::kdX; break;
+      case kSpaceCharge:      step.eval = Eval::kSpaceCharge; break;
+      case ktpcTime:          step.eval = Eval::kTime; break;
+      case kTpcPadMDF:        step.eval = Eval::kPadMDF; break;
+      case kEdge:             step.eval = Eval::kEdge; break;
+    }
 
-  double dE = CdEdx.F.dE;
-  double dx = CdEdx.F.dx;
+    if (k != kTpcSecRowB && k != kTpcSecRowC && k != kTpcEffectivedX && k != kAdcCorrectionMDF && k != kTpcPadMDF)
+      step.nrows = ((const St_tpcCorrectionC*) corrections_[k].Chair)->Struct()->nrows;
 
-  if (dx <= 0) return 3;
+    steps_.push_back(step);
+  }
 
-  ESector kTpcOutIn = kTpcOuter;
+  const tss_tsspar& tsspar = cfg_.S<tss_tsspar>();
+  int n_sectors = cfg_.S<tpcDimensions>().numberOfSectors;
+  n_rows_ = cfg_.S<tpcPadPlanes>().padRows;
 
-  if (tpcrs::IsInner(row, cfg_)) kTpcOutIn = kTpcInner;
+  row_constants_.resize(n_sectors * n_rows_);
+  step_constants_.resize(n_sectors * n_rows_ * steps_.size());
 
-  const tss_tsspar& tsspar = cfg_.S<tss_tsspar>();
-  double gasGain = 1;
-
-  if (tpcrs::IsInner(row, cfg_))
-    gasGain = tpcrs::GainCorrection(sector, row, cfg_) * tsspar.wire_coupling_in;
-  else
-    gasGain = tpcrs::GainCorrection(sector, row, cfg_) * tsspar.wire_coupling_out;
-
-  if (gasGain <= 0) return 4;
-
-  double Adc2GeVReal = tsspar.ave_ion_pot * tsspar.scale / gasGain;
-  double gc, ADC, xL2;
-  int nrows = 0;
-  double VarXs[kTpcLast] = {-999.};
-  VarXs[kTpcZDC]               = (cfg_.S<trigDetSums>().zdcX > 0) ? std::log10(cfg_.S<trigDetSums>().zdcX) : 0;
-  VarXs[kTpcCurrentCorrection] = cfg_.C<St_TpcAvgCurrentC>().AvCurrRow(sector, row);
-  VarXs[kTpcrCharge]           = CdEdx.rCharge;
-  VarXs[kTpcRowQ]              = 1e6 * cfg_.C<St_TpcAvgCurrentC>().AcChargeRowL(sector, row); // uC/cm
-  VarXs[ktpcPressure]          = std::log(cfg_.S<tpcGas>().barometricPressure);
-  VarXs[kDrift]                = CdEdx.ZdriftDistance * cfg_.S<tpcGas>().ppmOxygenIn;      // Blair correction
-  VarXs[kMultiplicity]         = CdEdx.QRatio;
-  VarXs[kzCorrection]          = CdEdx.ZdriftDistance;
-  VarXs[ktpcMethaneIn]         = cfg_.S<tpcGas>().percentMethaneIn * 1000. / cfg_.S<tpcGas>().barometricPressure;
-  VarXs[ktpcGasTemperature]    = cfg_.S<tpcGas>().outputGasTemperature;
-  VarXs[ktpcWaterOut]          = cfg_.S<tpcGas>().ppmWaterOut;
-  VarXs[kEdge]                 = CdEdx.PhiR;
-
-  if (VarXs[kEdge] < -1) VarXs[kEdge] = -1;
-  if (VarXs[kEdge] >  1) VarXs[kEdge] =  1;
-
-  VarXs[kPhiDirection]     = (std::abs(CdEdx.xyzD[0]) > 1.e-7) ? std::abs(CdEdx.xyzD[1] / CdEdx.xyzD[0]) : 999.;
-  VarXs[kTanL]             = CdEdx.TanL; // used in adc correction
-  VarXs[ktpcTime]          = CdEdx.tpcTime;
-  VarXs[kAdcCorrection]    = CdEdx.adc;
-  VarXs[kAdcCorrectionMDF] = CdEdx.adc;
+  for (int sector = 1; sector <= n_sectors; sector++) {
+    for (int row = 1; row <= n_rows_; row++) {
+      int i_row = (sector - 1) * n_rows_ + row - 1;
+      RowConstants& rc = row_constants_[i_row];
 
-  for (int k = kUncorrected; k <= kTpcLast; k++) {
-    int l = 0;
-    bool do_cut = false;
-    tpcCorrection* cor = 0;
-    tpcCorrection* corl = 0;
+      rc.io = tpcrs::IsInner(row, cfg_) ? kTpcInner : kTpcOuter;
 
-    if (!(options_ & (1u << k))) goto ENDL;
-    if (!corrections_[k].Chair) goto ENDL;
+      double gasGain = 1;
 
-    if (k == kTpcSecRowB || k == kTpcSecRowC ) {
-      const St_TpcSecRowCorC* chair = (const St_TpcSecRowCorC*) corrections_[k].Chair;
+      if (tpcrs::IsInner(row, cfg_))
+        gasGain = tpcrs::GainCorrection(sector, row, cfg_) * tsspar.wire_coupling_in;
+      else
+        gasGain = tpcrs::GainCorrection(sector, row, cfg_) * tsspar.wire_coupling_out;
+
+      rc.status = gasGain <= 0 ? 4 : 0;
+      rc.Adc2GeVReal = gasGain <= 0 ? 0 : tsspar.ave_ion_pot * tsspar.scale / gasGain;
+
+      for (size_t i = 0; i < steps_.size(); i++) {
+        const Step& step = steps_[i];
+        StepConstants& c = step_constants_[i_row * steps_.size() + i];
+
+        c.l = TableRow(step, sector, row);
+        c.status = 0;
+        c.factor = 1;
+
+        if (step.eval == Eval::kConstant) {
+          if (step.k == kTpcSecRowB || step.k == kTpcSecRowC) {
+            const St_TpcSecRowCorC* chair = (const St_TpcSecRowCorC*) corrections_[step.k].Chair;
+            c.factor = chair->Struct(sector - 1)->GainScale[row - 1];
+            c.status = c.factor <= 0.0 ? 1 : 0;
+          }
+          else {
+            c.status = Correct(step.k, c.l, RowVariable(step.k, sector, row), false, c.factor);
+          }
+        }
+        else if (step.eval == Eval::kConstantdX) {
+          const St_TpcEffectivedXC* chair = (const St_TpcEffectivedXC*) corrections_[step.k].Chair;
+          c.factor = rc.io == kTpcOuter ? chair->scaleOuter() : chair->scaleInner();
+        }
+      }
+    }
+  }
+}
 
-      if (! chair) goto ENDL;
 
-      const TpcSecRowCor* gain = chair->Struct(sector - 1);
-      gc =  gain->GainScale[row - 1];
+int StTpcdEdxCorrection::TableRow(const Step& step, int sector, int row) const
+{
+  ESector kTpcOutIn = tpcrs::IsInner(row, cfg_) ? kTpcInner : kTpcOuter;
 
-      if (gc <= 0.0) return 1;
+  if (step.k == kTpcSecRowB || step.k == kTpcSecRowC || step.k == kTpcEffectivedX)
+    return 0;
 
-      dE *= gc;
+  if (step.k == kTpcPadMDF)
+    return 2 * (sector - 1) + kTpcOutIn;
 
-      goto ENDL;
-    }
-    else if (k == kTpcEffectivedX) {
-      if      (kTpcOutIn == kTpcOuter) dx *= ((const St_TpcEffectivedXC* ) corrections_[k].Chair)->scaleOuter();
-      else if (kTpcOutIn == kTpcInner) dx *= ((const St_TpcEffectivedXC* ) corrections_[k].Chair)->scaleInner();
+  if (step.k == kAdcCorrectionMDF) {
+    int nrows = ((St_TpcAdcCorrectionMDF*) corrections_[step.k].Chair)->nrows();
+    return kTpcOutIn >= nrows ? nrows - 1 : kTpcOutIn;
+  }
 
-      goto ENDL;
-    }
+  const tpcCorrection* cor = ((const St_tpcCorrectionC*) corrections_[step.k].Chair)->Struct();
+  int nrows = step.nrows;
+  int l = 0;
+
+  if (nrows <= 3)
+    l = std::min(nrows - 1, static_cast<int>(kTpcOutIn));
+  else {
+    int channel = tpcrs::ChannelFromRow(row);
+    if (nrows == cfg_.S<tpcPadPlanes>().padRows) l = row - 1;
+    else if (nrows == 192) {l = 8 * (sector - 1) + channel - 1; assert(l == (cor + l)->idx - 1);}
+    else if (nrows ==  48) {l = 2 * (sector - 1) + kTpcOutIn;}
+    else if (nrows ==   6) {l =                    kTpcOutIn;             if (sector > 12) l += 3;}
+    else if (nrows ==   4) {l = std::min(static_cast<int>(kTpcOutIn), 1); if (sector > 12) l += 2;}
+  }
 
-    if (k == kTpcPadMDF) {
-      l = 2 * (sector - 1);
+  if (step.k == kTpcdCharge && l > 2) l = 1;
 
-      if (tpcrs::IsInner(row, cfg_)) l += kTpcInner;
+  return l;
+}
 
-      dE *= std::exp(-((St_TpcPadCorrectionMDF*)corrections_[k].Chair)->Eval(l, CdEdx.yrow, CdEdx.xpad));
-      goto ENDL;
-    }
 
-    if (k == kAdcCorrectionMDF) {
-      ADC = CdEdx.adc;
+double StTpcdEdxCorrection::RowVariable(int k, int sector, int row) const
+{
+  switch (k) {
+    case kTpcZDC:               return (cfg_.S<trigDetSums>().zdcX > 0) ? std::log10(cfg_.S<trigDetSums>().zdcX) : 0;
+    case kTpcCurrentCorrection: return cfg_.C<St_TpcAvgCurrentC>().AvCurrRow(sector, row);
+    case kTpcRowQ:              return 1e6 * cfg_.C<St_TpcAvgCurrentC>().AcChargeRowL(sector, row); // uC/cm
+    case ktpcPressure:          return std::log(cfg_.S<tpcGas>().barometricPressure);
+    case ktpcMethaneIn:         return cfg_.S<tpcGas>().percentMethaneIn * 1000. / cfg_.S<tpcGas>().barometricPressure;
+    case ktpcGasTemperature:    return cfg_.S<tpcGas>().outputGasTemperature;
+    case ktpcWaterOut:          return cfg_.S<tpcGas>().ppmWaterOut;
+    default:                    return -999.;
+  }
+}
 
-      if (ADC <= 0) return 3; //HACK to avoid FPE (VP)
 
-      double xx[2] = {std::log(ADC), (double)(CdEdx.npads + CdEdx.ntmbks)};
-      l = kTpcOutIn;
-      int nrows = ((St_TpcAdcCorrectionMDF*) corrections_[k].Chair)->nrows();
+double StTpcdEdxCorrection::ClusterVariable(int k, const dEdxY2_t &CdEdx) const
+{
+  switch (k) {
+    case kTpcrCharge:   return CdEdx.rCharge;
+    case kDrift:        return CdEdx.ZdriftDistance * cfg_.S<tpcGas>().ppmOxygenIn;      // Blair correction
+    case kMultiplicity: return CdEdx.QRatio;
+    case kzCorrection:  return CdEdx.ZdriftDistance;
+    case kPhiDirection: return (std::abs(CdEdx.xyzD[0]) > 1.e-7) ? std::abs(CdEdx.xyzD[1] / CdEdx.xyzD[0]) : 999.;
+    case kTanL:         return CdEdx.TanL;
+    case ktpcTime:      return CdEdx.tpcTime;
+    default:            return -999.;
+  }
+}
 
-      if (l >= nrows) l = nrows - 1;
 
-      dE = ADC * Adc2GeVReal * ((St_TpcAdcCorrectionMDF*) corrections_[k].Chair)->Eval(l, xx);
-      goto ENDL;
-    }
+int StTpcdEdxCorrection::Correct(int k, int l, double x, bool do_cut, double& dE) const
+{
+  const St_tpcCorrectionC* chair = (const St_tpcCorrectionC*) corrections_[k].Chair;
+  const tpcCorrection* corl = chair->Struct() + l;
 
-    cor = ((St_tpcCorrectionC*) corrections_[k].Chair)->Struct();
+  if (corl->type == 300) {
+    if (corl->min > 0 && x < corl->min) x = corl->min;
+    if (corl->max > 0 && x > corl->max) x = corl->max;
+  }
 
-    if (! cor) goto ENDL;
+  if (std::abs(corl->npar) >= 100 || do_cut) {
+    if (!(corl->min >= corl->max) && !(corl->min <= x && x <= corl->max))
+      return 2;
+  }
 
-    nrows = cor->nrows;
+  if (corl->npar % 100) {
+    dE *= std::exp(-chair->CalcCorrection(l, x));
+  }
 
-    if (nrows <= 3)
-      l = std::min(nrows - 1, static_cast<int>(kTpcOutIn));
-    else {
-      int channel = tpcrs::ChannelFromRow(row);
-      if (nrows == cfg_.S<tpcPadPlanes>().padRows) l = row - 1;
-      else if (nrows == 192) {l = 8 * (sector - 1) + channel - 1; assert(l == (cor + l)->idx - 1);}
-      else if (nrows ==  48) {l = 2 * (sector - 1) + kTpcOutIn;}
-      else if (nrows ==   6) {l =                    kTpcOutIn;             if (sector > 12) l += 3;}
-      else if (nrows ==   4) {l = std::min(static_cast<int>(kTpcOutIn), 1); if (sector > 12) l += 2;}
-    }
+  return 0;
+}
+
+
+int StTpcdEdxCorrection::Apply(const Step& step, const StepConstants& c, const RowConstants& rc, int sector, int row,
+                               dEdxY2_t &CdEdx, double& dE, double& dx) const
+{
+  const int k = step.k;
+  const int l = c.l;
+  const St_tpcCorrectionC* chair = (const St_tpcCorrectionC*) corrections_[k].Chair;
 
-    corl = cor + l;
+  switch (step.eval) {
+    case Eval::kConstant:
+      if (c.status) return c.status;
+      dE *= c.factor;
+      return 0;
 
-    if (k == kAdcCorrection) {
-      ADC = CdEdx.adc;
+    case Eval::kConstantdX:
+      dx *= c.factor;
+      return 0;
+
+    case Eval::kPadMDF:
+      dE *= std::exp(-((St_TpcPadCorrectionMDF*)corrections_[k].Chair)->Eval(l, CdEdx.yrow, CdEdx.xpad));
+      return 0;
+
+    case Eval::kAdcMDF: {
+      double ADC = CdEdx.adc;
 
       if (ADC <= 0) return 3; //HACK to avoid FPE (VP)
 
-      if (corl->type == 12)
-        dE = Adc2GeVReal * ((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(l, ADC, VarXs[kTanL]);
+      double xx[2] = {std::log(ADC), (double)(CdEdx.npads + CdEdx.ntmbks)};
+      dE = ADC * rc.Adc2GeVReal * ((St_TpcAdcCorrectionMDF*) corrections_[k].Chair)->Eval(l, xx);
+      return 0;
+    }
+
+    case Eval::kAdc: {
+      double ADC = CdEdx.adc;
+
+      if (ADC <= 0) return 3; //HACK to avoid FPE (VP)
+
+      if (chair->Struct()[l].type == 12)
+        dE = rc.Adc2GeVReal * chair->CalcCorrection(l, ADC, CdEdx.TanL);
       else
-        dE = Adc2GeVReal * ((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(l, ADC, std::abs(CdEdx.zG));
+        dE = rc.Adc2GeVReal * chair->CalcCorrection(l, ADC, std::abs(CdEdx.zG));
 
       if (dE <= 0) return 3;
 
-      goto ENDL;
+      return 0;
     }
-    else if (k == kTpcdCharge) {
-      if (l > 2) l = 1;
 
-      double slope = ((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(l, row + 0.5);
+    case Eval::kdCharge: {
+      double slope = chair->CalcCorrection(l, row + 0.5);
       dE *=  std::exp(-slope * CdEdx.dCharge);
-      dE *=  std::exp(-((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(2 + l, CdEdx.dCharge));
-      goto ENDL;
+      dE *=  std::exp(-chair->CalcCorrection(2 + l, CdEdx.dCharge));
+      return 0;
     }
-    else if (k == kzCorrection) {
-      do_cut = true; // Always cut
-    }
-    else if (k == kdXCorrection) {
-      xL2 = std::log2(dx);
-      double dXCorr = ((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(l, xL2);
+
+    case Eval::kdX: {
+      double xL2 = std::log2(dx);
+      double dXCorr = chair->CalcCorrection(l, xL2);
 
       if (std::abs(dXCorr) > 10) return 3;
 
-      if (nrows == 7) {// old schema without iTPC
-        dXCorr += ((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(2, xL2);
-        dXCorr += ((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(5 + kTpcOutIn, xL2);
+      if (step.nrows == 7) {// old schema without iTPC
+        dXCorr += chair->CalcCorrection(2, xL2);
+        dXCorr += chair->CalcCorrection(5 + rc.io, xL2);
       }
 
       CdEdx.dxC = std::exp(dXCorr) * CdEdx.F.dx;
       dE *= std::exp(-dXCorr);
-      goto ENDL;
+      return 0;
     }
-    else if (k == kSpaceCharge) {
+
+    case Eval::kSpaceCharge: {
+      const tpcCorrection* cor = chair->Struct();
+
       if (cor[2 * l    ].min <= CdEdx.QRatio && CdEdx.QRatio <= cor[2 * l    ].max &&
           cor[2 * l + 1].min <= CdEdx.DeltaZ && CdEdx.DeltaZ <= cor[2 * l + 1].max)
-        dE *= std::exp(-((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(2 * l,     CdEdx.QRatio)
-                       -((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(2 * l + 1, CdEdx.DeltaZ));
-      goto ENDL;
+        dE *= std::exp(-chair->CalcCorrection(2 * l,     CdEdx.QRatio)
+                       -chair->CalcCorrection(2 * l + 1, CdEdx.DeltaZ));
+      return 0;
     }
-    else if (k == kEdge) {
-      if (corl->type == 200) VarXs[kEdge] = std::abs(CdEdx.edge);
 
-      if (corl->min > 0 && corl->min > VarXs[kEdge]) return 2;
-    }
-    else if (k == ktpcTime) {   // use the correction if you have xmin < xmax && xmin <= x <= xmax
-      if (corl->min >= corl->max || corl->min > VarXs[ktpcTime] || VarXs[ktpcTime] > corl->max) goto ENDL;
+    case Eval::kTime: {
+      // use the correction if you have xmin < xmax && xmin <= x <= xmax
+      const tpcCorrection* corl = chair->Struct() + l;
+      double x = ClusterVariable(k, CdEdx);
 
-      dE *= std::exp(-((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(l, VarXs[ktpcTime]));
-      goto ENDL;
-    }
+      if (corl->min >= corl->max || corl->min > x || x > corl->max) return 0;
 
-    if (corl->type == 300) {
-      if (corl->min > 0 && VarXs[k] < corl->min) VarXs[k] = corl->min;
-      if (corl->max > 0 && VarXs[k] > corl->max) VarXs[k] = corl->max;
+      dE *= std::exp(-chair->CalcCorrection(l, x));
+      return 0;
     }
 
-    if (std::abs(corl->npar) >= 100 || do_cut) {
-      int iok = 2;
+    case Eval::kEdge: {
+      const tpcCorrection* corl = chair->Struct() + l;
+      double x = CdEdx.PhiR;
 
-      if (corl->min >= corl->max) {
-        iok = 0;
-      }
-      else {
-        if (corl->min <= VarXs[k] && VarXs[k] <= corl->max) {
-          iok = 0;
-        }
-      }
+      if (x < -1) x = -1;
+      if (x >  1) x =  1;
 
-      if (iok) {
-        return iok;
-      }
+      if (corl->type == 200) x = std::abs(CdEdx.edge);
+
+      if (corl->min > 0 && corl->min > x) return 2;
+
+      return Correct(k, l, x, false, dE);
     }
 
-    if (corl->npar % 100) {
-      dE *= std::exp(-((St_tpcCorrectionC*)corrections_[k].Chair)->CalcCorrection(l, VarXs[k]));
+    case Eval::kCluster:
+      return Correct(k, l, ClusterVariable(k, CdEdx), k == kzCorrection, dE); // Always cut in z
+  }
+
+  return 0;
+}
+
+
+int StTpcdEdxCorrection::dEdxCorrection(int sector, int row, dEdxY2_t &CdEdx) const
+{
+  if (CdEdx.F.dE <= 0.) CdEdx.F.dE = 1;
+
+  double dE = CdEdx.F.dE;
+  double dx = CdEdx.F.dx;
+
+  if (dx <= 0) return 3;
+
+  int i_row = (sector - 1) * n_rows_ + row - 1;
+  const RowConstants& rc = row_constants_[i_row];
+  const StepConstants* constants = &step_constants_[i_row * steps_.size()];
+
+  if (rc.status) return rc.status;
+
+  size_t i = 0;
+
+  for (int k = kUncorrected; k <= kTpcLast; k++) {
+    if (i < steps_.size() && steps_[i].k == k) {
+      int status = Apply(steps_[i], constants[i], rc, sector, row, CdEdx, dE, dx);
+
+      if (status) return status;
+
+      i++;
     }
 
-ENDL:
     CdEdx.C[k].dE = dE;
     CdEdx.C[k].dx = dx;
   }
@@ -355,3 +468,5 @@ ENDL:
   CdEdx.F = CdEdx.C[kTpcLast];
   return 0;
 }
+
+
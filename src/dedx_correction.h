@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "tpcrs/detail/config_structs.h"
 
 class dEdxY2_t;
@@ -102,7 +104,7 @@ class StTpcdEdxCorrection
       Corrections::kTpcLengthCorrectionMDF
   );
 
-  int dEdxCorrection(int sector, int row, dEdxY2_t &dEdx);
+  int dEdxCorrection(int sector, int row, dEdxY2_t &dEdx) const;
 
  private:
 
@@ -117,9 +119,88 @@ class StTpcdEdxCorrection
     float dE;
   };
 
+  /// The ways a correction depends on the cluster
+  enum class Eval {
+    /// A factor constant for a sector and row
+    kConstant,
+    /// A factor of dx constant for a sector and row
+    kConstantdX,
+    kAdc,
+    kAdcMDF,
+    kdCharge,
+    kdX,
+    kSpaceCharge,
+    kTime,
+    kPadMDF,
+    kEdge,
+    /// A tpcCorrection of one of the VarXs in dEdxCorrection
+    kCluster
+  };
+
+  /// An active correction compiled at construction
+  struct Step
+  {
+    int k;
+    Eval eval;
+    /// The number of rows given in the first row of a tpcCorrection table
+    int nrows;
+  };
+
+  /// The values of a step precomputed for a sector and row
+  struct StepConstants
+  {
+    /// The row of the correction table used in the sector and row
+    int l;
+    /// The code returned for every cluster in the row if not zero
+    int status;
+    /// The factor applied to dE, or to dx by a kConstantdX step
+    double factor;
+  };
+
+  /// The values of all steps precomputed for a sector and row
+  struct RowConstants
+  {
+    /// The code returned for every cluster in the row if not zero
+    int status;
+    double Adc2GeVReal;
+    ESector io;
+  };
+
+  /// Creates the steps of the active corrections and evaluates the factors
+  /// independent of the cluster for every sector and row
+  void Compile();
+
+  /// Returns the row of the tpcCorrection table of step used in the sector
+  /// and row
+  int TableRow(const Step& step, int sector, int row) const;
+
+  /// Returns the variable of a kConstant tpcCorrection in the sector and row
+  double RowVariable(int k, int sector, int row) const;
+
+  /// Returns the variable of a kCluster tpcCorrection
+  double ClusterVariable(int k, const dEdxY2_t &CdEdx) const;
+
+  /// Applies a tpcCorrection to dE. Returns 2 if x is outside the range of a
+  /// correction with a cut
+  int Correct(int k, int l, double x, bool do_cut, double& dE) const;
+
+  /// Applies the step to dE and dx. Returns the code of a rejected cluster
+  int Apply(const Step& step, const StepConstants& c, const RowConstants& rc, int sector, int row,
+            dEdxY2_t &CdEdx, double& dE, double& dx) const;
+
   const tpcrs::Configurator& cfg_;
   const int         options_;
   dEdxCorrection_t  corrections_[kTpcAllCorrections];
+
+  std::vector<Step> steps_;
+
+  int n_rows_;
+
+  /// Indexed by [sector-1][row-1]
+  std::vector<RowConstants> row_constants_;
+
+  /// Indexed by [sector-1][row-1][step]
+  std::vector<StepConstants> step_constants_;
 };
 
 
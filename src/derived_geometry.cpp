@@ -0,0 +1,42 @@
+#include "tpcrs/detail/derived_geometry.h"
+#include "tpcrs/detail/struct_containers.h"
+
+
+namespace tpcrs { namespace detail {
+
+DerivedGeometry::DerivedGeometry(const tpcrs::Configurator& cfg) :
+  n_sectors_(cfg.S<tpcDimensions>().numberOfSectors),
+  n_rows_(cfg.S<tpcPadPlanes>().padRows),
+  rows_(n_rows_),
+  sector_rows_(n_sectors_ * n_rows_),
+  drift_velocities_(n_sectors_)
+{
+  int pad_offset = 0;
+
+  for (int row = 1; row <= n_rows_; row++) {
+    bool is_inner = tpcrs::IsInner(row, cfg);
+    double pitch = is_inner ? cfg.S<tpcPadPlanes>().innerSectorPadPitch :
+                              cfg.S<tpcPadPlanes>().outerSectorPadPitch;
+    int n_pads = tpcrs::NumberOfPads(row, cfg);
+
+    rows_[row - 1] = Row{is_inner, n_pads, pad_offset, tpcrs::RadialDistanceAtRow(row, cfg), pitch};
+
+    pad_offset += n_pads;
+  }
+
+  for (int sector = 1; sector <= n_sectors_; sector++) {
+    drift_velocities_[sector - 1] = tpcrs::DriftVelocity(sector, cfg);
+
+    for (int row = 1; row <= n_rows_; row++) {
+      int l = is_inner(row) ? sector + 24 : sector;
+
+      sector_rows_[index(sector, row)] = SectorRow{
+        tpcrs::GainCorrection(sector, row, cfg),
+        cfg.S<tpcPadrowT0>(sector - 1).T0[row - 1],
+        cfg.S<tpcSectorT0offset>().t0[l - 1]
+      };
+    }
+  }
+}
+
+} }
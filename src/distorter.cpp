@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "tpcrs/detail/distorter.h"
+#include "logger.h"
+
+
+namespace tpcrs { namespace detail {
+
+namespace {
+
+/// Vacuum permittivity in F/cm
+const double kEpsilon0 = 8.854187817e-14;
+
+/// Number of rings and the resistance between adjacent rings in MOhm of the
+/// resistor chains defining the potential of the field cages
+const int kFieldCageRings = 182;
+const double kRingResistance = 2.0;
+
+/// Spacing of the grid on which the potentials are solved in cm
+const double kGridStep = 1.0;
+
+
+/**
+ * Regular grid in r and |z| covering the drift volume of one half of the TPC.
+ * The central membrane is at z = 0 and the readout plane at the last node.
+ */
+struct Grid
+{
+  double r0;
+  double dr;
+  double dz;
+  int n_r;
+  int n_z;
+
+  double r(int i) const { return r0 + i * dr; }
+  double z(int j) const { return j * dz; }
+  int index(int i, int j) const { return j * n_r + i; }
+  size_t size() const { return size_t(n_r) * n_z; }
+};
+
+
+/**
+ * Solves the Poisson equation in cylindrical coordinates assuming azimuthal
+ * symmetry, (1/r) d/dr (r dV/dr) + d^2V/dz^2 = -source, by successive
+ * over-relaxation. The values of V on the edges of the grid are kept fixed.
+ */
+void Relax(const Grid& grid, const std::vector<double>& source, std::vector<double>& V)
+{
+  double a = 1 / (grid.dr * grid.dr);
+  double b = 1 / (grid.dz * grid.dz);
+  double norm = 1 / (2 * a + 2 * b);
+
+  // Optimal over-relaxation for the Laplace operator on a square grid
+  double omega = 2 / (1 + std::sin(M_PI / std::max(grid.n_r, grid.n_z)));
+
+  double scale = 0;
+  for (size_t k = 0; k < V.size(); k++)
+    scale = std::max(scale, std::abs(V[k]) + std::abs(source[k]) / (2 * a + 2 * b));
+
+  if (scale == 0) return;
+
+  for (int iteration = 0; iteration < 100000; iteration++) {
+    double max_change = 0;
+
+    // Red-black ordering
+    for (int color = 0; color < 2; color++) {
+      for (int j = 1; j < grid.n_z - 1; j++) {
+        for (int i = 1 + (j + color) % 2; i < grid.n_r - 1; i += 2) {
+          int k = grid.index(i, j);
+          double c = grid.dr / (2 * grid.r(i));
+          double V_new = norm * (a * ((1 + c) * V[k + 1] + (1 - c) * V[k - 1]) +
+                                 b * (V[k + grid.n_r] + V[k - grid.n_r]) + source[k]);
+          double change = omega * (V_new - V[k]);
+          V[k] += change;
+          max_change = std::max(max_change, std::abs(change));
+        }
+      }
+    }
+
+    if (max_change < 1e-10 * scale) return;
+  }
+
+  LOG_WARN << "Distorter: Relaxation of the potential did not converge\n";
+}
+
+
+/**
+ * Integrates the radial electric field of the potential V from every node to
+ * the readout plane and returns the radial displacement of an electron
+ * drifting along that path, -∫ E_r / E_z dz, with E_z the magnitude of the
+ * nominal drift field.
+ */
+std::vector<double> RadialDisplacement(const Grid& grid, const std::vector<double>& V, double drift_field)
+{
+  std::vector<double> D(grid.size(), 0);
+  std::vector<double> E_r(grid.n_r);
+
+  for (int j = grid.n_z - 1; j >= 0; j--) {
+    for (int i = 0; i < grid.n_r; i++) {
+      int lo = std::max(i - 1, 0);
+      int hi = std::min(i + 1, grid.n_r - 1);
+      double E = -(V[grid.index(hi, j)] - V[grid.index(lo, j)]) / ((hi - lo) * grid.dr);
+
+      // Trapezoidal rule
+      if (j < grid.n_z - 1)
+        D[grid.index(i, j)] = D[grid.index(i, j + 1)] - grid.dz / 2 * (E + E_r[i]) / drift_field;
+
+      E_r[i] = E;
+    }
+  }
+
+  return D;
+}
+
+
+/// Fraction of the cell around r_i covered by the interval [r - w/2, r + w/2]
+double Overlap(const Grid& grid, int i, double r, double w)
+{
+  double lo = std::max(grid.r(i) - grid.dr / 2, r - w / 2);
+  double hi = std::min(grid.r(i) + grid.dr / 2, r + w / 2);
+  return hi > lo ? (hi - lo) / grid.dr : 0;
+}
+
+
+/**
+ * Sum over the luminosity detectors of the terms SC*(rate - offset)^exponent
+ * in tpcSCGL for one half of the TPC. A negative offset takes the one from the
+ * table.
+ */
+double SpaceChargeSCGL(const tpcSCGL& scgl, const trigDetSums& scalers, int half, double offset = -1)
+{
+  double sc = 0;
+
+  for (int i = 4 * half; i < 4 * half + 4; i++) {
+    double rate = ScalerRate(scalers, static_cast<int>(scgl.SCscaler[i]));
+    double x = rate - (offset < 0 ? scgl.SCoffset[i] : offset);
+    if (scgl.SC[i] != 0 && x > 0)
+      sc += scgl.SC[i] * std::pow(x, scgl.SCexponent[i]);
+  }
+
+  return sc;
+}
+
+}
+
+
+bool Distorter::HasStaticDistortions() const
+{
+  return distortions_.test(Distortions::kSpaceCharge) || distortions_.test(Distortions::kSpaceChargeR2) ||
+         distortions_.test(Distortions::kGridLeak) || distortions_.test(Distortions::kShortedRing) ||
+         distortions_.test(Distortions::kSpaceChargeGridLeak);
+}
+
+
+Distorter::Distorter(const tpcrs::Configurator& cfg, const Distorter& prev) :
+  cfg_(cfg),
+  distortions_(prev.distortions_),
+  dcfg_(cfg),
+  table_(),
+  static_()
+{
+  bool same_inputs = SameInputs(prev.cfg_);
+
+  if (same_inputs)
+    static_ = prev.static_;
+  else if (HasStaticDistortions())
+    InitStaticDistortions();
+
+  // The table includes the distortion due to the magnetic field
+  if (same_inputs && cfg_.Same<MagFactor>(prev.cfg_))
+    table_ = prev.table_;
+}
+
+
+bool Distorter::SameInputs(const tpcrs::Configurator& other) const
+{
+  if (!cfg_.Same<tpcDimensions, tpcHighVoltages, tpcOmegaTau, tpcDriftVelocity, tpcPadPlanes, tpcWirePlanes,
+                 ResponseSimulator>(other))
+    return false;
+
+  bool space_charge_r1 = distortions_.test(Distortions::kSpaceCharge);
+  bool space_charge_r2 = distortions_.test(Distortions::kSpaceChargeR2) || distortions_.test(Distortions::kGridLeak);
+
+  // The space charge is scaled by the luminosity and the magnetic field
+  if ((space_charge_r1 || space_charge_r2) && !cfg_.Same<trigDetSums, MagFactor>(other))
+    return false;
+
+  return (!space_charge_r1 || cfg_.Same<St_spaceChargeCorR1C>(other)) &&
+         (!space_charge_r2 || cfg_.Same<St_spaceChargeCorR2C>(other)) &&
+         (!distortions_.test(Distortions::kGridLeak) || cfg_.Same<St_tpcGridLeakC>(other)) &&
+         (!distortions_.test(Distortions::kSpaceChargeGridLeak) || cfg_.Same<St_tpcSCGLC, trigDetSums>(other)) &&
+         (!distortions_.test(Distortions::kShortedRing) || cfg_.Same<St_tpcFieldCageShortC>(other));
+}
+
+
+/**
+ * The space charge and the grid leak are densities of positive ions in C/cm^3
+ * uniform in z. The strength from spaceChargeCor is the density of the
+ * uniform charge. The 1/r^2 density is normalized to the same total charge.
+ * The grid leak sheets have the density of the 1/r^2 space charge at their
+ * radius times the strengths in tpcGridLeak. A shorted ring changes the
+ * potential along the resistor chain of its field cage, which is the boundary
+ * condition for the perturbation of the potential.
+ */
+void Distorter::InitStaticDistortions()
+{
+  const tpcDimensions& dims = cfg_.S<tpcDimensions>();
+
+  Grid grid;
+  grid.r0 = dims.tpcInnerRadius;
+  grid.n_r = static_cast<int>(std::ceil((dims.tpcOuterRadius - dims.tpcInnerRadius) / kGridStep)) + 1;
+  grid.n_z = static_cast<int>(std::ceil(dcfg_.readout_plane_z / kGridStep)) + 1;
+  grid.dr = (dims.tpcOuterRadius - dims.tpcInnerRadius) / (grid.n_r - 1);
+  grid.dz = dcfg_.readout_plane_z / (grid.n_z - 1);
+
+  static_.r0 = grid.r0;
+  static_.dr = grid.dr;
+  static_.dz = grid.dz;
+  static_.n_r = grid.n_r;
+  static_.n_z = grid.n_z;
+  std::fill(std::begin(static_.grid_leak_scale), std::end(static_.grid_leak_scale), 0);
+
+  double r_in = dims.tpcInnerRadius;
+  double r_out = dims.tpcOuterRadius;
+
+  // Density of the 1/r^2 charge with the same total as a unit uniform one
+  double r2_norm = (r_out * r_out - r_in * r_in) / (2 * std::log(r_out / r_in));
+
+  // The density in C/cm^3 in each half of the TPC as a function of r
+  std::vector<double> density[2] = {std::vector<double>(grid.n_r, 0), std::vector<double>(grid.n_r, 0)};
+  std::vector<double> sheet(grid.n_r, 0);
+
+  if (distortions_.test(Distortions::kSpaceCharge)) {
+    St_spaceChargeCorR1C& sc = cfg_.C<St_spaceChargeCorR1C>();
+    double coulombs = sc.getSpaceChargeCoulombs();
+    double ew_ratio = sc.getEWRatio() > 0 ? sc.getEWRatio() : 1;
+
+    for (int i = 0; i < grid.n_r; i++) {
+      density[0][i] += coulombs;
+      density[1][i] += coulombs * ew_ratio;
+    }
+  }
+
+  if (distortions_.test(Distortions::kSpaceChargeR2) || distortions_.test(Distortions::kGridLeak)) {
+    St_spaceChargeCorR2C& sc = cfg_.C<St_spaceChargeCorR2C>();
+    double coulombs = sc.getSpaceChargeCoulombs();
+    double ew_ratio = sc.getEWRatio() > 0 ? sc.getEWRatio() : 1;
+
+    std::vector<double> rho(grid.n_r, 0);
+
+    if (distortions_.test(Distortions::kSpaceChargeR2)) {
+      for (int i = 0; i < grid.n_r; i++)
+        rho[i] += coulombs * r2_norm / (grid.r(i) * grid.r(i));
+    }
+
+    if (distortions_.test(Distortions::kGridLeak)) {
+      St_tpcGridLeakC& gl = cfg_.C<St_tpcGridLeakC>();
+      double widths[] = {gl.InnerGLWidth(), gl.MiddlGLWidth(), gl.OuterGLWidth()};
+
+      for (StGLpos pos : {kGLinner, kGLmiddl, kGLouter}) {
+        double radius = gl.getGridLeakRadius(pos);
+        for (int i = 0; i < grid.n_r; i++)
+          rho[i] += coulombs * r2_norm / (radius * radius) * gl.getGridLeakStrength(pos) * Overlap(grid, i, radius, widths[pos]);
+      }
+    }
+
+    for (int i = 0; i < grid.n_r; i++) {
+      density[0][i] += rho[i];
+      density[1][i] += rho[i] * ew_ratio;
+    }
+  }
+
+  if (distortions_.test(Distortions::kSpaceChargeGridLeak)) {
+    const tpcSCGL& scgl = *cfg_.C<St_tpcSCGLC>().Struct();
+    const trigDetSums& scalers = cfg_.S<trigDetSums>();
+
+    for (int half = 0; half < 2; half++) {
+      double sc = SpaceChargeSCGL(scgl, scalers, half);
+
+      for (int i = 0; i < grid.n_r; i++)
+        density[half][i] += sc * r2_norm / (grid.r(i) * grid.r(i));
+
+      // Sectors 1 to 12 are in the first half and 13 to 24 in the second one
+      for (int s = 12 * half; s < 12 * half + 12; s++)
+        static_.grid_leak_scale[s] = scgl.GL[s] * SpaceChargeSCGL(scgl, scalers, half, scgl.GLoffset[s]);
+    }
+
+    for (int i = 0; i < grid.n_r; i++)
+      sheet[i] = r2_norm / (scgl.GLradius * scgl.GLradius) * Overlap(grid, i, scgl.GLradius, scgl.GLwidth);
+  }
+
+  // The potential at the field cages relative to the nominal one
+  std::vector<double> boundary[2][2] = {
+    {std::vector<double>(grid.n_z, 0), std::vector<double>(grid.n_z, 0)},
+    {std::vector<double>(grid.n_z, 0), std::vector<double>(grid.n_z, 0)}
+  };
+
+  if (distortions_.test(Distortions::kShortedRing)) {
+    St_tpcFieldCageShortC& shorts = cfg_.C<St_tpcFieldCageShortC>();
+    // tpcHighVoltages gives the magnitude of the negative cathode potential.
+    // The potential rises from the cathode at the central membrane toward the
+    // gated grid
+    double cathode_potential = -std::abs(dcfg_.cathode_voltage);
+    double voltage = dcfg_.gated_grid_voltage - cathode_potential;
+    double R_nominal = kFieldCageRings * kRingResistance;
+
+    for (unsigned int row = 0; row < shorts.GetNRows(); row++) {
+      // The table counts the west side, i.e. the first half, as 1
+      int half = shorts.side(row) > 0.5 ? 0 : 1;
+      int cage = shorts.cage(row) > 0.5 ? 1 : 0;
+      double ring = shorts.ring(row);
+      double R_total = R_nominal - shorts.MissingResistance(row) + shorts.resistor(row);
+
+      for (int j = 0; j < grid.n_z; j++) {
+        // Rings are counted from the central membrane
+        double u = double(j) / (grid.n_z - 1) * kFieldCageRings;
+        double R = u * kRingResistance - (u > ring ? shorts.MissingResistance(row) : 0);
+        boundary[half][cage][j] += voltage * (R / R_total - u / kFieldCageRings);
+      }
+    }
+  }
+
+  for (int half = 0; half < 2; half++) {
+    std::vector<double> source(grid.size(), 0);
+    std::vector<double> V(grid.size(), 0);
+
+    for (int j = 0; j < grid.n_z; j++) {
+      for (int i = 0; i < grid.n_r; i++)
+        source[grid.index(i, j)] = density[half][i] / kEpsilon0;
+
+      V[grid.index(0, j)] = boundary[half][0][j];
+      V[grid.index(grid.n_r - 1, j)] = boundary[half][1][j];
+    }
+
+    Relax(grid, source, V);
+    static_.symmetric[half] = RadialDisplacement(grid, V, dcfg_.electric_field);
+
+    if (!distortions_.test(Distortions::kSpaceChargeGridLeak)) continue;
+
+    std::fill(V.begin(), V.end(), 0);
+
+    for (int j = 0; j < grid.n_z; j++)
+      for (int i = 0; i < grid.n_r; i++)
+        source[grid.index(i, j)] = sheet[i] / kEpsilon0;
+
+    Relax(grid, source, V);
+    static_.grid_leak[half] = RadialDisplacement(grid, V, dcfg_.electric_field);
+  }
+}
+
+
+double Distorter::StaticDistortion::Interpolate(const std::vector<double>& values, double r, double z) const
+{
+  if (values.empty()) return 0;
+
+  // Extend the values at the edges so that the table nodes just outside the
+  // drift volume do not spoil the interpolation inside
+  double u = std::min(std::max((r - r0) / dr, 0.), n_r - 1.);
+  double w = std::min(std::max(z / dz, 0.), n_z - 1.);
+
+  int i = std::min(static_cast<int>(u), n_r - 2);
+  int j = std::min(static_cast<int>(w), n_z - 2);
+
+  u -= i;
+  w -= j;
+
+  const double* v = &values[j * n_r + i];
+  double v0 = v[0]   + u * (v[1]       - v[0]);
+  double v1 = v[n_r] + u * (v[n_r + 1] - v[n_r]);
+
+  return v0 + w * (v1 - v0);
+}
+
+
+/**
+ * The radial displacement D is rotated by the magnetic field as in the
+ * Langevin equation: the electron moves by const_0*D along r and by const_1*D
+ * along phi.
+ */
+void Distorter::StaticDisplacement(double x, double y, double z, int half, double& dx, double& dy) const
+{
+  dx = dy = 0;
+
+  double r = std::sqrt(x * x + y * y);
+
+  if (r == 0) return;
+
+  double D = static_.Interpolate(static_.symmetric[half], r, z);
+
+  if (!static_.grid_leak[half].empty()) {
+    // The sectors are 30 degrees wide. Sectors 3 and 21 are centered at phi =
+    // 0, and the numbers decrease with phi in the first half and increase in
+    // the second one
+    int k = static_cast<int>(std::lround(std::atan2(y, x) * 6 / M_PI));
+    int sector = half == 0 ? (((3 - k) % 12 + 11) % 12) + 1 : (((9 + k) % 12 + 11) % 12) + 13;
+    D += static_.grid_leak_scale[sector - 1] * static_.Interpolate(static_.grid_leak[half], r, z);
+  }
+
+  double d_r = dcfg_.const_0 * D;
+  double d_phi = dcfg_.const_1 * D;
+
+  dx = (d_r * x - d_phi * y) / r;
+  dy = (d_r * y + d_phi * x) / r;
+}
+
+
+void Distorter::TabulateStaticDistortions()
+{
+  for (int half = 0; half < 2; half++) {
+    for (int iz = 0; iz < table_.n_z; iz++) {
+      for (int iy = 0; iy < table_.n_xy; iy++) {
+        for (int ix = 0; ix < table_.n_xy; ix++) {
+          double dx, dy;
+          StaticDisplacement(table_.xy0 + ix * table_.xy_step, table_.xy0 + iy * table_.xy_step, iz * table_.z_step,
+                             half, dx, dy);
+
+          float* node = &table_.values[2 * (((half * table_.n_z + iz) * table_.n_xy + iy) * table_.n_xy + ix)];
+          node[0] += dx;
+          node[1] += dy;
+        }
+      }
+    }
+  }
+}
+
+} }
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "tpcrs/detail/field_map.h"
+#include "logger.h"
+
+
+namespace tpcrs { namespace detail {
+
+namespace {
+
+const char kMagic[8] = {'T', 'P', 'C', 'R', 'S', 'M', 'A', 'P'};
+
+const uint32_t kVersion = 2;
+
+/// Written in the native byte order to detect maps from a different platform
+const uint32_t kByteOrder = 0x01020304;
+
+/// The float values follow the header
+struct Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t n_r;
+  uint32_t n_z;
+  uint32_t n_phi;
+  uint32_t n_components;
+};
+
+
+bool EndsWith(const std::string& str, const std::string& suffix)
+{
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+
+GridAxis::GridAxis(const float* nodes, int n_nodes) :
+  nodes_(nodes),
+  n_nodes_(n_nodes),
+  uniform_(true),
+  x0_(n_nodes > 0 ? nodes[0] : 0),
+  inv_step_(0),
+  buckets_()
+{
+  if (n_nodes < 2) return;
+
+  float range = nodes[n_nodes - 1] - nodes[0];
+  float min_step = range;
+
+  for (int i = 1; i < n_nodes; i++) {
+    float step = nodes[i] - nodes[i - 1];
+    min_step = std::min(min_step, step);
+    uniform_ = uniform_ && std::abs(step - range / (n_nodes - 1)) <= 1e-5 * range;
+  }
+
+  if (uniform_) {
+    inv_step_ = (n_nodes - 1) / range;
+    return;
+  }
+
+  // The buckets are not wider than the smallest cell. Too many nodes within a
+  // bucket only make FindCell slower but not wrong
+  int n_buckets = min_step > 0 ? std::min(static_cast<int>(std::ceil(range / min_step)), 4096) : 4096;
+  inv_step_ = n_buckets / range;
+
+  buckets_.resize(n_buckets);
+
+  for (int b = 0, i = 0; b < n_buckets; b++) {
+    float edge = nodes[0] + b / inv_step_;
+    while (i < n_nodes - 2 && nodes[i + 1] <= edge) i++;
+    buckets_[b] = i;
+  }
+}
+
+
+FieldMap::FieldMap() :
+  n_r_(0), n_z_(0), n_phi_(0), n_components_(0),
+  r_(nullptr), z_(nullptr), phi_(nullptr), B_(nullptr),
+  r_axis_(), z_axis_(), phi_axis_(),
+  values_(),
+  file_()
+{
+}
+
+
+void FieldMap::Assign(const float* values)
+{
+  r_   = values;
+  z_   = r_ + n_r_;
+  phi_ = z_ + n_z_;
+  B_   = phi_ + n_phi_;
+
+  r_axis_   = GridAxis(r_, n_r_);
+  z_axis_   = GridAxis(z_, n_z_);
+  phi_axis_ = GridAxis(phi_, n_phi_);
+}
+
+
+std::shared_ptr<const FieldMap> FieldMap::Get(const std::string& path)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<const FieldMap>> maps;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::shared_ptr<const FieldMap>& map = maps[path];
+
+  if (!map) {
+    if (EndsWith(path, ".bin"))
+      map = ReadBinary(path);
+    else
+      map = ReadText(path);
+  }
+
+  return map;
+}
+
+
+/**
+ * Reads a map in the text format of the STAR field maps. The header gives the
+ * number of z, r, and, for a 3D map, phi nodes. Every following line holds the
+ * r, z, (phi,) Br, Bz, (Bphi) values at one node with r changing fastest.
+ */
+std::unique_ptr<FieldMap> FieldMap::ReadText(const std::string& path)
+{
+  FILE* file = std::fopen(path.c_str(), "r");
+
+  if (!file) {
+    LOG_ERROR << "FieldMap: Cannot open " << path << '\n';
+    return nullptr;
+  }
+
+  std::unique_ptr<FieldMap> map(new FieldMap());
+  char line[128];
+  int n_z = 0, n_r = 0, n_phi = 0;
+
+  // Skip the comments and read the dimensions
+  bool ok = std::fgets(line, sizeof(line), file) && std::fgets(line, sizeof(line), file) &&
+            std::fgets(line, sizeof(line), file) && std::sscanf(line, "%d", &n_z) == 1 &&
+            std::fgets(line, sizeof(line), file) && std::sscanf(line, "%d", &n_r) == 1 &&
+            std::fgets(line, sizeof(line), file);
+
+  bool is_3d = ok && std::sscanf(line, "%d", &n_phi) == 1;
+
+  // Skip the column names following the number of phi nodes
+  if (is_3d)
+    ok = std::fgets(line, sizeof(line), file) != nullptr;
+  else
+    n_phi = 1;
+
+  if (!ok || n_z < 2 || n_r < 2 || (is_3d && n_phi < 2)) {
+    std::fclose(file);
+    LOG_ERROR << "FieldMap: Invalid header in " << path << '\n';
+    return nullptr;
+  }
+
+  map->n_r_ = n_r;
+  map->n_z_ = n_z;
+  map->n_phi_ = n_phi;
+  map->n_components_ = is_3d ? 3 : 2;
+  map->values_.resize(n_r + n_z + n_phi + map->n_components_ * n_phi * n_z * n_r, 0);
+
+  float* r   = map->values_.data();
+  float* z   = r + n_r;
+  float* phi = z + n_z;
+  float* B   = phi + n_phi;
+
+  for (int i = 0; ok && i < n_phi; i++) {
+    for (int j = 0; ok && j < n_z; j++) {
+      for (int k = 0; ok && k < n_r; k++, B += map->n_components_) {
+        ok = std::fgets(line, sizeof(line), file) != nullptr;
+
+        if (is_3d) {
+          ok = ok && std::sscanf(line, " %f %f %f %f %f %f ", &r[k], &z[j], &phi[i], &B[0], &B[1], &B[2]) == 6;
+          phi[i] *= M_PI / 180.;   // Convert to Radians  phi = 0 to 2*Pi
+        } else {
+          ok = ok && std::sscanf(line, " %f %f %f %f ", &r[k], &z[j], &B[0], &B[1]) == 4;
+        }
+      }
+    }
+  }
+
+  std::fclose(file);
+
+  map->Assign(map->values_.data());
+
+  if (!ok) {
+    LOG_ERROR << "FieldMap: Cannot read " << path << '\n';
+    return nullptr;
+  }
+
+  return map;
+}
+
+
+std::unique_ptr<FieldMap> FieldMap::ReadBinary(const std::string& path)
+{
+  std::unique_ptr<FieldMap> map(new FieldMap());
+  map->file_.reset(new MappedFile(path));
+
+  if (!map->file_->data()) {
+    LOG_ERROR << "FieldMap: Cannot open " << path << '\n';
+    return nullptr;
+  }
+
+  const MappedFile& file = *map->file_;
+
+  if (file.size() < sizeof(Header)) {
+    LOG_ERROR << "FieldMap: Invalid binary map " << path << '\n';
+    return nullptr;
+  }
+
+  const Header& header = *reinterpret_cast<const Header*>(file.data());
+
+  size_t n_nodes = size_t(header.n_phi) * header.n_z * header.n_r;
+  size_t n_values = header.n_r + header.n_z + header.n_phi + header.n_components * n_nodes;
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+      header.byte_order != kByteOrder || header.n_r < 2 || header.n_z < 2 || header.n_phi < 1 ||
+      (header.n_components != 2 && header.n_components != 3) ||
+      file.size() != sizeof(Header) + n_values * sizeof(float))
+  {
+    LOG_ERROR << "FieldMap: Invalid binary map " << path << '\n';
+    return nullptr;
+  }
+
+  map->n_r_ = header.n_r;
+  map->n_z_ = header.n_z;
+  map->n_phi_ = header.n_phi;
+  map->n_components_ = header.n_components;
+  map->Assign(reinterpret_cast<const float*>(file.data() + sizeof(Header)));
+
+  return map;
+}
+
+
+bool FieldMap::WriteBinary(const std::string& path) const
+{
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrder;
+  header.n_r = n_r_;
+  header.n_z = n_z_;
+  header.n_phi = n_phi_;
+  header.n_components = n_components_;
+
+  FILE* file = std::fopen(path.c_str(), "wb");
+
+  if (!file) {
+    LOG_ERROR << "FieldMap: Cannot create " << path << '\n';
+    return false;
+  }
+
+  // The arrays are contiguous
+  size_t n_values = n_r_ + n_z_ + n_phi_ + size_t(n_components_) * n_phi_ * n_z_ * n_r_;
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(r_, sizeof(float), n_values, file) == n_values;
+
+  ok = std::fclose(file) == 0 && ok;
+
+  if (!ok) LOG_ERROR << "FieldMap: Cannot write " << path << '\n';
+
+  return ok;
+}
+
+} }
@@ -1,13 +1,70 @@
+#include <algorithm>
 #include <string>
 #include <cmath>
 
 #include "tpcrs/configurator.h"
+#include "tpcrs/detail/cpu_features.h"
 #include "tpcrs/detail/mag_field.h"
 #include "logger.h"
 
 
 namespace tpcrs { namespace detail {
 
+namespace {
+
+/**
+ * Interpolates linearly between (x0[i], y0[i]) and (x1[i], y1[i]) at x[i] for
+ * every i < n. The arithmetic is the same as in MagField::Interpolate so that
+ * all implementations give identical results.
+ */
+using LerpFunc = void (*)(int n, const float* x, const float* x0, const float* x1,
+                          const float* y0, const float* y1, float* y);
+
+
+void LerpScalar(int n, const float* x, const float* x0, const float* x1,
+                const float* y0, const float* y1, float* y)
+{
+  for (int i = 0; i < n; ++i)
+    y[i] = y0[i] + ( y1[i] - y0[i] ) * ( x[i] - x0[i] ) / ( x1[i] - x0[i] ) ;
+}
+
+
+#ifdef TPCRS_X86_DISPATCH
+
+__attribute__((target("avx2")))
+void LerpAvx2(int n, const float* x, const float* x0, const float* x1,
+              const float* y0, const float* y1, float* y)
+{
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256 x0_v = _mm256_loadu_ps(x0 + i);
+    __m256 y0_v = _mm256_loadu_ps(y0 + i);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y1 + i), y0_v);
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), x0_v);
+    __m256 step = _mm256_sub_ps(_mm256_loadu_ps(x1 + i), x0_v);
+
+    _mm256_storeu_ps(y + i, _mm256_add_ps(y0_v, _mm256_div_ps(_mm256_mul_ps(dy, dx), step)));
+  }
+
+  LerpScalar(n - i, x + i, x0 + i, x1 + i, y0 + i, y1 + i, y + i);
+}
+
+#endif
+
+
+LerpFunc SelectLerp()
+{
+#ifdef TPCRS_X86_DISPATCH
+  if (HasAvx2())
+    return LerpAvx2;
+#endif
+
+  return LerpScalar;
+}
+
+}
+
 
 /**
  * Reads the magnetic field map from a file and scales it according to a scale
@@ -58,97 +115,247 @@ void MagField::GetFieldValue3D(const float x[3], float B[3]) const
 }
 
 
+/**
+ * Evaluates the 2D field at a batch of points. The cells are located and the
+ * field values at their corners are gathered point by point, then the
+ * interpolation is done for all points at once.
+ */
+void MagField::ValueAt(size_t n, const double* x, const double* y, const double* z,
+                       double* Bx, double* By, double* Bz) const
+{
+  const FieldMap& map = *map_2d_;
+
+  // Scale maps to work in kGauss, cm
+  float fscale = 0.001 * scale_factor_;
+
+  // Points and cell nodes along r and z, and the field components at the
+  // corners indexed by [z node][r node][component]
+  double r[kBatchSize];
+  float r_[kBatchSize], z_[kBatchSize];
+  float r0[kBatchSize], r1[kBatchSize], z0[kBatchSize], z1[kBatchSize];
+  float corner[2][2][2][kBatchSize];
+  float save[2][2][kBatchSize];
+  float value[2][kBatchSize];
+  LerpFunc lerp = SelectLerp();
+
+  for (size_t first = 0; first < n; first += kBatchSize) {
+    int m = std::min<size_t>(kBatchSize, n - first);
+
+    for (int i = 0; i < m; i++)
+      r[i] = std::sqrt(x[first + i]*x[first + i] + y[first + i]*y[first + i]);
+
+    for (int i = 0; i < m; i++) {
+      r_[i] = r[i];
+      z_[i] = z[first + i];
+
+      int jlow = map.z_axis().FindCell(z_[i]);
+      int klow = map.r_axis().FindCell(r_[i]);
+
+      r0[i] = map.r()[klow];
+      r1[i] = map.r()[klow + 1];
+      z0[i] = map.z()[jlow];
+      z1[i] = map.z()[jlow + 1];
+
+      for (int j = 0; j < 2; j++) {
+        for (int k = 0; k < 2; k++) {
+          const float* B = map.B(0, jlow + j, klow + k);
+          corner[j][k][0][i] = B[0];
+          corner[j][k][1][i] = B[1];
+        }
+      }
+    }
+
+    for (int j = 0; j < 2; j++)
+      for (int c = 0; c < 2; c++)
+        lerp(m, r_, r0, r1, corner[j][0][c], corner[j][1][c], save[c][j]);
+
+    for (int c = 0; c < 2; c++)
+      lerp(m, z_, z0, z1, save[c][0], save[c][1], value[c]);
+
+    for (int i = 0; i < m; i++) {
+      size_t p = first + i;
+
+      Bx[p] = By[p] = Bz[p] = 0;
+
+      // within map
+      if (z[p] >= map.z()[0] && z[p] <= map.z()[map.n_z() - 1] && r[i] <= map.r()[map.n_r() - 1])
+      {
+        double Br_value = fscale * value[0][i];
+        double Bz_value = fscale * value[1][i];
+
+        if (r[i] != 0) {
+          Bx[p] = Br_value * (x[p] / r[i]) ;
+          By[p] = Br_value * (y[p] / r[i]) ;
+        }
+
+        Bz[p] = Bz_value;
+      }
+    }
+  }
+}
+
+
+/**
+ * B field in Cartesian coordinates - 3D field at a batch of points
+ */
+void MagField::GetFieldValue3D(size_t n, const float* x, const float* y, const float* z,
+                               float* Bx, float* By, float* Bz) const
+{
+  const FieldMap& map = *map_3d_;
+
+  // Scale maps to work in kGauss, cm
+  float fscale = 0.001 * scale_factor_;
+
+  // A 2D map does not depend on phi
+  bool has_phi = map.n_phi() > 1;
+  int n_phi_nodes = has_phi ? 2 : 1;
+
+  // Points and cell nodes along r, z, and phi, and the field components at the
+  // corners indexed by [phi node][z node][r node][component]
+  float r_[kBatchSize], z_[kBatchSize], phi_[kBatchSize];
+  float r0[kBatchSize], r1[kBatchSize], z0[kBatchSize], z1[kBatchSize], phi0[kBatchSize], phi1[kBatchSize];
+  float corner[2][2][2][3][kBatchSize];
+  float save[2][2][3][kBatchSize];
+  float saved[2][3][kBatchSize];
+  float value[3][kBatchSize];
+  LerpFunc lerp = SelectLerp();
+
+  for (size_t first = 0; first < n; first += kBatchSize) {
+    int m = std::min<size_t>(kBatchSize, n - first);
+
+    for (int i = 0; i < m; i++) {
+      size_t p = first + i;
+      float r = std::sqrt(x[p] * x[p] + y[p] * y[p]);
+      float phi = 0;
+
+      if ( r != 0.0 ) {
+        phi = std::atan2( y[p], x[p] );
+
+        if (phi < 0) phi += 2 * M_PI;           // Table uses phi from 0 to 2*Pi
+      }
+
+      r_[i] = r;
+      z_[i] = z[p];
+      phi_[i] = phi;
+
+      int ilow = has_phi ? map.phi_axis().FindCell(phi) : 0;
+      int jlow = map.z_axis().FindCell(z_[i]);
+      int klow = map.r_axis().FindCell(r);
+
+      r0[i] = map.r()[klow];
+      r1[i] = map.r()[klow + 1];
+      z0[i] = map.z()[jlow];
+      z1[i] = map.z()[jlow + 1];
+      phi0[i] = has_phi ? map.phi()[ilow] : 0;
+      phi1[i] = has_phi ? map.phi()[ilow + 1] : 0;
+
+      for (int l = 0; l < n_phi_nodes; l++) {
+        for (int j = 0; j < 2; j++) {
+          for (int k = 0; k < 2; k++) {
+            const float* B = map.B(ilow + l, jlow + j, klow + k);
+            corner[l][j][k][0][i] = B[0];
+            corner[l][j][k][1][i] = B[1];
+            corner[l][j][k][2][i] = has_phi ? B[2] : 0;
+          }
+        }
+      }
+    }
+
+    for (int l = 0; l < n_phi_nodes; l++) {
+      for (int j = 0; j < 2; j++)
+        for (int c = 0; c < 3; c++)
+          lerp(m, r_, r0, r1, corner[l][j][0][c], corner[l][j][1][c], save[l][j][c]);
+
+      for (int c = 0; c < 3; c++)
+        lerp(m, z_, z0, z1, save[l][0][c], save[l][1][c], saved[l][c]);
+    }
+
+    for (int c = 0; c < 3; c++) {
+      if (has_phi)
+        lerp(m, phi_, phi0, phi1, saved[0][c], saved[1][c], value[c]);
+      else
+        std::copy(saved[0][c], saved[0][c] + m, value[c]);
+    }
+
+    for (int i = 0; i < m; i++) {
+      size_t p = first + i;
+      float r = r_[i];
+      float Br_value   = fscale * value[0][i];
+      float Bz_value   = fscale * value[1][i];
+      float Bphi_value = fscale * value[2][i];
+
+      if ( r != 0.0 ) {
+        Bx[p] = Br_value * (x[p] / r) - Bphi_value * (y[p] / r);
+        By[p] = Br_value * (y[p] / r) + Bphi_value * (x[p] / r);
+        Bz[p] = Bz_value;
+      }
+      else {
+        Bx[p] = Br_value;
+        By[p] = Bphi_value;
+        Bz[p] = Bz_value;
+      }
+    }
+  }
+}
+
+
 /**
  * Read the electric and magnetic field maps stored on disk
  */
 void MagField::ReadField()
 {
-  FILE*    magfile, *b3Dfile ;
   std::string filename, filename3D ;
 
   if ( field_type_ == MagFieldType::kMapped ) {                  	// Mapped field values
     if ( scale_factor_ > 0 ) {
-      filename   = "bfield_full_positive_2D.dat" ;
-      filename3D = "bfield_full_positive_3D.dat" ;
+      filename   = "bfield_full_positive_2D" ;
+      filename3D = "bfield_full_positive_3D" ;
     }
     else {
-      filename   = "bfield_full_negative_2D.dat" ;
-      filename3D = "bfield_full_negative_3D.dat" ;
+      filename   = "bfield_full_negative_2D" ;
+      filename3D = "bfield_full_negative_3D" ;
       // The values read from file already reflect the sign
       scale_factor_ = std::abs(scale_factor_);
     }
   }
   else if ( field_type_ == MagFieldType::kConstant ) {           // Constant field values
-    filename = "const_full_positive_2D.dat" ;
+    filename = "const_full_positive_2D" ;
   }
 
-  std::string MapLocation = cfg_.Locate(filename);
-  magfile = fopen(MapLocation.c_str(), "r") ;
+  map_2d_ = LoadMap(filename);
+  map_3d_ = field_type_ == MagFieldType::kConstant ? map_2d_ : LoadMap(filename3D);
+}
 
-  if (magfile)
-  {
-    char cname[128] ;
-    fgets(cname, sizeof(cname), magfile);    // Read comment lines at begining of file
-    fgets(cname, sizeof(cname), magfile);
-    fgets(cname, sizeof(cname), magfile);
-    fgets(cname, sizeof(cname), magfile);
-    fgets(cname, sizeof(cname), magfile);
-
-    for ( int j = 0 ; j < nZ ; j++ ) {
-      for ( int k = 0 ; k < nR ; k++ ) {
-        fgets  ( cname, sizeof(cname), magfile ) ;
-        sscanf ( cname, " %f %f %f %f ", &Radius[k], &ZList[j], &Br[j][k], &Bz[j][k] ) ;
-      }
-    }
-  } else {
-    LOG_ERROR << "MagField: File " << MapLocation << " not found\n";
+
+std::shared_ptr<const FieldMap> MagField::LoadMap(const std::string& name) const
+{
+  std::string bin_path = cfg_.Locate(name + ".bin");
+  std::string dat_path = cfg_.Locate(name + ".dat");
+
+  if (bin_path.empty() && dat_path.empty()) {
+    LOG_ERROR << "MagField: Neither " << name << ".bin nor " << name << ".dat found\n";
     exit(1);
   }
 
-  fclose(magfile) ;
+  std::shared_ptr<const FieldMap> map;
 
-  MapLocation = cfg_.Locate(filename3D);
-  b3Dfile = fopen(MapLocation.c_str(), "r") ;
+  if (!bin_path.empty()) {
+    map = FieldMap::Get(bin_path);
 
-  if (b3Dfile)
-  {
-    char cname[128] ;
-    // Read comment lines at begining of file
-    fgets  ( cname, sizeof(cname), b3Dfile ) ;
-    fgets  ( cname, sizeof(cname), b3Dfile ) ;
-    fgets  ( cname, sizeof(cname), b3Dfile ) ;
-    fgets  ( cname, sizeof(cname), b3Dfile ) ;
-    fgets  ( cname, sizeof(cname), b3Dfile ) ;
-    fgets  ( cname, sizeof(cname), b3Dfile ) ;
-
-    for ( int i = 0 ; i < nPhi ; i++ ) {
-      for ( int j = 0 ; j < nZ ; j++ ) {
-        for ( int k = 0 ; k < nR ; k++ ) {
-          fgets  ( cname, sizeof(cname), b3Dfile ) ;
-          sscanf ( cname, " %f %f %f %f %f %f ",
-                   &R3D[k], &Z3D[j], &Phi3D[i], &Br3D[i][j][k], &Bz3D[i][j][k], &Bphi3D[i][j][k] ) ;
-          Phi3D[i] *= M_PI / 180. ;   // Convert to Radians  phi = 0 to 2*Pi
-        }
-      }
-    }
+    // The reason is reported by FieldMap
+    if (!map && !dat_path.empty())
+      LOG_WARN << "MagField: Cannot use binary map " << bin_path << ". Reading " << dat_path << " instead\n";
   }
-  else if ( field_type_ == MagFieldType::kConstant )             // Constant field values
-  {
-    for ( int i = 0 ; i < nPhi ; i++ ) {
-      for ( int j = 0 ; j < nZ ; j++ ) {
-        for ( int k = 0 ; k < nR ; k++ ) {
-          Br3D[i][j][k] = Br[j][k] ;
-          Bz3D[i][j][k] = Bz[j][k] ;
-          Bphi3D[i][j][k] = 0 ;
-        }
-      }
-    }
-  } else {
-    LOG_ERROR << "MagField: File " << MapLocation << " not found\n";
+
+  if (!map && !dat_path.empty())
+    map = FieldMap::Get(dat_path);
+
+  if (!map) {
+    LOG_ERROR << "MagField: Cannot read field map " << (dat_path.empty() ? bin_path : dat_path) << '\n';
     exit(1);
   }
 
-  fclose(b3Dfile) ;
+  return map;
 }
 
 
@@ -160,27 +367,24 @@ void MagField::InterpolateField2D(double r, double z, double &Br_value, double &
   // Scale maps to work in kGauss, cm
   float fscale = 0.001 * scale_factor_;
 
+  const FieldMap& map = *map_2d_;
+
   const  int ORDER = 1; // Linear interpolation = 1, Quadratic = 2
-  static int jlow = 0, klow = 0 ;
   float save_Br[ORDER + 1];
   float save_Bz[ORDER + 1];
 
-  Search(nZ, ZList,  float(z), jlow);
-  Search(nR, Radius, float(r), klow);
-
-  if (jlow < 0) jlow = 0;
-  if (klow < 0) klow = 0;
-
-  if (jlow + ORDER >= nZ - 1) jlow = nZ - 1 - ORDER;
-  if (klow + ORDER >= nR - 1) klow = nR - 1 - ORDER;
+  int jlow = map.z_axis().FindCell(float(z));
+  int klow = map.r_axis().FindCell(float(r));
 
   for (int j = jlow; j < jlow + ORDER + 1; j++) {
-    save_Br[j - jlow] = Interpolate( &Radius[klow], &Br[j][klow], ORDER, r )   ;
-    save_Bz[j - jlow] = Interpolate( &Radius[klow], &Bz[j][klow], ORDER, r )   ;
+    const float* B0 = map.B(0, j, klow);
+    const float* B1 = map.B(0, j, klow + 1);
+    save_Br[j - jlow] = Interpolate( &map.r()[klow], B0[0], B1[0], r )   ;
+    save_Bz[j - jlow] = Interpolate( &map.r()[klow], B0[1], B1[1], r )   ;
   }
 
-  Br_value = fscale * Interpolate( &ZList[jlow], save_Br, ORDER, z )   ;
-  Bz_value = fscale * Interpolate( &ZList[jlow], save_Bz, ORDER, z )   ;
+  Br_value = fscale * Interpolate( &map.z()[jlow], save_Br, ORDER, z )   ;
+  Bz_value = fscale * Interpolate( &map.z()[jlow], save_Bz, ORDER, z )   ;
 }
 
 
@@ -193,41 +397,47 @@ void MagField::InterpolateField3D(float r, float z, float phi,
   // Scale maps to work in kGauss, cm
   float fscale = 0.001 * scale_factor_;
 
+  const FieldMap& map = *map_3d_;
+
   const   int ORDER = 1 ;                       // Linear interpolation = 1, Quadratic = 2
-  static  int ilow = 0, jlow = 0, klow = 0 ;
   float save_Br[ORDER + 1],   saved_Br[ORDER + 1] ;
   float save_Bz[ORDER + 1],   saved_Bz[ORDER + 1] ;
   float save_Bphi[ORDER + 1], saved_Bphi[ORDER + 1] ;
 
   if (r < 0) return;
 
-  Search(nPhi, Phi3D, phi, ilow);
-  Search(nZ,   Z3D,   z,   jlow);
-  Search(nR,   R3D,   r,   klow);
+  // A 2D map does not depend on phi
+  bool has_phi = map.n_phi() > 1;
+  int n_phi_nodes = has_phi ? ORDER + 1 : 1;
 
-  if ( ilow < 0 ) ilow = 0 ;
-  if ( jlow < 0 ) jlow = 0 ;
-  if ( klow < 0 ) klow = 0 ;
+  int ilow = has_phi ? map.phi_axis().FindCell(phi) : 0;
+  int jlow = map.z_axis().FindCell(z);
+  int klow = map.r_axis().FindCell(r);
 
-  if ( ilow + ORDER  >=  nPhi - 1 ) ilow = nPhi - 1 - ORDER ;
-  if ( jlow + ORDER  >=    nZ - 1 ) jlow =   nZ - 1 - ORDER ;
-  if ( klow + ORDER  >=    nR - 1 ) klow =   nR - 1 - ORDER ;
-
-  for ( int i = ilow ; i < ilow + ORDER + 1 ; i++ ) {
+  for ( int i = ilow ; i < ilow + n_phi_nodes ; i++ ) {
     for ( int j = jlow ; j < jlow + ORDER + 1 ; j++ ) {
-      save_Br[j - jlow]   = Interpolate( &R3D[klow], &Br3D[i][j][klow], ORDER, r )   ;
-      save_Bz[j - jlow]   = Interpolate( &R3D[klow], &Bz3D[i][j][klow], ORDER, r )   ;
-      save_Bphi[j - jlow] = Interpolate( &R3D[klow], &Bphi3D[i][j][klow], ORDER, r ) ;
+      const float* B0 = map.B(i, j, klow);
+      const float* B1 = map.B(i, j, klow + 1);
+      save_Br[j - jlow]   = Interpolate( &map.r()[klow], B0[0], B1[0], r )   ;
+      save_Bz[j - jlow]   = Interpolate( &map.r()[klow], B0[1], B1[1], r )   ;
+      save_Bphi[j - jlow] = has_phi ? Interpolate( &map.r()[klow], B0[2], B1[2], r ) : 0 ;
     }
 
-    saved_Br[i - ilow]   = Interpolate( &Z3D[jlow], save_Br, ORDER, z )   ;
-    saved_Bz[i - ilow]   = Interpolate( &Z3D[jlow], save_Bz, ORDER, z )   ;
-    saved_Bphi[i - ilow] = Interpolate( &Z3D[jlow], save_Bphi, ORDER, z ) ;
+    saved_Br[i - ilow]   = Interpolate( &map.z()[jlow], save_Br, ORDER, z )   ;
+    saved_Bz[i - ilow]   = Interpolate( &map.z()[jlow], save_Bz, ORDER, z )   ;
+    saved_Bphi[i - ilow] = Interpolate( &map.z()[jlow], save_Bphi, ORDER, z ) ;
+  }
+
+  if (!has_phi) {
+    Br_value   = fscale * saved_Br[0] ;
+    Bz_value   = fscale * saved_Bz[0] ;
+    Bphi_value = fscale * saved_Bphi[0] ;
+    return;
   }
 
-  Br_value   = fscale * Interpolate( &Phi3D[ilow], saved_Br, ORDER, phi )   ;
-  Bz_value   = fscale * Interpolate( &Phi3D[ilow], saved_Bz, ORDER, phi )   ;
-  Bphi_value = fscale * Interpolate( &Phi3D[ilow], saved_Bphi, ORDER, phi ) ;
+  Br_value   = fscale * Interpolate( &map.phi()[ilow], saved_Br, ORDER, phi )   ;
+  Bz_value   = fscale * Interpolate( &map.phi()[ilow], saved_Bz, ORDER, phi )   ;
+  Bphi_value = fscale * Interpolate( &map.phi()[ilow], saved_Bphi, ORDER, phi ) ;
 }
 
 
@@ -253,6 +463,15 @@ float MagField::Interpolate(const float Xarray[], const float Yarray[], int orde
 }
 
 
+/**
+ * Linear interpolation between two nodes
+ */
+float MagField::Interpolate(const float Xarray[], float y0, float y1, const float x)
+{
+  return y0 + ( y1 - y0 ) * ( x - Xarray[0] ) / ( Xarray[1] - Xarray[0] ) ;
+}
+
+
 /**
  * Search an ordered table by starting at the most recently used point
  */
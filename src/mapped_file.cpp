@@ -0,0 +1,39 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tpcrs/detail/mapped_file.h"
+
+
+namespace tpcrs { namespace detail {
+
+MappedFile::MappedFile(const std::string& path) :
+  data_(nullptr),
+  size_(0)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0) return;
+
+  struct stat st;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data_ = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data_ == MAP_FAILED)
+      data_ = nullptr;
+    else
+      size_ = st.st_size;
+  }
+
+  close(fd);
+}
+
+
+MappedFile::~MappedFile()
+{
+  if (data_) munmap(data_, size_);
+}
+
+} }
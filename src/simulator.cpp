@@ -1,13 +1,18 @@
 #include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <limits>
 #include <numeric>
 #include <vector>
 
+#include <sys/stat.h>
+
 #include "tpcrs/detail/simulator.h"
 
 #include "Math/SpecFuncMathMore.h"
+#include "RVersion.h"
 #include "TFile.h"
-#include "tcl.h"
+#include "TRandom3.h"
 
 #include "particles/StParticleTable.hh"
 #include "particles/StParticleDefinition.hh"
@@ -20,6 +25,90 @@
 
 namespace tpcrs { namespace detail {
 
+namespace {
+
+/**
+ * Samples a ROOT function with the given generator. Prior to ROOT 6.24 only
+ * the global gRandom can be used.
+ */
+template<typename Distribution>
+double GetRandom(const Distribution& dist, TRandom& random)
+{
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,24,0)
+  return const_cast<Distribution&>(dist).GetRandom(&random);
+#else
+  return const_cast<Distribution&>(dist).GetRandom();
+#endif
+}
+
+
+/**
+ * Creates the distorter for cfg. If prev is not null, its static distortions
+ * and table are reused unless cfg changes the structs they depend on.
+ */
+Distorter* CreateDistorter(const tpcrs::Configurator& cfg, const Simulator::Options& options, const Distorter* prev = nullptr)
+{
+  Distorter* distorter = prev ? new Distorter(cfg, *prev) : new Distorter(cfg, options.distortions);
+
+  if (options.distortion_table_step > 0 && !distorter->tabulated()) {
+    MagField mag_field(cfg);
+    distorter->Tabulate(mag_field, options.distortion_table_step);
+
+    Distorter::TableAccuracy accuracy = distorter->CheckTable(mag_field);
+    LOG_INFO << "Distortion table with " << options.distortion_table_step << " cm step deviates from direct computation by "
+             << accuracy.rms << " cm (RMS), " << accuracy.max << " cm (max) at " << accuracy.n_points << " points\n";
+  }
+
+  return distorter;
+}
+
+}
+
+
+Simulator::Context::Context(uint64_t seed, Generator generator) :
+  seed_(seed),
+  generator_(generator),
+  engine_(),
+  random_(),
+  philox_(),
+  binned_charge_()
+{
+  if (generator_ == Generator::kCounterBased) {
+    philox_ = new Philox(seed);
+    engine_.reset(philox_);
+    random_ = philox_;
+    return;
+  }
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,24,0)
+  engine_.reset(new TRandom3(seed));
+  random_ = engine_.get();
+#else
+  random_ = gRandom;
+#endif
+
+  random_->SetSeed(seed);
+}
+
+
+void Simulator::Context::SetSeed(uint64_t seed)
+{
+  seed_ = seed;
+
+  if (philox_)
+    philox_->SetKey(seed);
+  else
+    random_->SetSeed(seed);
+}
+
+
+void Simulator::Context::SetStream(unsigned int sector, int track_id, unsigned int segment)
+{
+  if (philox_)
+    philox_->SetStream(sector, track_id, segment);
+}
+
+
 TF1 Simulator::fgTimeShape3[2] = {
   TF1F("TimeShape3Inner;Time [s];Signal", Simulator::shapeEI3, 0, 1, 7),
   TF1F("TimeShape3Outer;Time [s];Signal", Simulator::shapeEI3, 0, 1, 7)
@@ -31,14 +120,19 @@ TF1 Simulator::fgTimeShape0[2] = {
 };
 
 
-Simulator::Simulator(const tpcrs::Configurator& cfg) :
-  cfg_(cfg),
-  transform_(cfg_),
-  digi_(cfg_),
+Simulator::Simulator(const tpcrs::Configurator& cfg, const Options& options) :
+  cfg_(&cfg),
+  geom_(std::make_shared<const DerivedGeometry>(cfg)),
+  transform_(new CoordTransform(cfg, geom_)),
+  digi_(cfg),
+  distorter_(CreateDistorter(cfg, options)),
+  digitizer_(new Digitizer(cfg, digi_)),
+  dEdx_correction_(new StTpcdEdxCorrection(cfg)),
   dEdx_model_(dEdxModel::kBichsel),
   dNdx_(),
   dNdx_log10_(),
   dNdE_log10_(),
+  dNdE_log10_alias_(),
   mShaperResponses{
     std::vector<TF1F>(digi_.n_sectors, TF1F("ShaperFuncInner;Time [bin];Signal", Simulator::shapeEI_I, 0, 1, 7)),
     std::vector<TF1F>(digi_.n_sectors, TF1F("ShaperFuncOuter;Time [bin];Signal", Simulator::shapeEI_I, 0, 1, 7))
@@ -49,26 +143,148 @@ Simulator::Simulator(const tpcrs::Configurator& cfg) :
     TF1F("PolyaInner;x = G/G_0;signal", polya, 0, 10, 3),
     TF1F("PolyaOuter;x = G/G_0;signal", polya, 0, 10, 3)
   },
-  mHeed("Ec", Simulator::Ec, 0, 3.064 * cfg_.S<TpcResponseSimulator>().W, 1),
-  alpha_gain_variations_()
+  mHeed("Ec", Simulator::Ec, 0, 3.064 * cfg_->S<TpcResponseSimulator>().W, 1),
+  alpha_gain_variations_(),
+  table_cache_(),
+  n_calls_(0),
+  serial_fallback_reported_(false),
+  options_(options)
+{
+  SetupResponseTables();
+  InitGainSamplers();
+
+  // Create the particle table before it is accessed from const methods
+  StParticleTable::instance();
+}
+
+
+Simulator::~Simulator() = default;
+
+
+void Simulator::Update(const tpcrs::Configurator& cfg)
+{
+  // The response functions are allocated for every sector at construction
+  if (cfg.S<tpcDimensions>().numberOfSectors != digi_.n_sectors)
+    throw std::runtime_error("Simulator: Cannot update to a different number of sectors");
+
+  const tpcrs::Configurator& prev = *cfg_;
+  cfg_ = &cfg;
+
+  if (!cfg.Same<tpcDimensions, tpcPadPlanes, tpcDriftVelocity, tpcPadrowT0, tpcSectorT0offset, tpcAnodeHVavg,
+                St_TpcAvgPowerSupplyC, St_tpcGainCorrectionC>(prev))
+    geom_ = std::make_shared<const DerivedGeometry>(cfg);
+
+  transform_.reset(new CoordTransform(cfg, geom_, *transform_));
+
+  if (!cfg.Same<tpcDimensions, tpcPadPlanes, tpcElectronics>(prev))
+    digi_ = DigiChannelMap(cfg);
+
+  distorter_.reset(CreateDistorter(cfg, options_, distorter_.get()));
+  digitizer_.reset(new Digitizer(cfg, digi_));
+  dEdx_correction_.reset(new StTpcdEdxCorrection(cfg));
+
+  // The structs in ResponseTablesKey()
+  bool same_pads = cfg.Same<tpcDimensions, tpcPadPlanes, tpcWirePlanes, TpcResponseSimulator>(prev);
+  bool same_shapers = same_pads && cfg.Same<starClockOnl, tpcAltroParams, tpcAnodeHVavg, St_TpcAvgPowerSupplyC>(prev);
+
+  // The dE/dx model tables do not depend on the configuration. They are kept
+  // even when restored from the cache, and only the derived tables are rebuilt
+  if (!same_shapers) {
+    if (!same_pads) InitPadResponses();
+    InitShaperResponses();
+  }
+
+  if (!cfg.Same<TpcResponseSimulator>(prev))
+    InitGainSamplers();
+}
+
+
+void Simulator::SetupResponseTables()
+{
+  if (options_.cache_dir.empty()) {
+    InitResponseTables();
+  }
+  else {
+    uint64_t key = ResponseTablesKey();
+    char name[32];
+    std::snprintf(name, sizeof(name), "/tpcrs_tables_%016llx.bin", static_cast<unsigned long long>(key));
+    std::string path = options_.cache_dir + name;
+
+    if (!LoadResponseTables(path, key)) {
+      InitResponseTables();
+      SaveResponseTables(path, key);
+    }
+  }
+
+  dNdE_log10_alias_ = AliasTable(dNdE_log10_);
+}
+
+
+void Simulator::InitGainSamplers()
+{
+  //  mPolya = new TF1F("Polya;x = G/G_0;signal","sqrt(x)/exp(1.5*x)",0,10); // original Polya
+  //  mPolya = new TF1F("Polya;x = G/G_0;signal","pow(x,0.38)*exp(-1.38*x)",0,10); //  Valeri Cherniatin
+  //   mPoly = new TH1D("Poly","polyaAvalanche",100,0,10);
+  //if (gamma <= 0) gamma = 1.38;
+  double gamma_inn = cfg_->S<TpcResponseSimulator>().PolyaInner;
+  double gamma_out = cfg_->S<TpcResponseSimulator>().PolyaOuter;
+  mPolya[kInner].SetParameters(gamma_inn, 0., 1. / gamma_inn);
+  mPolya[kOuter].SetParameters(gamma_out, 0., 1. / gamma_out);
+
+  // HEED function to generate Ec, default w = 26.2
+  mHeed.SetRange(0, 3.064 * cfg_->S<TpcResponseSimulator>().W);
+  mHeed.SetParameter(0, cfg_->S<TpcResponseSimulator>().W);
+
+  // The Polya functions are defined on [0, 10]
+  polya_samplers_[kInner] = GammaSampler(gamma_inn, 1. / gamma_inn, 10);
+  polya_samplers_[kOuter] = GammaSampler(gamma_out, 1. / gamma_out, 10);
+  ec_sampler_ = EcSampler(cfg_->S<TpcResponseSimulator>().W);
+
+  // ROOT builds the integrals used by GetRandom() on the first call. Do it now
+  // so that later calls from concurrent threads only read them
+  mPolya[kInner].GetRandom();
+  mPolya[kOuter].GetRandom();
+  mHeed.GetRandom();
+}
+
+
+void Simulator::InitResponseTables()
 {
   if (dEdx_model_ == dEdxModel::kBichsel) {
-    TFile model_file(cfg_.Locate("dNdE_Bichsel.root").c_str());
-    dNdE_log10_ = *static_cast<TH1D*>(model_file.Get("dNdEL10"));
+    TFile model_file(cfg_->Locate("dNdE_Bichsel.root").c_str());
+    dNdE_log10_ = BinnedTable(*static_cast<TH1D*>(model_file.Get("dNdEL10")));
 
-    TFile model_file_2(cfg_.Locate("dNdx_Bichsel.root").c_str());
-    dNdx_ = *static_cast<TH1D*>(model_file_2.Get("dNdx"));
+    TFile model_file_2(cfg_->Locate("dNdx_Bichsel.root").c_str());
+    dNdx_ = BinnedTable(*static_cast<TH1D*>(model_file_2.Get("dNdx")));
   }
   else if (dEdx_model_ == dEdxModel::kHeed) {
-    TFile model_file(cfg_.Locate("dNdx_Heed.root").c_str());
-    dNdE_log10_ = *static_cast<TH1D*>(model_file.Get("dNdEL10"));
-    dNdx_log10_ = *static_cast<TH1D*>(model_file.Get("dNdxL10"));
+    TFile model_file(cfg_->Locate("dNdx_Heed.root").c_str());
+    dNdE_log10_ = BinnedTable(*static_cast<TH1D*>(model_file.Get("dNdEL10")));
+    dNdx_log10_ = BinnedTable(*static_cast<TH1D*>(model_file.Get("dNdxL10")));
   } // else ... need to throw an exception
 
+  InitPadResponses();
+  InitShaperResponses();
+}
+
+
+void Simulator::InitPadResponses()
+{
+  for (int io = 0; io < 2; io++) {
+    for (int sector = 1; sector <= digi_.n_sectors; sector++) {
+      InitPadResponseFuncs(io, sector);
+      InitChargeFractionFuncs(io, sector);
+    }
+  }
+}
+
+
+void Simulator::InitShaperResponses()
+{
   double t0IO[2];
   InitAlphaGainVariations(t0IO);
 
-  double timebin_width = 1. / cfg_.S<starClockOnl>().frequency;
+  double timebin_width = 1. / cfg_->S<starClockOnl>().frequency;
 
   // Shapers
   double timebin_min = -0.5;
@@ -77,9 +293,9 @@ Simulator::Simulator(const tpcrs::Configurator& cfg) :
   for (int io = 0; io < 2; io++) {// In/Out
     FuncParams_t params3{
       {"t0",    t0IO[io]},
-      {"tauF",  cfg_.S<TpcResponseSimulator>().tauF},
-      {"tauP",  cfg_.S<TpcResponseSimulator>().tauP},
-      {"tauI",  cfg_.S<TpcResponseSimulator>().tauIntegration},
+      {"tauF",  cfg_->S<TpcResponseSimulator>().tauF},
+      {"tauP",  cfg_->S<TpcResponseSimulator>().tauP},
+      {"tauI",  cfg_->S<TpcResponseSimulator>().tauIntegration},
       {"width", timebin_width},
       {"tauC",  0},
       {"io",    io}
@@ -98,9 +314,9 @@ Simulator::Simulator(const tpcrs::Configurator& cfg) :
       {"t0",    t0IO[io]},
       {"tauF",  0},
       {"tauP",  0},
-      {"tauI",  io ? cfg_.S<TpcResponseSimulator>().tauXO : cfg_.S<TpcResponseSimulator>().tauXI},
+      {"tauI",  io ? cfg_->S<TpcResponseSimulator>().tauXO : cfg_->S<TpcResponseSimulator>().tauXI},
       {"width", timebin_width},
-      {"tauC",  io ? cfg_.S<TpcResponseSimulator>().tauCO : cfg_.S<TpcResponseSimulator>().tauCI},
+      {"tauC",  io ? cfg_->S<TpcResponseSimulator>().tauCO : cfg_->S<TpcResponseSimulator>().tauCI},
       {"io",    io}
     };
 
@@ -113,9 +329,6 @@ Simulator::Simulator(const tpcrs::Configurator& cfg) :
 
     for (int sector = 1; sector <= digi_.n_sectors; sector++)
     {
-      InitPadResponseFuncs(io, sector);
-      InitChargeFractionFuncs(io, sector);
-
       //  TF1F *func = new TF1F("funcP","x*sqrt(x)/exp(2.5*x)",0,10);
       // see http://www4.rcf.bnl.gov/~lebedev/tec/polya.html
       // Gain fluctuation in proportional counters follows Polya distribution.
@@ -125,25 +338,109 @@ Simulator::Simulator(const tpcrs::Configurator& cfg) :
       // Valeri Cherniatin (cherniat@bnlarm.bnl.gov) recomends m=1.38
       // Trs uses x**1.5/exp(x)
       // tss used x**0.5/exp(1.5*x)
-      if (cfg_.S<tpcAltroParams>(sector - 1).N < 0) { // old TPC
+      if (cfg_->S<tpcAltroParams>(sector - 1).N < 0) { // old TPC
         InitShaperFuncs(io, sector, mShaperResponses, Simulator::shapeEI3_I, params3, timebin_min, timebin_max);
       } else {//Altro
         InitShaperFuncs(io, sector, mShaperResponses, Simulator::shapeEI_I,  params0, timebin_min, timebin_max);
       }
     }
   }
+}
 
-  //  mPolya = new TF1F("Polya;x = G/G_0;signal","sqrt(x)/exp(1.5*x)",0,10); // original Polya
-  //  mPolya = new TF1F("Polya;x = G/G_0;signal","pow(x,0.38)*exp(-1.38*x)",0,10); //  Valeri Cherniatin
-  //   mPoly = new TH1D("Poly","polyaAvalanche",100,0,10);
-  //if (gamma <= 0) gamma = 1.38;
-  double gamma_inn = cfg_.S<TpcResponseSimulator>().PolyaInner;
-  double gamma_out = cfg_.S<TpcResponseSimulator>().PolyaOuter;
-  mPolya[kInner].SetParameters(gamma_inn, 0., 1. / gamma_inn);
-  mPolya[kOuter].SetParameters(gamma_out, 0., 1. / gamma_out);
 
-  // HEED function to generate Ec, default w = 26.2
-  mHeed.SetParameter(0, cfg_.S<TpcResponseSimulator>().W);
+uint64_t Simulator::ResponseTablesKey() const
+{
+  const std::string names[] = {
+    ConfigNodeName<TpcResponseSimulator>(),
+    ConfigNodeName<tpcPadPlanes>(),
+    ConfigNodeName<tpcWirePlanes>(),
+    ConfigNodeName<tpcDimensions>(),
+    ConfigNodeName<starClockOnl>(),
+    ConfigNodeName<tpcAltroParams>(),
+    ConfigNodeName<tpcAnodeHVavg>(),
+    St_TpcAvgPowerSupplyC::name
+  };
+
+  uint64_t key = TableCache::Hash(&dEdx_model_, sizeof(dEdx_model_));
+
+  for (const std::string& name : names) {
+    std::string node = cfg_->Serialized(name);
+    key = TableCache::Hash(name, key);
+    if (!node.empty()) key = TableCache::Hash(node, key);
+  }
+
+  // The model files are identified by their location, size, and modification
+  // time
+  for (const char* file : {"dNdE_Bichsel.root", "dNdx_Bichsel.root", "dNdx_Heed.root"}) {
+    std::string path = cfg_->Locate(file);
+    struct stat st;
+    key = TableCache::Hash(path, key);
+
+    if (stat(path.c_str(), &st) == 0) {
+      int64_t id[2] = {static_cast<int64_t>(st.st_size), static_cast<int64_t>(st.st_mtime)};
+      key = TableCache::Hash(id, sizeof(id), key);
+    }
+  }
+
+  return key;
+}
+
+
+bool Simulator::LoadResponseTables(const std::string& path, uint64_t key)
+{
+  std::unique_ptr<TableCache> cache(new TableCache(path, key));
+
+  if (!cache->valid()) return false;
+
+  // The functions refer to the saved values in the mapped file
+  auto restore = [&cache](TF1F& func) {
+    const double* range = cache->Read(4);
+    if (!range) return false;
+
+    // The number of saved values follows from the saved range
+    func.SetRange(range[0], range[1]);
+    func.SetSaveData(range[2], range[3], nullptr);
+
+    const double* values = cache->Read(func.GetSaveSize());
+    func.SetSaveData(range[2], range[3], values);
+
+    return values != nullptr;
+  };
+
+  for (auto funcs : {&mShaperResponses[kInner], &mShaperResponses[kOuter], &mChargeFraction, &mPadResponseFunction})
+    for (TF1F& func : *funcs)
+      if (!restore(func)) return false;
+
+  const double* alphas = cache->Read(digi_.n_sectors*2);
+
+  if (!alphas || !dNdx_.Restore(*cache) || !dNdx_log10_.Restore(*cache) || !dNdE_log10_.Restore(*cache))
+    return false;
+
+  alpha_gain_variations_.assign(alphas, alphas + digi_.n_sectors*2);
+  table_cache_ = std::move(cache);
+
+  return true;
+}
+
+
+void Simulator::SaveResponseTables(const std::string& path, uint64_t key) const
+{
+  std::vector<double> values;
+
+  for (auto funcs : {&mShaperResponses[kInner], &mShaperResponses[kOuter], &mChargeFraction, &mPadResponseFunction}) {
+    for (const TF1F& func : *funcs) {
+      values.insert(values.end(), {func.GetXmin(), func.GetXmax(), func.GetSaveXmin(), func.GetSaveXmax()});
+      values.insert(values.end(), func.GetSaveData(), func.GetSaveData() + func.GetSaveSize());
+    }
+  }
+
+  values.insert(values.end(), alpha_gain_variations_.begin(), alpha_gain_variations_.end());
+
+  dNdx_.Store(values);
+  dNdx_log10_.Store(values);
+  dNdE_log10_.Store(values);
+
+  TableCache::Write(path, key, values);
 }
 
 
@@ -153,16 +450,16 @@ void Simulator::InitPadResponseFuncs(int io, int sector)
   //  double paramsI[6] = {0.2850, 0.2000,  0.4000, 0.0010, 1.1500, 0};
   //  double paramsO[6] = {0.6200, 0.4000,  0.4000, 0.0010, 1.1500, 0};
   double params[6]{
-    io == kInner ? cfg_.S<tpcPadPlanes>().innerSectorPadWidth :  // w = width of pad
-                   cfg_.S<tpcPadPlanes>().outerSectorPadWidth,
-    io == kInner ? cfg_.S<tpcWirePlanes>().innerSectorAnodeWirePadSep :            // h = Anode-Cathode gap
-                   cfg_.S<tpcWirePlanes>().outerSectorAnodeWirePadSep,
-    cfg_.S<tpcWirePlanes>().anodeWirePitch,                                        // s = wire spacing
-    io == kInner ? cfg_.S<TpcResponseSimulator>().K3IP :
-                   cfg_.S<TpcResponseSimulator>().K3OP,
+    io == kInner ? cfg_->S<tpcPadPlanes>().innerSectorPadWidth :  // w = width of pad
+                   cfg_->S<tpcPadPlanes>().outerSectorPadWidth,
+    io == kInner ? cfg_->S<tpcWirePlanes>().innerSectorAnodeWirePadSep :            // h = Anode-Cathode gap
+                   cfg_->S<tpcWirePlanes>().outerSectorAnodeWirePadSep,
+    cfg_->S<tpcWirePlanes>().anodeWirePitch,                                        // s = wire spacing
+    io == kInner ? cfg_->S<TpcResponseSimulator>().K3IP :
+                   cfg_->S<TpcResponseSimulator>().K3OP,
     0,
-    io == kInner ? cfg_.S<tpcPadPlanes>().innerSectorPadPitch :
-                   cfg_.S<tpcPadPlanes>().outerSectorPadPitch
+    io == kInner ? cfg_->S<tpcPadPlanes>().innerSectorPadPitch :
+                   cfg_->S<tpcPadPlanes>().outerSectorPadPitch
   };
 
   mPadResponseFunction[digi_.n_sectors*io + sector - 1].SetParameters(params);
@@ -175,26 +472,27 @@ void Simulator::InitPadResponseFuncs(int io, int sector)
 void Simulator::InitChargeFractionFuncs(int io, int sector)
 {
   double params[6]{
-    io == kInner ? cfg_.S<tpcPadPlanes>().innerSectorPadLength :  // w = length of pad
-                   cfg_.S<tpcPadPlanes>().outerSectorPadLength,
-    io == kInner ? cfg_.S<tpcWirePlanes>().innerSectorAnodeWirePadSep :            // h = Anode-Cathode gap
-                   cfg_.S<tpcWirePlanes>().outerSectorAnodeWirePadSep,
-    cfg_.S<tpcWirePlanes>().anodeWirePitch,                                        // s = wire spacing
-    io == kInner ? cfg_.S<TpcResponseSimulator>().K3IR :
-                   cfg_.S<TpcResponseSimulator>().K3OR,
+    io == kInner ? cfg_->S<tpcPadPlanes>().innerSectorPadLength :  // w = length of pad
+                   cfg_->S<tpcPadPlanes>().outerSectorPadLength,
+    io == kInner ? cfg_->S<tpcWirePlanes>().innerSectorAnodeWirePadSep :            // h = Anode-Cathode gap
+                   cfg_->S<tpcWirePlanes>().outerSectorAnodeWirePadSep,
+    cfg_->S<tpcWirePlanes>().anodeWirePitch,                                        // s = wire spacing
+    io == kInner ? cfg_->S<TpcResponseSimulator>().K3IR :
+                   cfg_->S<TpcResponseSimulator>().K3OR,
     0,
     1
   };
 
-  // Cut the tails
-  double x_range = 2.5;
-  for (; x_range > 1.5; x_range -= 0.05) {
-    double r = mChargeFraction[digi_.n_sectors*io + sector - 1].Eval(x_range) / mChargeFraction[digi_.n_sectors*io + sector - 1].Eval(0);
-    if (r > 0.01) break;
-  }
-
   mChargeFraction[digi_.n_sectors*io + sector - 1].SetParameters(params);
   mChargeFraction[digi_.n_sectors*io + sector - 1].SetParNames("PadLength", "Anode-Cathode gap", "wire spacing", "K3IR", "CrossTalk", "RowPitch");
+
+  // Cut the tails. The cut used to be searched for on the function before its
+  // parameters were set. The ratio was NaN then, so the search always ran to
+  // its last step. The reference results depend on this range, keep it for
+  // fresh and updated simulators alike
+  double x_range = 2.5;
+  while (x_range > 1.5) x_range -= 0.05;
+
   mChargeFraction[digi_.n_sectors*io + sector - 1].SetRange(-x_range, x_range);
   mChargeFraction[digi_.n_sectors*io + sector - 1].Save(-2.5, 2.5, 0, 0, 0, 0);
 }
@@ -229,22 +527,22 @@ void Simulator::InitAlphaGainVariations(double t0IO[2])
 {
   alpha_gain_variations_.resize(digi_.n_sectors*2, 0);
 
-  double anode_wire_pitch  = cfg_.S<tpcWirePlanes>().anodeWirePitch;
-  double anode_wire_radius = cfg_.S<tpcWirePlanes>().anodeWireRadius;
+  double anode_wire_pitch  = cfg_->S<tpcWirePlanes>().anodeWirePitch;
+  double anode_wire_radius = cfg_->S<tpcWirePlanes>().anodeWireRadius;
   double cathod_anode_gap[2] = {0.2, 0.4};
   std::vector<double> avg_anode_voltage(digi_.n_sectors*2, 0);
 
   for (int sector = 1; sector <= digi_.n_sectors; sector++)
   {
     int n_inner = 0, n_outer = 0;
-    for (int row = 1; row <= cfg_.S<tpcPadPlanes>().padRows; row++) {
-      if (tpcrs::IsInner(row, cfg_)) {
+    for (int row = 1; row <= geom_->n_rows(); row++) {
+      if (geom_->is_inner(row)) {
         n_inner++;
-        avg_anode_voltage[digi_.n_sectors*0 + sector - 1] += tpcrs::VoltagePadrow(sector, row, cfg_);
+        avg_anode_voltage[digi_.n_sectors*0 + sector - 1] += tpcrs::VoltagePadrow(sector, row, *cfg_);
       }
       else {
         n_outer++;
-        avg_anode_voltage[digi_.n_sectors*1 + sector - 1] += tpcrs::VoltagePadrow(sector, row, cfg_);
+        avg_anode_voltage[digi_.n_sectors*1 + sector - 1] += tpcrs::VoltagePadrow(sector, row, *cfg_);
       }
     }
 
@@ -263,15 +561,48 @@ void Simulator::InitAlphaGainVariations(double t0IO[2])
 }
 
 
+bool Simulator::SimulatesInParallel(const Context& context) const
+{
+  if (context.generator_ == Context::Generator::kCounterBased)
+    return true;
+
+  if (!serial_fallback_reported_.exchange(true))
+    LOG_WARN << "Simulator: The sequential generator cannot be shared by threads. "
+             << "The sectors are processed serially. Use a context with the counter-based generator\n";
+
+  return false;
+}
+
+
+std::vector<Simulator::SectorSegments> Simulator::GroupBySector(const TrackSegments& segments) const
+{
+  std::vector<SectorSegments> groups;
+
+  for (auto segment_iter = begin(segments); segment_iter != end(segments); )
+  {
+    unsigned int sector = segment_iter->simu_hit.volume_id % 10000 / 100;
+
+    auto last = std::find_if(segment_iter, end(segments), [sector](const TrackSegment& segment) {
+      return segment.simu_hit.volume_id % 10000 / 100 != sector;
+    });
+
+    groups.push_back({sector, segment_iter, last, static_cast<unsigned int>(segment_iter - begin(segments))});
+    segment_iter = last;
+  }
+
+  return groups;
+}
+
+
 double Simulator::GetNoPrimaryClusters(double betaGamma, int charge) const
 {
   double beta = betaGamma / std::sqrt(1.0 + betaGamma * betaGamma);
   double dNdx = 0;
 
   if (dEdx_model_ == dEdxModel::kBichsel)
-    dNdx = const_cast<TH1D*>(&dNdx_)->Interpolate(betaGamma);
+    dNdx = dNdx_.Interpolate(betaGamma);
   else if (dEdx_model_ == dEdxModel::kHeed)
-    dNdx = const_cast<TH1D*>(&dNdx_log10_)->Interpolate(std::log10(betaGamma));
+    dNdx = dNdx_log10_.Interpolate(std::log10(betaGamma));
 
   double Q_eff = std::abs(charge % 100);
 
@@ -541,7 +872,7 @@ double Simulator::Ec(double* x, double* p)
 }
 
 
-std::vector<float> Simulator::NumberOfElectronsInCluster(const TF1& heed, float dE, float& dEr) const
+std::vector<float> Simulator::NumberOfElectronsInCluster(const TF1& heed, float dE, float& dEr, TRandom& random) const
 {
   std::vector<float> rs;
 
@@ -549,7 +880,11 @@ std::vector<float> Simulator::NumberOfElectronsInCluster(const TF1& heed, float
   dEr = dET;
   float EC;
 
-  while ((EC = const_cast<TF1&>(heed).GetRandom()) < dEr) {
+  auto sample_ec = [&]() -> float {
+    return options_.closed_form_sampling ? ec_sampler_.GetRandom(random) : GetRandom(heed, random);
+  };
+
+  while ((EC = sample_ec()) < dEr) {
     dEr -= EC;
     rs.push_back(1 - dEr / dET);
   }
@@ -558,44 +893,44 @@ std::vector<float> Simulator::NumberOfElectronsInCluster(const TF1& heed, float
 }
 
 
-double Simulator::CalcBaseGain(int sector, int row) const
+double Simulator::CalcBaseGain(int sector, int row, TRandom& random) const
 {
   // switch between Inner / Outer Sector paramters
   int iowe = 0;
   if (sector > 12)  iowe += 4;
-  if (!tpcrs::IsInner(row, cfg_)) iowe += 2;
+  if (!geom_->is_inner(row)) iowe += 2;
 
   // Extra correction for simulation with respect to data
-  const float* AdditionalMcCorrection = cfg_.S<TpcResponseSimulator>().SecRowCorIW;
-  const float* AddSigmaMcCorrection   = cfg_.S<TpcResponseSimulator>().SecRowSigIW;
+  const float* AdditionalMcCorrection = cfg_->S<TpcResponseSimulator>().SecRowCorIW;
+  const float* AddSigmaMcCorrection   = cfg_->S<TpcResponseSimulator>().SecRowSigIW;
 
-  double gain = tpcrs::GainCorrection(sector, row, cfg_);
+  double gain = geom_->base_gain(sector, row);
   double gain_x_correctionL = AdditionalMcCorrection[iowe] + row * AdditionalMcCorrection[iowe + 1];
   double gain_x_sigma = AddSigmaMcCorrection[iowe] + row * AddSigmaMcCorrection[iowe + 1];
 
   gain *= std::exp(-gain_x_correctionL);
 
-  if (gain_x_sigma > 0) gain *= std::exp(gRandom->Gaus(0., gain_x_sigma));
+  if (gain_x_sigma > 0) gain *= std::exp(random.Gaus(0., gain_x_sigma));
 
   return gain;
 }
 
 
-double Simulator::CalcLocalGain(const TrackSegment& segment) const
+double Simulator::CalcLocalGain(const TrackSegment& segment, TRandom& random) const
 {
-  double gain_base = CalcBaseGain(segment.Pad.sector, segment.Pad.row);
+  double gain_base = CalcBaseGain(segment.Pad.sector, segment.Pad.row, random);
   double dedx_corr = dEdxCorrection(segment);
   dedx_corr *= GatingGridTransparency(segment.Pad.timeBucket);
 
-  if (dedx_corr < cfg_.S<ResponseSimulator>().min_signal)
+  if (dedx_corr < cfg_->S<ResponseSimulator>().min_signal)
     return 0;
   else
-    return gain_base / dedx_corr / cfg_.S<TpcResponseSimulator>().NoElPerAdc;
+    return gain_base / dedx_corr / cfg_->S<TpcResponseSimulator>().NoElPerAdc;
 }
 
 
 void Simulator::SignalFromSegment(const TrackSegment& segment, double gain_local,
-  ChargeContainer& binned_charge, int& nP, double& dESum, double& dSSum) const
+  Context& context, int& nP, double& dESum, double& dSSum) const
 {
   static const double m_e = .51099907e-3;
   static const double eV = 1e-9; // electronvolt in GeV
@@ -628,8 +963,8 @@ void Simulator::SignalFromSegment(const TrackSegment& segment, double gain_local
     Tmax = 2 * m_e * betaGamma * betaGamma / (1 + 2 * gamma * r + r * r);
   }
 
-  if (Tmax > cfg_.S<ResponseSimulator>().electron_cutoff_energy)
-    Tmax = cfg_.S<ResponseSimulator>().electron_cutoff_energy;
+  if (Tmax > cfg_->S<ResponseSimulator>().electron_cutoff_energy)
+    Tmax = cfg_->S<ResponseSimulator>().electron_cutoff_energy;
 
   float dEr = 0;
   double s_low   = -std::abs(segment.simu_hit.ds) / 2;
@@ -648,21 +983,23 @@ void Simulator::SignalFromSegment(const TrackSegment& segment, double gain_local
       double gamma = eKin / m_e + 1;
       Tmax = 0.5 * m_e * (gamma - 1);
 
-      if (Tmax <= cfg_.S<TpcResponseSimulator>().W / 2 * eV) break;
+      if (Tmax <= cfg_->S<TpcResponseSimulator>().W / 2 * eV) break;
 
       NP = GetNoPrimaryClusters(betaGamma, segment.charge);
     }
     else {
-      dS = -std::log(gRandom->Rndm()) / NP;
+      dS = -std::log(context.random().Rndm()) / NP;
     }
 
-    double dE = std::exp(cLog10 * dNdE_log10_.GetRandom());
+    double dE_log10 = options_.alias_sampling ? dNdE_log10_alias_.GetRandom(context.random()) :
+                                                dNdE_log10_.GetRandom(context.random());
+    double dE = std::exp(cLog10 * dE_log10);
     double E = dE * eV;
     newPosition += dS;
 
     if (newPosition > s_upper) break;
 
-    if (dE < cfg_.S<TpcResponseSimulator>().W / 2 || E > Tmax) continue;
+    if (dE < cfg_->S<TpcResponseSimulator>().W / 2 || E > Tmax) continue;
 
     if (eKin > 0) {
       if (eKin >= E) {eKin -= E;}
@@ -674,237 +1011,269 @@ void Simulator::SignalFromSegment(const TrackSegment& segment, double gain_local
     nP++;
     double xRange = ElectronRange(dE, dEr);
 
-    std::vector<float> rs = NumberOfElectronsInCluster(mHeed, dE, dEr);
+    std::vector<float> rs = NumberOfElectronsInCluster(mHeed, dE, dEr, context.random());
 
     if (!rs.size()) continue;
 
     Coords xyzC = segment.track.at(newPosition);
 
-    LoopOverElectronsInCluster(rs, segment, binned_charge, xRange, xyzC, gain_local);
+    LoopOverElectronsInCluster(rs, segment, context, xRange, xyzC, gain_local);
   }
   while (true);   // Clusters
 }
 
 
 void Simulator::LoopOverElectronsInCluster(
-  const std::vector<float>& rs, const TrackSegment &segment, ChargeContainer& binned_charge,
+  const std::vector<float>& rs, const TrackSegment &segment, Context& context,
   double xRange, Coords xyzC, double gain_local) const
 {
+  TRandom& random = context.random();
+  ElectronBatch& electrons = context.electrons_;
+
+  const TpcResponseSimulator& response = cfg_->S<TpcResponseSimulator>();
+
   int sector = segment.Pad2.sector;
   int row    = segment.Pad2.row;
-  double omega_tau = cfg_.S<TpcResponseSimulator>().OmegaTau * segment.BLS.position.z / 5.0; // from diffusion 586 um / 106 um at B = 0/ 5kG
+  bool is_inner = geom_->is_inner(row);
+  double omega_tau = response.OmegaTau * segment.BLS.position.z / 5.0; // from diffusion 586 um / 106 um at B = 0/ 5kG
   double driftLength = std::abs(segment.coorLS2.position.z);
   double D = 1. + omega_tau * omega_tau;
-  double SigmaL = cfg_.S<TpcResponseSimulator>().longitudinalDiffusion * std::sqrt(driftLength);
-  double SigmaT = cfg_.S<TpcResponseSimulator>().transverseDiffusion * std::sqrt(driftLength / D);
-  double sigmaJitterX = tpcrs::IsInner(row, cfg_) ?  cfg_.S<TpcResponseSimulator>().SigmaJitterXI :
-                                                     cfg_.S<TpcResponseSimulator>().SigmaJitterXO;
+  double SigmaL = response.longitudinalDiffusion * std::sqrt(driftLength);
+  double SigmaT = response.transverseDiffusion * std::sqrt(driftLength / D);
+  double sigmaJitterX = is_inner ? response.SigmaJitterXI : response.SigmaJitterXO;
   if (sigmaJitterX > 0) {
     SigmaT = std::sqrt(SigmaT * SigmaT + sigmaJitterX * sigmaJitterX);
   }
 
   // Dummy call to keep the same random number sequence
-  gRandom->Rndm();
-  double rX, rY;
+  random.Rndm();
 
-  InOut io = tpcrs::IsInner(row, cfg_) ? kInner : kOuter;
+  InOut io = is_inner ? kInner : kOuter;
 
   Coords unit = segment.dirLS.position.unit();
   double L2L[9] = {unit.z,                  - unit.x*unit.z, unit.x,
                    unit.x,                  - unit.y*unit.z, unit.y,
                    0.0,       unit.x*unit.x + unit.y*unit.y, unit.z};
 
-  for (int ie = 0; ie < rs.size(); ie++)
+  double lastInnerSectorAnodeWire = cfg_->S<tpcWirePlanes>().lastInnerSectorAnodeWire;
+  double gainVariation[2][2] = {
+    {std::exp( alpha_gain_variations_[sector - 1]), std::exp(-alpha_gain_variations_[sector - 1])},
+    {std::exp( alpha_gain_variations_[digi_.n_sectors + sector - 1]), std::exp(-alpha_gain_variations_[digi_.n_sectors + sector - 1])}
+  };
+  double dY = mChargeFraction[digi_.n_sectors*io + sector - 1].GetXmax();
+  const TF1F* shaper = &mShaperResponses[io][sector - 1];
+
+  // The time jitter is drawn for every electron while generating the signal.
+  // The legacy sequential generator has to process one electron at a time to
+  // reproduce the original sequence of random numbers
+  bool jitter = (is_inner ? response.SigmaJitterTI : response.SigmaJitterTO) != 0;
+  size_t n_electrons = rs.size();
+  size_t batch_size = jitter && context.generator_ == Context::Generator::kSequential ? 1 : n_electrons;
+
+  electrons.resize(n_electrons);
+
+  for (size_t first = 0; first < n_electrons; first += batch_size)
   {
-    double gain_gas = const_cast<TF1F*>(&mPolya[io])->GetRandom();
-    // transport to wire
-    gRandom->Rannor(rX, rY);
-    StTpcLocalSectorCoordinate xyzE{xyzC.x + rX * SigmaT,
-                                    xyzC.y + rY * SigmaT,
-                                    xyzC.z + gRandom->Gaus(0, SigmaL), sector, row};
-    if (xRange > 0) {
-      double xyzRangeL[3] = {rs[ie] * xRange * rX, rs[ie] * xRange * rY, 0.};
-      double xyzR[3] = {0};
-      TCL::mxmpy(L2L, xyzRangeL, xyzR, 3, 3, 1);
-      for (int i=0; i<3; i++) xyzE.position[i] += xyzR[i];
+    size_t last = std::min(first + batch_size, n_electrons);
+
+    // Random draws are sequential
+    for (size_t ie = first; ie < last; ie++) {
+      electrons.gain[ie] = options_.closed_form_sampling ? polya_samplers_[io].GetRandom(random) :
+                                                           GetRandom(mPolya[io], random);
+      random.Rannor(electrons.rx[ie], electrons.ry[ie]);
+      electrons.rz[ie] = random.Gaus(0, SigmaL);
+    }
+
+    // Diffusion
+    for (size_t ie = first; ie < last; ie++) {
+      electrons.x[ie] = xyzC.x + electrons.rx[ie] * SigmaT;
+      electrons.y[ie] = xyzC.y + electrons.ry[ie] * SigmaT;
+      electrons.z[ie] = xyzC.z + electrons.rz[ie];
     }
 
-    bool missed_readout = false;
-    bool is_ground_wire = false;
+    // Range of the primary electron rotated to the track direction
+    if (xRange > 0) {
+      for (size_t ie = first; ie < last; ie++) {
+        double rangeX = rs[ie] * xRange * electrons.rx[ie];
+        double rangeY = rs[ie] * xRange * electrons.ry[ie];
+        electrons.x[ie] += L2L[0] * rangeX + L2L[1] * rangeY;
+        electrons.y[ie] += L2L[3] * rangeX + L2L[4] * rangeY;
+        electrons.z[ie] += L2L[6] * rangeX + L2L[7] * rangeY;
+      }
+    }
 
-    Coords at_readout = TransportToReadout(xyzE.position, omega_tau, missed_readout, is_ground_wire);
+    TransportToReadout(electrons, first, last, omega_tau);
 
-    if (missed_readout) continue;
+    for (size_t ie = first; ie < last; ie++) {
+      if (electrons.missed_readout[ie]) continue;
 
-    double alphaVariation = (xyzE.position.y <= cfg_.S<tpcWirePlanes>().lastInnerSectorAnodeWire) ?
-                             alpha_gain_variations_[digi_.n_sectors*0 + sector - 1] :
-                             alpha_gain_variations_[digi_.n_sectors*1 + sector - 1];
+      int inout = electrons.y[ie] <= lastInnerSectorAnodeWire ? 0 : 1;
+      electrons.gain[ie] *= gainVariation[inout][electrons.is_ground_wire[ie] ? 1 : 0];
 
-    if (!is_ground_wire) gain_gas *= std::exp( alphaVariation);
-    else                 gain_gas *= std::exp(-alphaVariation);
+      electrons.row_min[ie] = transform_->YToRow(electrons.readout_y[ie] - dY, sector);
+      electrons.row_max[ie] = transform_->YToRow(electrons.readout_y[ie] + dY, sector);
+    }
 
-    double dY     = mChargeFraction[digi_.n_sectors*io + sector - 1].GetXmax();
-    double yLmin  = at_readout.y - dY;
-    double yLmax  = at_readout.y + dY;
+    for (size_t ie = first; ie < last; ie++) {
+      if (electrons.missed_readout[ie]) continue;
 
-    int    rowMin = transform_.YToRow(yLmin, sector);
-    int    rowMax = transform_.YToRow(yLmax, sector);
+      Coords at_readout{electrons.readout_x[ie], electrons.readout_y[ie], electrons.readout_z[ie]};
 
-    GenerateSignal(segment, at_readout, rowMin, rowMax,
-                   &mShaperResponses[io][sector - 1], binned_charge, gain_local * gain_gas);
+      GenerateSignal(segment, at_readout, electrons.row_min[ie], electrons.row_max[ie],
+                     shaper, context, gain_local * electrons.gain[ie]);
+    }
   }  // electrons in Cluster
 }
 
 
 void Simulator::GenerateSignal(const TrackSegment &segment, Coords at_readout, int rowMin, int rowMax,
-  const TF1F* shaper, ChargeContainer& binned_charge, double gain_local_gas) const
+  const TF1F* shaper, Context& context, double gain_local_gas) const
 {
+  ChargeAccumulator& binned_charge = context.binned_charge_;
+
   int sector = segment.Pad2.sector;
   int row    = segment.Pad2.row;
-  double sigmaJitterT = (tpcrs::IsInner(row, cfg_) ? cfg_.S<TpcResponseSimulator>().SigmaJitterTI :
-                                                     cfg_.S<TpcResponseSimulator>().SigmaJitterTO);
+  double min_signal = cfg_->S<ResponseSimulator>().min_signal;
+  double sigmaJitterT = (geom_->is_inner(row) ? cfg_->S<TpcResponseSimulator>().SigmaJitterTI :
+                                                cfg_->S<TpcResponseSimulator>().SigmaJitterTO);
 
   for (int row = rowMin; row <= rowMax; row++) {
 
     StTpcLocalSectorCoordinate xyzW{at_readout.x, at_readout.y, at_readout.z, sector, row};
     StTpcPadCoordinate Pad;
-    transform_.local_sector_to_hardware(xyzW, Pad);
+    transform_->local_sector_to_hardware(xyzW, Pad);
     float bin = Pad.timeBucket;//L  - 1; // K
     int binT = tpcrs::irint(bin); //L bin;//K tpcrs::irint(bin);// J bin; // I tpcrs::irint(bin);
 
     if (binT < 0 || binT >= digi_.n_timebins) continue;
 
-    double dT = bin - binT + cfg_.S<TpcResponseSimulator>().T0offset;
-    dT += tpcrs::IsInner(row, cfg_) ? cfg_.S<TpcResponseSimulator>().T0offsetI :
-                                      cfg_.S<TpcResponseSimulator>().T0offsetO;
+    double dT = bin - binT + cfg_->S<TpcResponseSimulator>().T0offset;
+    dT += geom_->is_inner(row) ? cfg_->S<TpcResponseSimulator>().T0offsetI :
+                                 cfg_->S<TpcResponseSimulator>().T0offsetO;
 
-    if (sigmaJitterT) dT += gRandom->Gaus(0, sigmaJitterT);
+    if (sigmaJitterT) dT += context.random().Gaus(0, sigmaJitterT);
 
-    InOut io = tpcrs::IsInner(row, cfg_) ? kInner : kOuter;
+    InOut io = geom_->is_inner(row) ? kInner : kOuter;
 
-    double delta_y = tpcrs::RadialDistanceAtRow(row, cfg_) - at_readout.y;
+    double delta_y = geom_->radius(row) - at_readout.y;
     double YDirectionCoupling = mChargeFraction[digi_.n_sectors*io + sector - 1].GetSaveL(delta_y);
 
-    if (YDirectionCoupling < cfg_.S<ResponseSimulator>().min_signal) continue;
+    if (YDirectionCoupling < min_signal) continue;
 
     float padX = Pad.pad;
     int CentralPad = tpcrs::irint(padX);
 
-    if (CentralPad < 1 || CentralPad > digi_.n_pads(row)) continue;
+    if (CentralPad < 1 || CentralPad > geom_->n_pads(row)) continue;
 
     int DeltaPad = tpcrs::irint(mPadResponseFunction[digi_.n_sectors*io + sector - 1].GetXmax()) + 1;
     int padMin   = std::max(CentralPad - DeltaPad, 1);
-    int padMax   = std::min(CentralPad + DeltaPad, digi_.n_pads(row));
+    int padMax   = std::min(CentralPad + DeltaPad, geom_->n_pads(row));
     int Npads    = std::min(padMax - padMin + 1, static_cast<int>(kPadMax));
     double xPadMin = padMin - padX;
 
-    static double XDirectionCouplings[kPadMax];
+    double XDirectionCouplings[kPadMax];
     mPadResponseFunction[digi_.n_sectors*io + sector - 1].GetSaveL(Npads, xPadMin, XDirectionCouplings);
 
-    for (unsigned pad = padMin; pad <= padMax; pad++) {
-      double gain = gain_local_gas;
-      double dt = dT;
+    // Pads excluded from the deposition are marked with NaN
+    double PadCouplings[kPadMax];
 
-      gain *= cfg_.S<tpcPadGainT0>().Gain[sector-1][row-1][pad-1];
+    for (int i = 0; i < Npads; i++) {
+      int pad = padMin + i;
+      double gain = gain_local_gas * cfg_->S<tpcPadGainT0>().Gain[sector-1][row-1][pad-1];
+      double XYcoupling = gain * XDirectionCouplings[i] * YDirectionCoupling;
 
-      if (gain <= 0.0) continue;
+      PadCouplings[i] = gain <= 0.0 || XYcoupling < min_signal ? std::numeric_limits<double>::quiet_NaN() : XYcoupling;
+    }
 
-      dt -= cfg_.S<tpcPadGainT0>().T0[sector-1][row-1][pad-1];
+    // The time couplings depend on the pad T0 and are shared by the adjacent
+    // pads with the same T0
+    for (int first = 0, last = 1; first < Npads; first = last++) {
+      double T0 = cfg_->S<tpcPadGainT0>().T0[sector-1][row-1][padMin + first - 1];
 
-      double XYcoupling = gain * XDirectionCouplings[pad - padMin] * YDirectionCoupling;
+      while (last < Npads && cfg_->S<tpcPadGainT0>().T0[sector-1][row-1][padMin + last - 1] == T0) last++;
 
-      if (XYcoupling < cfg_.S<ResponseSimulator>().min_signal) continue;
+      double dt = dT - T0;
 
       int tbin_first = std::max(0, binT + tpcrs::irint(dt + shaper->GetXmin() - 0.5));
       int tbin_last  = std::min(digi_.n_timebins - 1, binT + tpcrs::irint(dt + shaper->GetXmax() + 0.5));
       int num_tbins  = std::min(tbin_last - tbin_first + 1, static_cast<int>(kTimeBacketMax));
 
-      static double TimeCouplings[kTimeBacketMax];
-      shaper->GetSaveL(num_tbins, tbin_first - binT - dt, TimeCouplings);
-
-      int index = digi_.n_timebins * (digi_.total_pads(row) + pad - 1) + tbin_first;
-
-      for (unsigned itbin = tbin_first; itbin <= tbin_last; itbin++, index++) {
-        double signal = XYcoupling * TimeCouplings[itbin - tbin_first];
+      if (num_tbins <= 0) continue;
 
-        if (signal < cfg_.S<ResponseSimulator>().min_signal) continue;
+      double TimeCouplings[kTimeBacketMax];
+      shaper->GetSaveL(num_tbins, tbin_first - binT - dt, TimeCouplings);
 
-        binned_charge[index] += {static_cast<float>(signal), static_cast<short>(segment.simu_hit.track_id)};
-      } // time
-    } // pad limits
+      binned_charge.Deposit(geom_->pad_offset(row) + padMin + first - 1, last - first, PadCouplings + first,
+                            tbin_first, num_tbins, TimeCouplings, min_signal, static_cast<short>(segment.simu_hit.track_id));
+    }
   } // row limits
 }
 
 
-Coords Simulator::TransportToReadout(const Coords c, double omega_tau, bool& missed_readout, bool& is_ground_wire) const
+void Simulator::TransportToReadout(ElectronBatch& electrons, size_t first, size_t last, double omega_tau) const
 {
-  Coords readout;
-  missed_readout = false;
-
   // Transport to wire
-  double firstOuterSectorAnodeWire = cfg_.S<tpcWirePlanes>().firstOuterSectorAnodeWire;
-  double anodeWirePitch            = cfg_.S<tpcWirePlanes>().anodeWirePitch;
-  int wire_index = 0;
+  double firstInnerSectorAnodeWire = cfg_->S<tpcWirePlanes>().firstInnerSectorAnodeWire;
+  double firstOuterSectorAnodeWire = cfg_->S<tpcWirePlanes>().firstOuterSectorAnodeWire;
+  double lastInnerSectorAnodeWire  = cfg_->S<tpcWirePlanes>().lastInnerSectorAnodeWire;
+  double anodeWirePitch            = cfg_->S<tpcWirePlanes>().anodeWirePitch;
+  int numInnerSectorAnodeWires     = cfg_->S<tpcWirePlanes>().numInnerSectorAnodeWires;
+  int numOuterSectorAnodeWires     = cfg_->S<tpcWirePlanes>().numOuterSectorAnodeWires;
 
-  if (c.y <= cfg_.S<tpcWirePlanes>().lastInnerSectorAnodeWire) {
-    double firstInnerSectorAnodeWire = cfg_.S<tpcWirePlanes>().firstInnerSectorAnodeWire;
-    wire_index = tpcrs::irint((c.y - firstInnerSectorAnodeWire) / anodeWirePitch) + 1;
-    // In TPC the first and last wires are fat ones
-    if (wire_index <= 1 || wire_index >= cfg_.S<tpcWirePlanes>().numInnerSectorAnodeWires)
-      missed_readout = true;
-    readout.y = firstInnerSectorAnodeWire + (wire_index - 1) * anodeWirePitch;
-  }
-  else {
-    wire_index = tpcrs::irint((c.y - firstOuterSectorAnodeWire) / anodeWirePitch) + 1;
-    // In TPC the first and last wires are fat ones
-    if (wire_index <= 1 || wire_index >= cfg_.S<tpcWirePlanes>().numOuterSectorAnodeWires)
-      missed_readout = true;
-    readout.y = firstOuterSectorAnodeWire + (wire_index - 1) * anodeWirePitch;
-  }
+  // omega_tau near wires taken from comparison with data
+  double tanLorentzI = omega_tau / cfg_->S<TpcResponseSimulator>().OmegaTauScaleI;
+  double tanLorentzO = omega_tau / cfg_->S<TpcResponseSimulator>().OmegaTauScaleO;
+
+  for (size_t ie = first; ie < last; ie++)
+  {
+    double y = electrons.y[ie];
+    bool inner = y <= lastInnerSectorAnodeWire;
 
-  double distance_to_wire = c.y - readout.y; // Calculated effective distance to wire affected by Lorentz shift
-  // Grid plane (1 mm spacing) focusing effect + Lorentz angle in drift volume
-  int iGridWire = int(std::abs(10.*distance_to_wire));
-  double dist2Grid = std::copysign(0.05 + 0.1 * iGridWire, distance_to_wire); // [cm]
-  // Ground plane (1 mm spacing) focusing effect
-  int iGroundWire = int(std::abs(10.*dist2Grid));
-  double distFocused = std::copysign(0.05 + 0.1 * iGroundWire, dist2Grid);
+    double firstWire = inner ? firstInnerSectorAnodeWire : firstOuterSectorAnodeWire;
+    int numWires     = inner ? numInnerSectorAnodeWires : numOuterSectorAnodeWires;
 
-  // omega_tau near wires taken from comparison with data
-  double tanLorentz = (c.y < firstOuterSectorAnodeWire) ? omega_tau / cfg_.S<TpcResponseSimulator>().OmegaTauScaleI :
-                                                          omega_tau / cfg_.S<TpcResponseSimulator>().OmegaTauScaleO;
+    int wire_index = tpcrs::irint((y - firstWire) / anodeWirePitch) + 1;
+    // In TPC the first and last wires are fat ones
+    electrons.missed_readout[ie] = wire_index <= 1 || wire_index >= numWires;
+    electrons.readout_y[ie] = firstWire + (wire_index - 1) * anodeWirePitch;
 
-  readout.x = c.x + distFocused * tanLorentz; // tanLorentz near wires taken from comparison with data
-  readout.z = c.z + std::abs(distFocused);
+    double distance_to_wire = y - electrons.readout_y[ie]; // Calculated effective distance to wire affected by Lorentz shift
+    // Grid plane (1 mm spacing) focusing effect + Lorentz angle in drift volume
+    int iGridWire = int(std::abs(10.*distance_to_wire));
+    double dist2Grid = std::copysign(0.05 + 0.1 * iGridWire, distance_to_wire); // [cm]
+    // Ground plane (1 mm spacing) focusing effect
+    int iGroundWire = int(std::abs(10.*dist2Grid));
+    double distFocused = std::copysign(0.05 + 0.1 * iGroundWire, dist2Grid);
 
-  is_ground_wire = iGroundWire != 0;
+    double tanLorentz = y < firstOuterSectorAnodeWire ? tanLorentzI : tanLorentzO;
 
-  return readout;
+    electrons.readout_x[ie] = electrons.x[ie] + distFocused * tanLorentz; // tanLorentz near wires taken from comparison with data
+    electrons.readout_z[ie] = electrons.z[ie] + std::abs(distFocused);
+
+    electrons.is_ground_wire[ie] = iGroundWire != 0;
+  }
 }
 
 
 double Simulator::dEdxCorrection(const TrackSegment &segment) const
 {
-  static StTpcdEdxCorrection dEdx_correction_(cfg_);
-
   dEdxY2_t CdEdx{};
   CdEdx.DeltaZ  = 5.2;
   CdEdx.QRatio  = -2;
   CdEdx.QRatioA = -2.;
   CdEdx.edge    = tpcrs::irint(segment.Pad.pad);
 
-  if (CdEdx.edge > 0.5 * digi_.n_pads(segment.Pad.row))
-    CdEdx.edge += 1 - digi_.n_pads(segment.Pad.row);
+  if (CdEdx.edge > 0.5 * geom_->n_pads(segment.Pad.row))
+    CdEdx.edge += 1 - geom_->n_pads(segment.Pad.row);
 
   CdEdx.F.dE   = 1;
   CdEdx.F.dx   = std::abs(segment.simu_hit.ds);
   CdEdx.xyz[0] = segment.coorLS.position.x;
   CdEdx.xyz[1] = segment.coorLS.position.y;
   CdEdx.xyz[2] = segment.coorLS.position.z;
-  double probablePad = digi_.n_pads(segment.Pad.row) / 2;
-  double pitch = tpcrs::IsInner(segment.Pad.row, cfg_) ? cfg_.S<tpcPadPlanes>().innerSectorPadPitch :
-                                                   cfg_.S<tpcPadPlanes>().outerSectorPadPitch;
-  double PhiMax = std::atan2(probablePad * pitch, tpcrs::RadialDistanceAtRow(segment.Pad.row, cfg_));
+  double probablePad = geom_->n_pads(segment.Pad.row) / 2;
+  double pitch = geom_->pad_pitch(segment.Pad.row);
+  double PhiMax = std::atan2(probablePad * pitch, geom_->radius(segment.Pad.row));
   CdEdx.PhiR    = std::atan2(CdEdx.xyz[0], CdEdx.xyz[1]) / PhiMax;
   CdEdx.xyzD[0] = segment.dirLS.position.x;
   CdEdx.xyzD[1] = segment.dirLS.position.y;
@@ -912,7 +1281,7 @@ double Simulator::dEdxCorrection(const TrackSegment &segment) const
   CdEdx.zG      = CdEdx.xyz[2];
   CdEdx.ZdriftDistance = segment.coorLS.position.z; // drift length
 
-  return dEdx_correction_.dEdxCorrection(segment.Pad.sector, segment.Pad.row, CdEdx) ? 1 : CdEdx.F.dE;
+  return dEdx_correction_->dEdxCorrection(segment.Pad.sector, segment.Pad.row, CdEdx) ? 1 : CdEdx.F.dE;
 }
 
 } }
@@ -1,7 +1,4 @@
 #include <cassert>
-#include "TF1.h"
-#include "TF2.h"
-#include "TF3.h"
 
 #include "logger.h"
 #include "tpcrs/detail/struct_containers.h"
@@ -19,19 +16,52 @@ MakeChairInstance2(TpcSecRowCor,St_TpcSecRowCC,Calibrations/tpc/TpcSecRowC);
 MakeChairInstance(tpcSCGL,Calibrations/tpc/tpcSCGL);
 
 
+namespace {
+
+/// The number of intervals of the grids in one and two variables. The same as
+/// the default number of points of TF1 and TF2
+const int kMDFGridIntervals[2] = {100, 30};
+
+/// Returns the polynomial with n coefficients a at x
+double Polynomial(const double* a, int n, double x)
+{
+  double sum = a[n-1];
+  for (int i = n-2; i >= 0; i--) sum = x*sum + a[i];
+  return sum;
+}
+
+/// Returns the Gaussian exp(-0.5*((x - mean)/sigma)^2) as TMath::Gaus does,
+/// i.e. 1e30 for zero sigma and 0 far in the tails
+double Gaus(double x, double mean, double sigma)
+{
+  if (sigma == 0) return 1.e30;
+  double t = (x - mean)/sigma;
+  if (t < -39 || t > 39) return 0;
+  return std::exp(-0.5*t*t);
+}
+
+}
+
+
 double St_tpcCorrectionC::CalcCorrection(int i, double x, double z, int NparMax) const {
   tpcCorrection *cor =  Struct(i);
   return SumSeries(cor, x, z, NparMax);
 }
 
 
+void St_tpcCorrectionC::CalcCorrection(int i, const double* x, double* result, int n, double z, int NparMax) const {
+  tpcCorrection *cor =  Struct(i);
+  for (int j = 0; j < n; j++) result[j] = SumSeries(cor, x[j], z, NparMax);
+}
+
+
 double St_tpcCorrectionC::SumSeries(tpcCorrection *cor,  double x, double z, int NparMax) const {
   double Sum = 0;
   if (! cor) return Sum;
   int N = std::abs(cor->npar)%100;
   if (N == 0) return Sum;
   if (NparMax > 0) N = NparMax;
-  static double T0, T1, T2;
+  double T0, T1, T2;
   // parameterization variable
   double X = x;
   if (cor->npar  < 0) X = std::exp(x);
@@ -67,9 +97,6 @@ double St_tpcCorrectionC::SumSeries(tpcCorrection *cor,  double x, double z, int
     if (X < cor->min) X = cor->min;
     if (X > cor->max) X = cor->max;
   }
-  static TF1 *f1000 = 0, *f1100 = 0, *f1200 = 0, *f1300 = 0;
-  static TF1 *f2000 = 0, *f2100 = 0, *f2200 = 0, *f2300 = 0;
-  TF1 *f = 0;
   switch (cor->type) {
   case 1: // Tchebyshev [-1,1]
     T0 = 1;
@@ -112,47 +139,17 @@ double St_tpcCorrectionC::SumSeries(tpcCorrection *cor,  double x, double z, int
     Sum = cor->a[1] + z*cor->a[2] + z*z*cor->a[3] + std::exp(X*(cor->a[4] + X*cor->a[5]) + cor->a[6]);
     Sum *= std::exp(-cor->a[0]);
     break;
-  case 1000:
-  case 1100:
-  case 1200:
-  case 1300:
-    if (cor->type == 1000) {
-      if (! f1000) f1000 = new TF1("f1000","gaus+pol0(3)");
-      f = f1000;
-    } else if (cor->type == 1100) {
-      if (! f1100) f1100 = new TF1("f1100","gaus+pol1(3)");
-      f = f1100;
-    } else if (cor->type == 1200) {
-      if (! f1200) f1200 = new TF1("f1200","gaus+pol2(3)");
-      f = f1200;
-    } else if (cor->type == 1300) {
-      if (! f1300) f1300 = new TF1("f1300","gaus+pol3(3)");
-      f = f1300;
-    }
-    assert(f);
-    f->SetParameters(cor->a);
-    Sum = f->Eval(X);
+  case 1000: // gaus+pol0(3)
+  case 1100: // gaus+pol1(3)
+  case 1200: // gaus+pol2(3)
+  case 1300: // gaus+pol3(3)
+    Sum = cor->a[0]*Gaus(X, cor->a[1], cor->a[2]) + Polynomial(cor->a + 3, (cor->type - 1000)/100 + 1, X);
     break;
-  case 2000:
-  case 2100:
-  case 2200:
-  case 2300:
-    if (cor->type == 2000) {
-      if (! f2000) f2000 = new TF1("f2000","expo+pol0(2)");
-      f = f2000;
-    } else if (cor->type == 2100) {
-      if (! f2100) f2100 = new TF1("f2100","expo+pol1(2)");
-      f = f2100;
-    } else if (cor->type == 2200) {
-      if (! f2200) f2200 = new TF1("f2200","expo+pol2(2)");
-      f = f2200;
-    } else if (cor->type == 2300) {
-      if (! f2300) f2300 = new TF1("f2300","expo+pol3(2)");
-      f = f2300;
-    }
-    assert(f);
-    f->SetParameters(cor->a);
-    Sum = f->Eval(X);
+  case 2000: // expo+pol0(2)
+  case 2100: // expo+pol1(2)
+  case 2200: // expo+pol2(2)
+  case 2300: // expo+pol3(2)
+    Sum = std::exp(cor->a[0] + cor->a[1]*X) + Polynomial(cor->a + 2, (cor->type - 2000)/100 + 1, X);
     break;
   default: // polynomials
     Sum = cor->a[N-1];
@@ -185,40 +182,79 @@ MakeChairInstance2(tpcCorrection,St_TpcPhiDirectionC,Calibrations/tpc/TpcPhiDire
 MakeChairInstance2(tpcCorrection,St_TpcLengthCorrectionBC,Calibrations/tpc/TpcLengthCorrectionB);
 MakeChairInstance2(MDFCorrection,St_TpcLengthCorrectionMDF,Calibrations/tpc/TpcLengthCorrectionMDF);
 MakeChairInstance2(MDFCorrection,St_TpcPadCorrectionMDF,Calibrations/tpc/TpcPadCorrectionMDF);
-St_MDFCorrectionC *St_MDFCorrectionC::fgMDFCorrectionC = 0;
-
-
-St_MDFCorrectionC::St_MDFCorrectionC() : fFunc(0) {
+void St_MDFCorrectionC::Initialize() {
+  unsigned int N = GetNRows();
+  fGrids.resize(N);
+  fMaxPowers.resize(N);
+  for (unsigned int k = 0; k < N; k++) {
+    Grid &grid = fGrids[k];
+    grid.n_vars = 0;
+    if (NVariables(k) > kMaxVariables) {
+      if (!is_missing) LOG_ERROR << "St_MDFCorrectionC: Too many variables in row " << k << " of " << GetName() << '\n';
+      continue;
+    }
+    fMaxPowers[k].fill(0);
+    for (int i = 0; i < NCoefficients(k); i++)
+      for (int j = 0; j < NVariables(k); j++)
+        fMaxPowers[k][j] = std::max(fMaxPowers[k][j], int(Powers(k)[i * NVariables(k) + j]));
+    grid.n_vars = NVariables(k);
+    if (grid.n_vars <= 0) continue;
+    // Tabulate at the nodes x_min + i*(x_max - x_min)/n
+    double step[kMaxVariables] = {0, 0};
+    for (int v = 0; v < kMaxVariables; v++) {
+      grid.n[v] = v < grid.n_vars ? kMDFGridIntervals[grid.n_vars - 1] : 0;
+      grid.x_min[v] = XMin(k)[v];
+      grid.x_max[v] = XMax(k)[v];
+      if (grid.n[v]) step[v] = (grid.x_max[v] - grid.x_min[v])/grid.n[v];
+    }
+    grid.values.reserve((grid.n[0] + 1)*(grid.n[1] + 1));
+    double x[kMaxVariables];
+    for (int j = 0; j <= grid.n[1]; j++) {
+      x[1] = grid.x_min[1] + step[1]*j;
+      for (int i = 0; i <= grid.n[0]; i++) {
+        x[0] = grid.x_min[0] + step[0]*i;
+        grid.values.push_back(EvalPolynomial(k, x));
+      }
+    }
+  }
 }
 
 
-St_MDFCorrectionC::~St_MDFCorrectionC() {
-  unsigned int N = GetNRows();
-  for (unsigned int i = 0; i < N; i++) {SafeDelete(fFunc[i]);}
-  delete [] fFunc;
+void St_MDFCorrectionC::EvalBasis(int k, int j, double y, double *basis) const {
+  // The basis function with power p at y, p = 1 is the constant
+  basis[0] = 0;
+  basis[1] = 1;
+  basis[2] = y;
+  double p1 = 1;
+  double p2 = y;
+  for (int i = 3; i <= fMaxPowers[k][j]; i++) {
+    double p3 = p2 * y;
+    if (PolyType(k) == kLegendre)
+      p3 = ((2 * i - 3) * p2 * y - (i - 2) * p1) / (i - 1);
+    else if (PolyType(k) == kChebyshev)
+      p3 = 2 * y * p2 - p1;
+    p1 = p2;
+    p2 = p3;
+    basis[i] = p3;
+  }
 }
 
 
-double St_MDFCorrectionC::MDFunc(double *x, double *p) {
-  // Evaluate parameterization at point x. Optional argument coeff is
-  // a vector of coefficients for the parameterisation, NCoefficients
-  // elements long.
+double St_MDFCorrectionC::EvalPolynomial(int k, const double *x) const {
+  // Evaluate parameterization at point x
   assert(x);
-  unsigned int k = p[0];
-  assert(k >= 0 && k < fgMDFCorrectionC->GetNRows());
-  double returnValue = fgMDFCorrectionC->DMean(k);
-  double term        = 0;
-  unsigned char    i, j;
-  for (i = 0; i < fgMDFCorrectionC->NCoefficients(k); i++) {
+  if (NVariables(k) > kMaxVariables) return 0;
+  double basis[kMaxVariables][256];
+  for (int j = 0; j < NVariables(k); j++) {
+    double y = 1 + 2. / (XMax(k)[j] - XMin(k)[j]) * (x[j] - XMax(k)[j]);
+    EvalBasis(k, j, y, basis[j]);
+  }
+  double returnValue = DMean(k);
+  for (int i = 0; i < NCoefficients(k); i++) {
     // Evaluate the ith term in the expansion
-    term = fgMDFCorrectionC->Coefficients(k)[i];
-    for (j = 0; j < fgMDFCorrectionC->NVariables(k); j++) {
-      // Evaluate the factor (polynomial) in the j-th variable.
-      int    p  =  fgMDFCorrectionC->Powers(k)[i * fgMDFCorrectionC->NVariables(k) + j];
-      double y  =  1 + 2. / (fgMDFCorrectionC->XMax(k)[j] - fgMDFCorrectionC->XMin(k)[j])
-	* (x[j] - fgMDFCorrectionC->XMax(k)[j]);
-      term        *= fgMDFCorrectionC->EvalFactor(k,p,y);
-    }
+    double term = Coefficients(k)[i];
+    for (int j = 0; j < NVariables(k); j++)
+      term *= basis[j][Powers(k)[i * NVariables(k) + j]];
     // Add this term to the final result
     returnValue += term;
   }
@@ -226,7 +262,6 @@ double St_MDFCorrectionC::MDFunc(double *x, double *p) {
 }
 
 
-
 double St_MDFCorrectionC::Eval(int k, double x0, double x1) const {
   double x[2] = {x0, x1};
   return Eval(k,x);
@@ -234,94 +269,57 @@ double St_MDFCorrectionC::Eval(int k, double x0, double x1) const {
 
 
 double St_MDFCorrectionC::Eval(int k, double *x) const {
-  // Evaluate parameterization at point x. Optional argument coeff is
-  // a vector of coefficients for the parameterisation, NCoefficients
-  // elements long.
+  // Interpolate the tabulated parameterization at point x
   assert(x);
-  if (! fFunc[k]) {
-    fgMDFCorrectionC = (St_MDFCorrectionC *) this;
-    if (NVariables(k) <= 0) {
-      return 0;
-    } else if (NVariables(k) == 1) {
-      fFunc[k] = new TF1(Form("%s_%i",GetName().c_str(),k),St_MDFCorrectionC::MDFunc,
-			 XMin(k)[0],XMax(k)[0],1);
-      fFunc[k]->SetParameter(0,k);
-      fFunc[k]->Save(XMin(k)[0],XMax(k)[0],0,0,0,0);
-    } else if (NVariables(k) == 2) {
-      fFunc[k] = new TF2(Form("%s_%i",GetName().c_str(),k),St_MDFCorrectionC::MDFunc,
-			 XMin(k)[0],XMax(k)[0],XMin(k)[1],XMax(k)[1],1);
-      fFunc[k]->SetParameter(0,k);
-      ((TF2 *) fFunc[k])->Save(XMin(k)[0],XMax(k)[0],XMin(k)[1],XMax(k)[1],0,0);
-    } else if (NVariables(k) == 3) {
-      fFunc[k] = new TF3(Form("%s_%i",GetName().c_str(),k),St_MDFCorrectionC::MDFunc,
-			 XMin(k)[0],XMax(k)[0],XMin(k)[1],XMax(k)[1],XMin(k)[2],XMax(k)[2],1);
-      fFunc[k]->SetParameter(0,k);
-      ((TF3 *) fFunc[k])->Save(XMin(k)[0],XMax(k)[0],XMin(k)[1],XMax(k)[1],XMin(k)[2],XMax(k)[2]);
-    }
-  }
-  double xx[3];
-  for (int v = 0; v < NVariables(k); v++) {
+  const Grid &grid = fGrids[k];
+  if (grid.n_vars <= 0) return 0;
+  double xx[kMaxVariables];
+  double dx[kMaxVariables];
+  int bin[kMaxVariables];
+  for (int v = 0; v < grid.n_vars; v++) {
     xx[v] = std::max(XMin(k)[v], std::min(XMin(k)[v]+0.999*(XMax(k)[v]-XMin(k)[v]), x[v]));
+    dx[v] = (grid.x_max[v] - grid.x_min[v])/grid.n[v];
+    if (!(dx[v] > 0)) return 0;
+    bin[v] = std::min(grid.n[v] - 1, int((xx[v] - grid.x_min[v])/dx[v]));
   }
-  return fFunc[k]->GetSave(xx);
+  const double *values = grid.values.data();
+  if (grid.n_vars == 1) {
+    double xlow = grid.x_min[0] + bin[0]*dx[0];
+    double xup  = xlow + dx[0];
+    double ylow = values[bin[0]];
+    double yup  = values[bin[0] + 1];
+    return ((xup*ylow - xlow*yup) + xx[0]*(yup - ylow))/dx[0];
+  }
+  // Bilinear interpolation between the four nodes surrounding x
+  double t = (xx[0] - (grid.x_min[0] + bin[0]*dx[0]))/dx[0];
+  double u = (xx[1] - (grid.x_min[1] + bin[1]*dx[1]))/dx[1];
+  int k1 = bin[1]*(grid.n[0] + 1) + bin[0];
+  int k4 = k1 + grid.n[0] + 1;
+  return (1-t)*(1-u)*values[k1] + t*(1-u)*values[k1 + 1] + t*u*values[k4 + 1] + (1-t)*u*values[k4];
 }
 
 
 double St_MDFCorrectionC::EvalError(int k, double *x) const {
-  // Evaluate parameterization error at point x. Optional argument coeff is
-  // a vector of coefficients for the parameterisation, NCoefficients(k)
-  // elements long.
+  // Evaluate parameterization error at point x
   assert(x);
+  if (NVariables(k) > kMaxVariables) return 0;
+  double basis[kMaxVariables][256];
+  for (int j = 0; j < NVariables(k); j++) {
+    double y = 1 + 2. / (XMax(k)[j] - XMin(k)[j]) * (x[j] - XMax(k)[j]);
+    EvalBasis(k, j, y, basis[j]);
+  }
   double returnValue = 0;
-  double term        = 0;
-  unsigned char    i, j;
-  for (i = 0; i < NCoefficients(k); i++) {
+  for (int i = 0; i < NCoefficients(k); i++) {
     // Evaluate the ith term in the expansion
-    term = CoefficientsRMS(k)[i];
-    for (j = 0; j < NVariables(k); j++) {
-      // Evaluate the factor (polynomial) in the j-th variable.
-      int    p  =  Powers(k)[i * NVariables(k) + j];
-      double y  =  1 + 2. / (XMax(k)[j] - XMin(k)[j]) * (x[j] - XMax(k)[j]);
-      term     *= EvalFactor(p,y);
-    }
+    double term = CoefficientsRMS(k)[i];
+    for (int j = 0; j < NVariables(k); j++)
+      term *= basis[j][Powers(k)[i * NVariables(k) + j]];
     // Add this term to the final result
     returnValue += term*term;
   }
   return std::sqrt(returnValue);
 }
 
-
-double St_MDFCorrectionC::EvalFactor(int k, int p, double x) const {
-  // Evaluate function with power p at variable value x
-  int    i   = 0;
-  double p1  = 1;
-  double p2  = 0;
-  double p3  = 0;
-  double r   = 0;
-
-  switch(p) {
-  case 1:
-    r = 1;
-    break;
-  case 2:
-    r =  x;
-    break;
-  default:
-    p2 = x;
-    for (i = 3; i <= p; i++) {
-      p3 = p2 * x;
-      if (PolyType(k) == kLegendre)
-	p3 = ((2 * i - 3) * p2 * x - (i - 2) * p1) / (i - 1);
-      else if (PolyType(k) == kChebyshev)
-	p3 = 2 * x * p2 - p1;
-      p1 = p2;
-      p2 = p3;
-    }
-    r = p3;
-  }
-  return r;
-}
-
 MakeChairInstance(tpcAnodeHV,Calibrations/tpc/tpcAnodeHV);
 
 void  St_tpcAnodeHVC::sockets(int sector, int padrow, int &e1, int &e2, float &f2) {
@@ -548,27 +546,7 @@ double St_spaceChargeCorC::getSpaceChargeCoulombs(const tpcrs::Configurator& cfg
     double coulombs = 0;
 
     for (int row=0;row< (int) GetNRows();row++) {
-      double mult = 0;
-      switch ((int) getSpaceChargeDetector(row)) {
-        case (0) : mult = scalers.mult; break; // vpdx as of 2007-12-19
-        case (1) : mult = scalers.bbcX; break;
-        case (2) : mult = scalers.zdcX; break;
-        case (3) : mult = scalers.zdcEast + scalers.zdcWest; break;
-        case (4) : mult = scalers.bbcEast + scalers.bbcWest; break;
-        case (5) : mult = scalers.zdcEast; break;
-        case (6) : mult = scalers.zdcWest; break;
-        case (7) : mult = scalers.bbcEast; break;
-        case (8) : mult = scalers.bbcWest; break;
-        case (9) : mult = scalers.bbcYellowBkg; break;
-        case (10): mult = scalers.bbcBlueBkg; break;
-        case (11): mult = scalers.pvpdEast; break;
-        case (12): mult = scalers.pvpdWest; break;
-        case (13): mult = scalers.ctbTOFp; break; // zdcx-no-killer as of 2011
-        case (14): mult = scalers.ctbEast; break; // zdce-no-killer as of 2011
-        case (15): mult = scalers.ctbWest; break; // zdcw-no-killer as of 2011
-
-        default  : mult = 0.;
-      }
+      double mult = tpcrs::ScalerRate(scalers, (int) getSpaceChargeDetector(row));
       if (mult < 0) {
         is_missing = true;
         return 0; // Unphysical scaler rates will be uncorrected
@@ -594,6 +572,30 @@ double St_spaceChargeCorC::getSpaceChargeCoulombs(const tpcrs::Configurator& cfg
 
 namespace tpcrs {
 
+double ScalerRate(const trigDetSums& scalers, int detector)
+{
+  switch (detector) {
+    case (0) : return scalers.mult; // vpdx as of 2007-12-19
+    case (1) : return scalers.bbcX;
+    case (2) : return scalers.zdcX;
+    case (3) : return scalers.zdcEast + scalers.zdcWest;
+    case (4) : return scalers.bbcEast + scalers.bbcWest;
+    case (5) : return scalers.zdcEast;
+    case (6) : return scalers.zdcWest;
+    case (7) : return scalers.bbcEast;
+    case (8) : return scalers.bbcWest;
+    case (9) : return scalers.bbcYellowBkg;
+    case (10): return scalers.bbcBlueBkg;
+    case (11): return scalers.pvpdEast;
+    case (12): return scalers.pvpdWest;
+    case (13): return scalers.ctbTOFp; // zdcx-no-killer as of 2011
+    case (14): return scalers.ctbEast; // zdce-no-killer as of 2011
+    case (15): return scalers.ctbWest; // zdcw-no-killer as of 2011
+    default  : return 0;
+  }
+}
+
+
 int ChannelFromRow(int row)
 {
     if (row <  3) return 1;
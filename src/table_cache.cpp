@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "tpcrs/detail/table_cache.h"
+#include "logger.h"
+
+
+namespace tpcrs { namespace detail {
+
+namespace {
+
+const char kMagic[8] = {'T', 'P', 'C', 'R', 'S', 'T', 'B', 'L'};
+
+/// The values follow the header. Its size keeps them aligned
+struct Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t value_size;
+  uint64_t key;
+  uint64_t n_values;
+};
+
+}
+
+
+TableCache::TableCache(const std::string& path, uint64_t key) :
+  file_(new MappedFile(path)),
+  data_(nullptr),
+  size_(0),
+  position_(0)
+{
+  if (file_->size() < sizeof(Header)) return;
+
+  const Header& header = *reinterpret_cast<const Header*>(file_->data());
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.value_size != sizeof(double) ||
+      header.key != key ||
+      header.n_values != (file_->size() - sizeof(Header)) / sizeof(double))
+  {
+    LOG_WARN << "Ignoring stale table cache " << path << '\n';
+    return;
+  }
+
+  data_ = reinterpret_cast<const double*>(file_->data() + sizeof(Header));
+  size_ = header.n_values;
+}
+
+
+const double* TableCache::Read(size_t n)
+{
+  if (!data_ || n > size_ - position_) return nullptr;
+
+  const double* values = data_ + position_;
+  position_ += n;
+  return values;
+}
+
+
+bool TableCache::Read(double& x)
+{
+  const double* value = Read(1);
+
+  if (value) x = *value;
+
+  return value != nullptr;
+}
+
+
+bool TableCache::Write(const std::string& path, uint64_t key, const std::vector<double>& values)
+{
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.value_size = sizeof(double);
+  header.key = key;
+  header.n_values = values.size();
+
+  // Write to a temporary file and rename it so that concurrent readers never
+  // see a partially written file
+  std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+  FILE* file = std::fopen(tmp_path.c_str(), "wb");
+
+  if (!file) {
+    LOG_WARN << "Cannot create table cache " << tmp_path << '\n';
+    return false;
+  }
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(values.data(), sizeof(double), values.size(), file) == values.size();
+  ok = std::fclose(file) == 0 && ok;
+  ok = ok && std::rename(tmp_path.c_str(), path.c_str()) == 0;
+
+  if (!ok) {
+    LOG_WARN << "Cannot write table cache " << path << '\n';
+    std::remove(tmp_path.c_str());
+  }
+
+  return ok;
+}
+
+
+uint64_t TableCache::Hash(const void* bytes, size_t size, uint64_t hash)
+{
+  const unsigned char* byte = static_cast<const unsigned char*>(bytes);
+
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= byte[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+} }
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/tpcrs_core.h"
+#include "tpcrs/detail/coords.h"
+#include "tpcrs/detail/derived_geometry.h"
+
+
+namespace tpcrs { namespace test {
+
+/// Returns straight tracks crossing every pad row of a few sectors with one
+/// hit per row
+inline std::vector<tpcrs::SimulatedHit> GenerateHits(const tpcrs::Configurator& cfg)
+{
+  auto geom = std::make_shared<const tpcrs::detail::DerivedGeometry>(cfg);
+  CoordTransform transform(cfg, geom);
+
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+
+  std::vector<tpcrs::SimulatedHit> hits;
+
+  for (int track_id = 1; track_id <= 20; track_id++) {
+    int sector = 1 + gen() % 24;
+    double x0 = 10 * uniform(gen), dxdy = 0.2 * uniform(gen);
+    double z0 = 100 + 60 * uniform(gen), dzdy = 0.2 * uniform(gen);
+
+    std::vector<StGlobalCoordinate> points(geom->n_rows());
+
+    for (int row = 1; row <= geom->n_rows(); row++) {
+      double dy = geom->radius(row) - geom->radius(1);
+      StTpcLocalSectorCoordinate coorS{{x0 + dxdy * dy, geom->radius(row), z0 + dzdy * dy}, sector, row};
+      StTpcLocalCoordinate coorLT;
+      transform.local_sector_to_local(coorS, coorLT);
+      transform.local_to_global(coorLT, points[row - 1]);
+    }
+
+    double s = 0;
+
+    for (int row = 1; row <= geom->n_rows(); row++) {
+      const Coords& p = points[row - 1].position;
+      const Coords& q = points[row < geom->n_rows() ? row : row - 2].position;
+
+      // Unit vector along the track
+      double d[3] = {q.x - p.x, q.y - p.y, q.z - p.z};
+      double ds = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+      double sign = row < geom->n_rows() ? 1 : -1;
+
+      s += row > 1 ? ds : geom->radius(1);
+
+      // A 1 GeV/c pi+ losing about 2.5 keV/cm
+      hits.push_back(tpcrs::SimulatedHit{
+        track_id, 8, 100 * sector + row,
+        p.x, p.y, p.z,
+        sign * d[0] / ds, sign * d[1] / ds, sign * d[2] / ds,
+        2.5e-6 * ds, ds, s, s / 3e10, 0.8f
+      });
+    }
+  }
+
+  return hits;
+}
+
+
+/// Returns the number of digitized hits that differ between a and b
+inline int CountDifferences(const std::vector<tpcrs::DigiHit>& a, const std::vector<tpcrs::DigiHit>& b)
+{
+  if (a.size() != b.size()) {
+    std::cerr << "Different number of digitized hits: " << a.size() << " vs " << b.size() << '\n';
+    return 1;
+  }
+
+  int failed = 0;
+
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!(a[i].channel == b[i].channel) || a[i].adc != b[i].adc || a[i].track_id != b[i].track_id) {
+      if (failed++ < 10)
+        std::cerr << "Mismatch at " << i << ": " << a[i] << " vs " << b[i] << '\n';
+    }
+  }
+
+  return failed;
+}
+
+} }
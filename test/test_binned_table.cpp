@@ -0,0 +1,77 @@
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include "TH1.h"
+#include "TRandom3.h"
+
+#include "tpcrs/detail/binned_table.h"
+
+using tpcrs::detail::AliasTable;
+using tpcrs::detail::BinnedTable;
+
+
+/**
+ * Compares the bin frequencies of the alias and the cumulative sampling of a
+ * small table with the expected probabilities, and checks that a table
+ * without positive content is rejected.
+ */
+int main()
+{
+  const int n_bins = 5;
+  const double contents[n_bins] = {1, 0, 4, 2.5, 0.5};
+  const double total = 8;
+
+  TH1D hist("hist", "", n_bins, 0, n_bins);
+  hist.SetDirectory(nullptr);
+
+  for (int i = 0; i < n_bins; i++)
+    hist.SetBinContent(i + 1, contents[i]);
+
+  BinnedTable table(hist);
+  AliasTable alias(table);
+
+  const int n_samples = 1000000;
+  int cdf_counts[n_bins] = {}, alias_counts[n_bins] = {};
+  TRandom3 random(1);
+
+  int failed = 0;
+
+  for (int i = 0; i < n_samples; i++) {
+    double x_cdf = table.GetRandom(random);
+    double x_alias = alias.GetRandom(random);
+
+    if (x_cdf < 0 || x_cdf >= n_bins || x_alias < 0 || x_alias >= n_bins) {
+      std::cerr << "Sample outside of the table range\n";
+      return failed + 1;
+    }
+
+    cdf_counts[static_cast<int>(x_cdf)]++;
+    alias_counts[static_cast<int>(x_alias)]++;
+  }
+
+  for (int i = 0; i < n_bins; i++) {
+    double p = contents[i] / total;
+    // Allow five standard deviations of the binomial count
+    double tolerance = 5 * std::sqrt(n_samples * p * (1 - p)) + 1e-9;
+
+    if (std::abs(cdf_counts[i] - n_samples * p) > tolerance ||
+        std::abs(alias_counts[i] - n_samples * p) > tolerance) {
+      std::cerr << "Bin " << i << ": expected " << n_samples * p << ", CDF " << cdf_counts[i]
+                << ", alias " << alias_counts[i] << '\n';
+      failed++;
+    }
+  }
+
+  TH1D empty("empty", "", n_bins, 0, n_bins);
+  empty.SetDirectory(nullptr);
+
+  try {
+    AliasTable rejected{BinnedTable(empty)};
+    std::cerr << "An alias table without positive content was accepted\n";
+    failed++;
+  }
+  catch (const std::runtime_error&) {}
+
+  return failed;
+}
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "tpcrs/detail/charge_accumulator.h"
+#include "tpcrs/detail/cpu_features.h"
+
+using namespace tpcrs::detail;
+
+
+/**
+ * Deposits the same random charges with the vectorized and the scalar kernels
+ * and checks that the accumulated charges and track ids are identical.
+ */
+int main()
+{
+  const int n_pads = 40;
+  const int n_timebins = 400;
+
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  struct Deposit {
+    int pad_index;
+    int timebin;
+    std::vector<double> pad_couplings;
+    std::vector<double> time_couplings;
+    short track_id;
+  };
+
+  std::vector<Deposit> deposits;
+
+  for (int i = 0; i < 500; i++) {
+    Deposit d;
+    d.pad_index = gen() % (n_pads - 5);
+    d.timebin = gen() % (n_timebins - 30);
+    d.pad_couplings.resize(1 + gen() % 5);
+    d.time_couplings.resize(1 + gen() % 30);
+    d.track_id = 1 + gen() % 5;
+    for (double& c : d.pad_couplings) c = uniform(gen) * 100;
+    for (double& c : d.time_couplings) c = uniform(gen);
+    deposits.push_back(d);
+  }
+
+  auto accumulate = [&](Simd simd)
+  {
+    SetMaxSimd(simd);
+
+    ChargeAccumulator charges;
+    charges.Reset(n_pads, n_timebins);
+
+    for (const Deposit& d : deposits) {
+      charges.Deposit(d.pad_index, d.pad_couplings.size(), d.pad_couplings.data(),
+                      d.timebin, d.time_couplings.size(), d.time_couplings.data(), 0.5, d.track_id);
+    }
+
+    return charges;
+  };
+
+  ChargeAccumulator scalar = accumulate(Simd::kScalar);
+  ChargeAccumulator vector = accumulate(Simd::kAvx512);
+
+  std::cout << "AVX2: " << HasAvx2() << ", AVX-512: " << HasAvx512() << '\n';
+
+  int failed = 0;
+
+  for (int pad = 0; pad < n_pads; pad++) {
+    for (int tb = 0; tb < n_timebins; tb++) {
+      tpcrs::SimulatedCharge a = scalar.Get(pad, tb);
+      tpcrs::SimulatedCharge b = vector.Get(pad, tb);
+
+      if (a.charge != b.charge || a.track_id != b.track_id) {
+        if (failed++ < 10)
+          std::cerr << "Mismatch at pad " << pad << ", timebin " << tb << ": "
+                    << a.charge << " (" << a.track_id << ") vs " << b.charge << " (" << b.track_id << ")\n";
+      }
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,148 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/detail/struct_containers.h"
+
+using tpcrs::Configurator;
+using tpcrs::TypeList;
+
+
+namespace {
+
+/// Returns the number of structs with different rows in a and b
+template<typename... Structs>
+int CountDifferentStructs(const char* what, const Configurator& a, const Configurator& b, TypeList<Structs...>)
+{
+  bool same[] = {a.Same<Structs>(b)...};
+  std::string names[] = {tpcrs::ConfigNodeName<Structs>()...};
+
+  int failed = 0;
+
+  for (size_t i = 0; i < sizeof...(Structs); i++) {
+    if (!same[i]) {
+      std::cerr << what << ": " << names[i] << " differs\n";
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+
+/// Returns the number of chairs with different rows or status in a and b
+template<typename... Chairs>
+int CountDifferentChairs(const char* what, const Configurator& a, const Configurator& b, TypeList<Chairs...>)
+{
+  bool same[] = {a.Same<Chairs>(b) && a.C<Chairs>().is_missing == b.C<Chairs>().is_missing &&
+                 a.C<Chairs>().GetNRows() == b.C<Chairs>().GetNRows()...};
+  std::string names[] = {Chairs::name...};
+
+  int failed = 0;
+
+  for (size_t i = 0; i < sizeof...(Chairs); i++) {
+    if (!same[i]) {
+      std::cerr << what << ": " << names[i] << " differs\n";
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+
+int CountDifferences(const char* what, const Configurator& a, const Configurator& b)
+{
+  return CountDifferentStructs(what, a, b, tpcrs::ConfigStructTypes()) +
+         CountDifferentChairs(what, a, b, tpcrs::ConfigChairTypes());
+}
+
+
+/// Returns 1 if the overlay does not share the chair with the base as expected
+template<typename Chair>
+int CheckSharedChair(const Configurator& overlay, const Configurator& base, bool expected)
+{
+  if ((&overlay.C<Chair>() == &base.C<Chair>()) == expected) return 0;
+
+  std::cerr << "Overlay: " << Chair::name << (expected ? " is not shared" : " is shared") << " with the base\n";
+  return 1;
+}
+
+}
+
+
+/**
+ * Checks that a configuration read from a snapshot has the same rows in every
+ * struct and chair as the yaml configuration it was written from, and that an
+ * overlay has the same rows as a single configuration with the replaced
+ * nodes. The overlay must share the chairs of the other nodes with the base.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+  const std::string snapshot = "test_configurator.bin";
+
+  Configurator cfg(cfgname);
+
+  if (!cfg.WriteSnapshot(snapshot)) {
+    std::cerr << "Cannot write " << snapshot << '\n';
+    return 1;
+  }
+
+  int failed = 0;
+
+  {
+    Configurator mapped(cfgname, snapshot);
+    failed += CountDifferences("Snapshot", cfg, mapped);
+  }
+
+  // Replace a struct, a struct read by the space charge chairs, and a chair
+  YAML::Node delta;
+
+  tpcHighVoltages hv = cfg.S<tpcHighVoltages>();
+  hv.cathode += 1;
+  delta[tpcrs::ConfigNodeName<tpcHighVoltages>()] = hv;
+
+  trigDetSums scalers = cfg.S<trigDetSums>();
+  scalers.zdcX = 2 * scalers.zdcX + 1;
+  delta[tpcrs::ConfigNodeName<trigDetSums>()] = scalers;
+
+  tpcGridLeak grid_leak = *cfg.C<St_tpcGridLeakC>().Struct();
+  grid_leak.MiddlGLStrength += 1;
+  delta[St_tpcGridLeakC::name] = grid_leak;
+
+  YAML::Node merged = YAML::LoadFile(cfg.Locate(cfgname + ".yaml"));
+
+  for (const auto& node : delta)
+    merged[node.first.as<std::string>()] = node.second;
+
+  const std::string delta_file = "test_configurator_delta.yaml";
+  const std::string merged_file = "test_configurator_merged.yaml";
+  std::ofstream(delta_file) << delta;
+  std::ofstream(merged_file) << merged;
+
+  Configurator single(cfgname, merged_file);
+
+  for (const std::string& base_file : {std::string(), snapshot}) {
+    std::shared_ptr<const Configurator> base(new Configurator(cfgname, base_file));
+    Configurator overlay(base, cfgname, delta_file);
+
+    failed += CountDifferences("Overlay", single, overlay);
+
+    failed += CheckSharedChair<St_TpcEdgeC>(overlay, *base, true);
+    failed += CheckSharedChair<StTpcOuterSectorPosition>(overlay, *base, true);
+    failed += CheckSharedChair<St_TpcAvgCurrentC>(overlay, *base, true);
+    failed += CheckSharedChair<St_tpcGridLeakC>(overlay, *base, false);
+    failed += CheckSharedChair<St_spaceChargeCorR1C>(overlay, *base, false);
+    failed += CheckSharedChair<St_spaceChargeCorR2C>(overlay, *base, false);
+  }
+
+  std::remove(snapshot.c_str());
+  std::remove(delta_file.c_str());
+  std::remove(merged_file.c_str());
+
+  return failed;
+}
@@ -0,0 +1,135 @@
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/detail/coords.h"
+#include "tpcrs/detail/cpu_features.h"
+#include "tpcrs/detail/derived_geometry.h"
+
+using namespace tpcrs::detail;
+
+
+namespace {
+
+bool Identical(const Coords& a, const Coords& b)
+{
+  return std::memcmp(a.xyz(), b.xyz(), 3 * sizeof(double)) == 0;
+}
+
+
+template<typename Coordinate>
+int CountMismatches(const char* name, const std::vector<Coordinate>& a, const std::vector<Coordinate>& b)
+{
+  int failed = 0;
+
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!Identical(a[i].position, b[i].position)) {
+      if (failed++ < 10)
+        std::cerr << name << ": Mismatch at " << i << ": (" << a[i].position.x << ", " << a[i].position.y << ", "
+                  << a[i].position.z << ") vs (" << b[i].position.x << ", " << b[i].position.y << ", "
+                  << b[i].position.z << ")\n";
+    }
+  }
+
+  return failed;
+}
+
+}
+
+
+/**
+ * Converts random points between the local sector, the TPC local, and the
+ * global coordinates with the batch functions using the vectorized and the
+ * scalar kernels and with the single point functions. All results must be
+ * identical.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  tpcrs::Configurator cfg(cfgname);
+  auto geom = std::make_shared<const DerivedGeometry>(cfg);
+  CoordTransform transform(cfg, geom);
+
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+
+  std::vector<StTpcLocalSectorCoordinate> points;
+
+  for (int i = 0; i < 1000; i++) {
+    int sector = 1 + gen() % 24;
+    int row = 1 + gen() % geom->n_rows();
+    Coords position{30 * uniform(gen), geom->radius(row) + 0.5 * uniform(gen), 100 + 100 * uniform(gen)};
+
+    // The row of every fourth point is found from y
+    points.push_back(StTpcLocalSectorCoordinate{position, sector, i % 4 ? row : 0});
+  }
+
+  size_t n = points.size();
+
+  struct Results {
+    std::vector<StTpcLocalCoordinate> local;
+    std::vector<StGlobalCoordinate> global;
+    std::vector<StTpcLocalCoordinate> local_back;
+    std::vector<StTpcLocalSectorCoordinate> sector_back;
+  };
+
+  auto convert = [&](Simd simd)
+  {
+    SetMaxSimd(simd);
+
+    Results r{std::vector<StTpcLocalCoordinate>(n), std::vector<StGlobalCoordinate>(n),
+              std::vector<StTpcLocalCoordinate>(n), std::vector<StTpcLocalSectorCoordinate>(n)};
+
+    transform.local_sector_to_local(points.data(), r.local.data(), n);
+    transform.local_to_global(r.local.data(), r.global.data(), n);
+    transform.global_to_local(r.global.data(), r.local_back.data(), n);
+
+    // The batch global_to_local does not set the sector and row
+    for (size_t i = 0; i < n; i++) {
+      r.local_back[i].sector = r.local[i].sector;
+      r.local_back[i].row = r.local[i].row;
+    }
+
+    transform.local_to_local_sector(r.local_back.data(), r.sector_back.data(), n);
+
+    return r;
+  };
+
+  Results scalar = convert(Simd::kScalar);
+  Results vector = convert(Simd::kAvx512);
+
+  std::cout << "AVX2: " << HasAvx2() << ", AVX-512: " << HasAvx512() << '\n';
+
+  Results single{std::vector<StTpcLocalCoordinate>(n), std::vector<StGlobalCoordinate>(n),
+                 std::vector<StTpcLocalCoordinate>(n), std::vector<StTpcLocalSectorCoordinate>(n)};
+
+  for (size_t i = 0; i < n; i++) {
+    transform.local_sector_to_local(points[i], single.local[i]);
+    transform.local_to_global(single.local[i], single.global[i]);
+    transform.global_to_local(single.global[i], single.local_back[i], single.local[i].sector, single.local[i].row);
+    transform.local_to_local_sector(single.local_back[i], single.sector_back[i]);
+  }
+
+  int failed = 0;
+
+  for (const Results* r : {&vector, &single}) {
+    failed += CountMismatches("local_sector_to_local", scalar.local, r->local);
+    failed += CountMismatches("local_to_global", scalar.global, r->global);
+    failed += CountMismatches("global_to_local", scalar.local_back, r->local_back);
+    failed += CountMismatches("local_to_local_sector", scalar.sector_back, r->sector_back);
+
+    for (size_t i = 0; i < n; i++) {
+      if (scalar.local[i].row != r->local[i].row || scalar.sector_back[i].row != r->sector_back[i].row) {
+        std::cerr << "Different rows at " << i << '\n';
+        failed++;
+      }
+    }
+  }
+
+  return failed;
+}
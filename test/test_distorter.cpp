@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/detail/distorter.h"
+#include "tpcrs/detail/mag_field.h"
+
+using tpcrs::Configurator;
+using tpcrs::detail::Distorter;
+using tpcrs::detail::MagField;
+using Distortions = Distorter::Distortions;
+
+
+namespace {
+
+/// Vacuum permittivity in F/cm
+const double kEpsilon0 = 8.854187817e-14;
+
+const double kInnerRadius = 46.6;
+const double kOuterRadius = 200;
+const double kCathode = 27.95;
+const double kGatedGrid = -115;
+const double kPadPlaneZ = 209.3;
+const double kGatingGridPadSep = 0.6;
+
+const int kFieldCageRings = 182;
+const double kRingResistance = 2.0;
+
+
+/**
+ * Writes a configuration with the drift volume and the static distortions.
+ * Without a nominal magnetic field the electrons are displaced only radially
+ * by the static distortions.
+ */
+void WriteConfig(const std::string& filename, double nominal_magnetic_field)
+{
+  YAML::Node root;
+
+  tpcHighVoltages hv{}; hv.cathode = kCathode; hv.gatedGridRef = kGatedGrid;
+  tpcOmegaTau ot{}; ot.tensorV1 = 1.35; ot.tensorV2 = 1.1;
+  tpcDriftVelocity dv{}; dv.laserDriftVelocityEast = dv.laserDriftVelocityWest = 5.55;
+  tpcPadPlanes pp{}; pp.outerSectorPadPlaneZ = kPadPlaneZ;
+  tpcWirePlanes wp{}; wp.outerSectorGatingGridPadSep = kGatingGridPadSep;
+  ResponseSimulator rs{}; rs.nominal_magnetic_field = nominal_magnetic_field;
+  tpcDimensions dims{}; dims.tpcInnerRadius = kInnerRadius; dims.tpcOuterRadius = kOuterRadius;
+  MagFactor mf{}; mf.ScaleFactor = 1;
+  trigDetSums ts{}; ts.zdcX = 1e4;
+
+  spaceChargeCor sc{}; sc.fullFieldA = 1e-18; sc.satRate = 1e9; sc.factor = 1; sc.detector = 2; sc.ewratio = 1.1;
+
+  tpcGridLeak gl{};
+  gl.InnerGLRadius = 53; gl.MiddlGLRadius = 121.8; gl.OuterGLRadius = 195;
+  gl.InnerGLWidth = gl.MiddlGLWidth = gl.OuterGLWidth = 3;
+  gl.MiddlGLStrength = 15;
+
+  tpcFieldCageShort fs{}; fs.side = 1; fs.cage = 1; fs.ring = 169.5; fs.resistor = 0; fs.MissingResistance = 2;
+
+  root[tpcrs::ConfigNodeName<tpcHighVoltages>()] = hv;
+  root[tpcrs::ConfigNodeName<tpcOmegaTau>()] = ot;
+  root[tpcrs::ConfigNodeName<tpcDriftVelocity>()] = dv;
+  root[tpcrs::ConfigNodeName<tpcPadPlanes>()] = pp;
+  root[tpcrs::ConfigNodeName<tpcWirePlanes>()] = wp;
+  root[tpcrs::ConfigNodeName<ResponseSimulator>()] = rs;
+  root[tpcrs::ConfigNodeName<tpcDimensions>()] = dims;
+  root[tpcrs::ConfigNodeName<MagFactor>()] = mf;
+  root[tpcrs::ConfigNodeName<trigDetSums>()] = ts;
+  root["Calibrations/rich/spaceChargeCor"] = sc;
+  root["Calibrations/rich/spaceChargeCorR2"] = sc;
+  root["Calibrations/tpc/tpcGridLeak"] = gl;
+  root["Geometry/tpc/tpcFieldCageShort"] = fs;
+
+  std::ofstream(filename) << root;
+}
+
+
+/**
+ * Reference radial displacement of an electron drifting from (r, z) to the
+ * readout plane at z = L in the field of a potential V added to the nominal
+ * one. V solves (1/r) d/dr (r dV/dr) + d^2V/dz^2 = -rho(r)/eps0 with V = 0 at
+ * z = 0 and L and the given potentials at the field cages. V is expanded in
+ * sin(k_n z), and every radial mode is solved by finite differences on a grid
+ * much finer than the one of the Distorter. An electron moves against the
+ * field, so the displacement is -∫_z^L E_r / E_0 dz with E_r = -dV/dr.
+ */
+class Reference
+{
+ public:
+
+  Reference(std::function<double(double)> rho, std::function<double(double)> V_inner,
+            std::function<double(double)> V_outer, double L, double E_0) :
+    L_(L), E_0_(E_0), h_((kOuterRadius - kInnerRadius) / (kRadialNodes - 1)), dVdr_(kModes)
+  {
+    const int n_z = 20000;
+
+    for (int n = 1; n <= kModes; n++) {
+      double k = n * M_PI / L;
+
+      // The sine coefficients of the source uniform in z and of the potentials
+      // at the cages by the midpoint rule
+      double source = 2 * (1 - std::cos(n * M_PI)) / (n * M_PI);
+      double b_inner = 0, b_outer = 0;
+
+      for (int j = 0; j < n_z; j++) {
+        double z = (j + 0.5) * L / n_z;
+        b_inner += 2. / n_z * V_inner(z) * std::sin(k * z);
+        b_outer += 2. / n_z * V_outer(z) * std::sin(k * z);
+      }
+
+      // Thomas algorithm for f'' + f'/r - k^2 f = -source rho(r) / eps0
+      std::vector<double> c(kRadialNodes, 0), d(kRadialNodes, 0), f(kRadialNodes, 0);
+      d[0] = b_inner;
+
+      for (int i = 1; i < kRadialNodes - 1; i++) {
+        double r = kInnerRadius + i * h_;
+        double lower = 1 / (h_ * h_) - 1 / (2 * h_ * r);
+        double upper = 1 / (h_ * h_) + 1 / (2 * h_ * r);
+        double diag = -2 / (h_ * h_) - k * k;
+        double rhs = -source * rho(r) / kEpsilon0;
+
+        double denom = diag - lower * c[i - 1];
+        c[i] = upper / denom;
+        d[i] = (rhs - lower * d[i - 1]) / denom;
+      }
+
+      f[kRadialNodes - 1] = b_outer;
+
+      for (int i = kRadialNodes - 2; i > 0; i--)
+        f[i] = d[i] - c[i] * f[i + 1];
+
+      f[0] = b_inner;
+
+      dVdr_[n - 1].resize(kRadialNodes, 0);
+
+      for (int i = 1; i < kRadialNodes - 1; i++)
+        dVdr_[n - 1][i] = (f[i + 1] - f[i - 1]) / (2 * h_);
+    }
+  }
+
+  double Displacement(double r, double z) const
+  {
+    int i = static_cast<int>((r - kInnerRadius) / h_);
+    double w = (r - kInnerRadius) / h_ - i;
+    double D = 0;
+
+    for (int n = 1; n <= kModes; n++) {
+      double k = n * M_PI / L_;
+      double dVdr = dVdr_[n - 1][i] + w * (dVdr_[n - 1][i + 1] - dVdr_[n - 1][i]);
+      D += dVdr * (std::cos(k * z) - std::cos(k * L_)) / k;
+    }
+
+    return D / E_0_;
+  }
+
+ private:
+
+  static const int kModes = 400;
+  static const int kRadialNodes = 4001;
+
+  double L_;
+  double E_0_;
+  double h_;
+
+  /// dV/dr of every mode on the radial grid
+  std::vector<std::vector<double>> dVdr_;
+};
+
+
+/// Radial displacement of a point at (r, 0, z) in sector 3, which is centered
+/// at phi = 0
+double Displacement(const Distorter& distorter, const MagField& field, double r, double z)
+{
+  Coords p{r, 0, z};
+  return distorter.Distort(p, 3, field).x - r;
+}
+
+
+/**
+ * Compares the radial displacement by the Distorter in the first half of the
+ * TPC with the reference at a few points away from the field cages and the
+ * grid leak sheets. Returns the number of failed checks.
+ */
+int Compare(const char* name, const Distorter& distorter, const MagField& field, const Reference& reference)
+{
+  const double radii[] = {60, 90, 140, 180};
+  const double depths[] = {10, 100, 180};
+
+  double D_max = 0;
+  for (double r : radii)
+    for (double z : depths)
+      D_max = std::max(D_max, std::abs(reference.Displacement(r, z)));
+
+  int failed = 0;
+
+  for (double r : radii) {
+    for (double z : depths) {
+      double D = Displacement(distorter, field, r, z);
+      double D_ref = reference.Displacement(r, z);
+
+      if (std::abs(D - D_ref) > 0.01 * D_max) {
+        std::cerr << name << ": Displacement at r = " << r << ", z = " << z << " is " << D
+                  << " cm instead of " << D_ref << " cm\n";
+        failed++;
+      }
+    }
+  }
+
+  return failed;
+}
+
+
+/// Returns 1 if the displacement at (r, z) is not in the direction of sign
+int CheckDirection(const char* name, const Distorter& distorter, const MagField& field, double r, double z, int sign)
+{
+  if (Displacement(distorter, field, r, z) * sign > 0) return 0;
+
+  std::cerr << name << ": Wrong direction of the displacement at r = " << r << ", z = " << z << '\n';
+  return 1;
+}
+
+
+/**
+ * Compares the distortions interpolated in a table with a step of 2 cm with
+ * the ones integrated for every point. Returns the number of failed checks.
+ */
+int CheckTable(const Configurator& cfg, const MagField& field, Distorter::EnabledDistortions distortions,
+               double max_deviation)
+{
+  Distorter distorter(cfg, distortions);
+  distorter.Tabulate(field, 2.0);
+
+  Distorter::TableAccuracy accuracy = distorter.CheckTable(field, 2000);
+
+  if (!distorter.tabulated() || accuracy.n_points < 1000 || accuracy.max > max_deviation) {
+    std::cerr << "Table: Deviation up to " << accuracy.max << " cm at " << accuracy.n_points << " points\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+}
+
+
+/**
+ * Checks the static distortions against a semi-analytic solution of the
+ * Poisson equation for a uniform space charge, grid leak sheets, and a shorted
+ * ring in the outer field cage, and the tabulated distortions against the
+ * integrated ones.
+ */
+int main()
+{
+  WriteConfig("test_distorter.yaml", 0);
+  WriteConfig("test_distorter_field.yaml", 4.98);
+
+  Configurator cfg("test_distorter", "test_distorter.yaml");
+  MagField field(cfg, MagField::MagFieldType::kConstant, 1.0);
+
+  double L = kPadPlaneZ - kGatingGridPadSep;
+  double E_0 = std::abs(kCathode * 1000 - kGatedGrid) / L;
+
+  auto zero = [](double) { return 0.; };
+
+  int failed = 0;
+
+  // Positive ions between grounded cages attract the electrons toward the
+  // middle of the drift volume
+  {
+    double rho = cfg.C<St_spaceChargeCorR1C>().getSpaceChargeCoulombs();
+    Reference reference([rho](double) { return rho; }, zero, zero, L, E_0);
+    Distorter distorter(cfg, Distorter::EnabledDistortions() | Distortions::kSpaceCharge);
+    failed += Compare("Space charge", distorter, field, reference);
+    failed += CheckDirection("Space charge", distorter, field, 60, 10, +1);
+    failed += CheckDirection("Space charge", distorter, field, 190, 10, -1);
+  }
+
+  // The sheet between the inner and outer sectors attracts the electrons.
+  // Its density is that of the 1/r^2 space charge with the total charge of
+  // the uniform one at its radius times its strength
+  {
+    const tpcGridLeak& gl = *cfg.C<St_tpcGridLeakC>().Struct();
+    double rho = cfg.C<St_spaceChargeCorR2C>().getSpaceChargeCoulombs();
+
+    double total_uniform = (kOuterRadius * kOuterRadius - kInnerRadius * kInnerRadius) / 2;
+    double total_r2 = std::log(kOuterRadius / kInnerRadius);
+    double rho_sheet = rho * total_uniform / total_r2 / (gl.MiddlGLRadius * gl.MiddlGLRadius) * gl.MiddlGLStrength;
+
+    auto sheet = [&gl, rho_sheet](double r) {
+      return std::abs(r - gl.MiddlGLRadius) < gl.MiddlGLWidth / 2 ? rho_sheet : 0.;
+    };
+
+    Reference reference(sheet, zero, zero, L, E_0);
+    Distorter distorter(cfg, Distorter::EnabledDistortions() | Distortions::kGridLeak);
+    failed += Compare("Grid leak", distorter, field, reference);
+    failed += CheckDirection("Grid leak", distorter, field, 110, 10, +1);
+    failed += CheckDirection("Grid leak", distorter, field, 135, 10, -1);
+  }
+
+  // The missing resistance between the shorted ring and the gated grid
+  // raises the potential of the outer cage between the central membrane and
+  // the ring, which attracts the electrons toward the cage
+  {
+    const tpcFieldCageShort& fs = *cfg.C<St_tpcFieldCageShortC>().Struct();
+    double voltage = kGatedGrid + kCathode * 1000;
+    double R_total = kFieldCageRings * kRingResistance - fs.MissingResistance + fs.resistor;
+
+    auto V_outer = [&](double z) {
+      double u = z / L * kFieldCageRings;
+      double R = u * kRingResistance - (u > fs.ring ? fs.MissingResistance : 0);
+      return voltage * (R / R_total - u / kFieldCageRings);
+    };
+
+    Reference reference(zero, zero, V_outer, L, E_0);
+    Distorter distorter(cfg, Distorter::EnabledDistortions() | Distortions::kShortedRing);
+    failed += Compare("Shorted ring", distorter, field, reference);
+    failed += CheckDirection("Shorted ring", distorter, field, 190, 100, +1);
+
+    // The short is on the west side
+    Coords p{190, 0, -100};
+    Coords q = distorter.Distort(p, 21, field);
+
+    if (q.x != p.x || q.y != p.y) {
+      std::cerr << "Shorted ring: Displacement on the east side\n";
+      failed++;
+    }
+  }
+
+  // The grid leak sheets are left out as they are narrower than the table
+  // step
+  {
+    Configurator cfg_field("test_distorter_field", "test_distorter_field.yaml");
+    MagField mapped(cfg_field, MagField::MagFieldType::kMapped, 1.0);
+
+    failed += CheckTable(cfg_field, mapped, Distorter::EnabledDistortions() | Distortions::kMagneticField, 0.02);
+    failed += CheckTable(cfg_field, mapped, Distorter::EnabledDistortions() | Distortions::kMagneticField |
+                         Distortions::kSpaceCharge | Distortions::kShortedRing, 0.05);
+  }
+
+  return failed;
+}
@@ -0,0 +1,67 @@
+#include <iostream>
+
+#include "tpcrs/detail/distorter.h"
+
+using Distortions = tpcrs::detail::Distorter::Distortions;
+using EnabledDistortions = tpcrs::detail::Distorter::EnabledDistortions;
+
+
+/**
+ * Checks that the sets built with the bitwise operators contain exactly the
+ * enumerators combined with them.
+ */
+int main()
+{
+  const Distortions all[] = {
+    Distortions::kMagneticField, Distortions::kSpaceCharge, Distortions::kSpaceChargeR2,
+    Distortions::kGridLeak, Distortions::kShortedRing, Distortions::kSpaceChargeGridLeak
+  };
+
+  int failed = 0;
+
+  auto expect = [&failed, &all](const char* name, const EnabledDistortions& set, std::initializer_list<Distortions> enabled)
+  {
+    for (Distortions d : all) {
+      bool expected = false;
+      for (Distortions e : enabled) expected = expected || e == d;
+
+      if (set.test(d) != expected) {
+        std::cerr << name << ": test(" << static_cast<unsigned>(d) << ") is " << set.test(d) << '\n';
+        failed++;
+      }
+    }
+  };
+
+  EnabledDistortions none;
+  expect("Default", none, {});
+
+  if (none || none.any() || !none.none()) {
+    std::cerr << "Default: Set is not empty\n";
+    failed++;
+  }
+
+  EnabledDistortions pair = Distortions::kMagneticField | Distortions::kSpaceCharge;
+  expect("Enum | Enum", pair, {Distortions::kMagneticField, Distortions::kSpaceCharge});
+
+  EnabledDistortions triple = pair | Distortions::kShortedRing;
+  expect("BitSet | Enum", triple, {Distortions::kMagneticField, Distortions::kSpaceCharge, Distortions::kShortedRing});
+
+  EnabledDistortions assigned;
+  assigned |= Distortions::kGridLeak;
+  assigned |= Distortions::kSpaceChargeGridLeak;
+  expect("|=", assigned, {Distortions::kGridLeak, Distortions::kSpaceChargeGridLeak});
+
+  EnabledDistortions set;
+  set.set(Distortions::kSpaceChargeR2);
+  set.set(Distortions::kGridLeak);
+  set.unset(Distortions::kGridLeak);
+  expect("set/unset", set, {Distortions::kSpaceChargeR2});
+
+  expect("Enum & Enum", Distortions::kGridLeak & Distortions::kGridLeak, {Distortions::kGridLeak});
+  expect("Enum & other Enum", Distortions::kGridLeak & Distortions::kShortedRing, {});
+  expect("BitSet & Enum", triple & Distortions::kSpaceCharge, {Distortions::kSpaceCharge});
+  expect("Enum ^ Enum", Distortions::kGridLeak ^ Distortions::kShortedRing, {Distortions::kGridLeak, Distortions::kShortedRing});
+  expect("BitSet ^ Enum", triple ^ Distortions::kSpaceCharge, {Distortions::kMagneticField, Distortions::kShortedRing});
+
+  return failed;
+}
@@ -0,0 +1,75 @@
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/detail/field_map.h"
+
+using tpcrs::detail::FieldMap;
+
+
+namespace {
+
+/// Returns 1 if the maps have different grids or field values
+int CompareMaps(const std::string& name, const FieldMap& a, const FieldMap& b)
+{
+  if (a.n_r() != b.n_r() || a.n_z() != b.n_z() || a.n_phi() != b.n_phi() || a.n_components() != b.n_components()) {
+    std::cerr << name << ": The grids differ\n";
+    return 1;
+  }
+
+  bool same = std::memcmp(a.r(), b.r(), a.n_r() * sizeof(float)) == 0 &&
+              std::memcmp(a.z(), b.z(), a.n_z() * sizeof(float)) == 0 &&
+              std::memcmp(a.phi(), b.phi(), a.n_phi() * sizeof(float)) == 0 &&
+              std::memcmp(a.B(0, 0, 0), b.B(0, 0, 0), a.n_phi() * a.n_z() * a.n_r() * a.n_components() * sizeof(float)) == 0;
+
+  if (!same) {
+    std::cerr << name << ": The values differ\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+}
+
+
+/**
+ * Checks that the binary field maps generated at build time are found on the
+ * configuration search path and hold the same values as the text maps they
+ * were converted from.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  tpcrs::Configurator cfg(cfgname);
+
+  int failed = 0;
+
+  for (std::string name : {"bfield_full_negative_2D", "bfield_full_negative_3D", "bfield_full_positive_2D",
+                           "bfield_full_positive_3D", "const_full_positive_2D"}) {
+    std::string bin_path = cfg.Locate(name + ".bin");
+    std::string dat_path = cfg.Locate(name + ".dat");
+
+    if (bin_path.empty() || dat_path.empty()) {
+      std::cerr << name << ": Cannot find the binary or the text map\n";
+      failed++;
+      continue;
+    }
+
+    std::unique_ptr<FieldMap> binary = FieldMap::ReadBinary(bin_path);
+    std::unique_ptr<FieldMap> text = FieldMap::ReadText(dat_path);
+
+    if (!binary || !text) {
+      std::cerr << name << ": Cannot read the binary or the text map\n";
+      failed++;
+      continue;
+    }
+
+    failed += CompareMaps(name, *text, *binary);
+  }
+
+  return failed;
+}
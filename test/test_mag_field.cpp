@@ -0,0 +1,81 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/tpcrs.h"
+#include "tpcrs/detail/coords.h"
+#include "tpcrs/detail/cpu_features.h"
+
+using namespace tpcrs::detail;
+
+
+/**
+ * Evaluates the 3D field map at random points inside and around the TPC with
+ * the public batch functions taking arrays of points and separate arrays of
+ * components, using the vectorized and the scalar kernels. All results must be
+ * identical to those of the single point function.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  tpcrs::Configurator cfg(cfgname);
+  tpcrs::MagField mag_field(cfg);
+
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<float> uniform(-1, 1);
+
+  // The number of points is not a multiple of the batch size. The first point
+  // is on the axis
+  size_t n = 1001;
+  std::vector<float> x(n), y(n), z(n);
+
+  for (size_t i = 1; i < n; i++) {
+    x[i] = 220 * uniform(gen);
+    y[i] = 220 * uniform(gen);
+    z[i] = 260 * uniform(gen);
+  }
+
+  std::vector<float> expected(3 * n);
+
+  for (size_t i = 0; i < n; i++) {
+    float point[3] = {x[i], y[i], z[i]};
+    mag_field.ValueAt3D(point, &expected[3 * i]);
+  }
+
+  int failed = 0;
+
+  for (Simd simd : {Simd::kScalar, Simd::kAvx512}) {
+    SetMaxSimd(simd);
+
+    std::vector<float> Bx(n), By(n), Bz(n);
+    mag_field.ValueAt3D(n, x.data(), y.data(), z.data(), Bx.data(), By.data(), Bz.data());
+
+    std::vector<Coords> points(n), values(n);
+
+    for (size_t i = 0; i < n; i++)
+      points[i] = Coords{x[i], y[i], z[i]};
+
+    mag_field.ValueAt3D(points.data(), n, values.data());
+
+    for (size_t i = 0; i < n; i++) {
+      const float* B = &expected[3 * i];
+
+      bool same_soa = Bx[i] == B[0] && By[i] == B[1] && Bz[i] == B[2];
+      bool same_aos = values[i].x == B[0] && values[i].y == B[1] && values[i].z == B[2];
+
+      if (!same_soa || !same_aos) {
+        if (failed++ < 10)
+          std::cerr << "Mismatch at (" << x[i] << ", " << y[i] << ", " << z[i] << "): (" << B[0] << ", " << B[1]
+                    << ", " << B[2] << ") vs (" << Bx[i] << ", " << By[i] << ", " << Bz[i] << ") and ("
+                    << values[i].x << ", " << values[i].y << ", " << values[i].z << ")\n";
+      }
+    }
+  }
+
+  std::cout << "AVX2: " << HasAvx2() << ", AVX-512: " << HasAvx512() << '\n';
+
+  return failed;
+}
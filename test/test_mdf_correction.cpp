@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/detail/struct_containers.h"
+
+using tpcrs::Configurator;
+
+
+/**
+ * Replaces the pad MDF correction with polynomials of every type in one and
+ * two variables and checks that the tabulated parameterization matches the
+ * polynomial at the grid nodes and stays close to it between them.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+
+  const int n_rows = 6;
+  YAML::Node rows;
+
+  for (int k = 0; k < n_rows; k++) {
+    MDFCorrection row{};
+    row.idx = k + 1;
+    row.nrows = n_rows;
+    row.PolyType = k % 3;
+    row.NVariables = 1 + k / 3;
+    row.NCoefficients = 12;
+    row.DMean = 0.1 * uniform(gen);
+    row.XMin[0] = -0.5;
+    row.XMax[0] =  0.5;
+    row.XMin[1] =  0;
+    row.XMax[1] = 30;
+
+    // Powers up to 4 in each variable, 1 is the constant
+    for (int i = 0; i < row.NCoefficients; i++) {
+      for (int j = 0; j < row.NVariables; j++)
+        row.Power[i * row.NVariables + j] = 1 + (i / (j ? 4 : 1)) % 4;
+
+      row.Coefficients[i] = 0.05 * uniform(gen);
+      row.CoefficientsRMS[i] = 0.01;
+    }
+
+    rows.push_back(row);
+  }
+
+  YAML::Node delta;
+  delta[St_TpcPadCorrectionMDF::name] = rows;
+
+  const std::string delta_file = "test_mdf_correction_delta.yaml";
+  std::ofstream(delta_file) << delta;
+
+  std::shared_ptr<const Configurator> base(new Configurator(cfgname));
+  Configurator cfg(base, cfgname, delta_file);
+  std::remove(delta_file.c_str());
+
+  const St_MDFCorrectionC& mdf = cfg.C<St_TpcPadCorrectionMDF>();
+
+  if (mdf.GetNRows() != n_rows) {
+    std::cerr << "Expected " << n_rows << " rows, got " << mdf.GetNRows() << '\n';
+    return 1;
+  }
+
+  int failed = 0;
+
+  for (int k = 0; k < n_rows; k++) {
+    int n_vars = mdf.NVariables(k);
+    double x_min[2] = {mdf.XMin(k)[0], n_vars > 1 ? mdf.XMin(k)[1] : 0};
+    double x_max[2] = {mdf.XMax(k)[0], n_vars > 1 ? mdf.XMax(k)[1] : 0};
+
+    // The 1D and 2D grids both have a node at every tenth of the range
+    double max_diff_nodes = 0;
+
+    for (int i = 0; i < 10; i++) {
+      for (int j = 0; j < (n_vars > 1 ? 10 : 1); j++) {
+        double x[2] = {x_min[0] + (x_max[0] - x_min[0]) * i / 10, x_min[1] + (x_max[1] - x_min[1]) * j / 10};
+        max_diff_nodes = std::max(max_diff_nodes, std::abs(mdf.Eval(k, x) - mdf.EvalPolynomial(k, x)));
+      }
+    }
+
+    // Between the nodes the linear interpolation error is of the order of
+    // the squared grid step times the second derivative
+    double max_diff = 0, max_value = 0;
+
+    for (int i = 0; i < 10000; i++) {
+      double x[2];
+
+      for (int j = 0; j < 2; j++)
+        x[j] = x_min[j] + 0.999 * (x_max[j] - x_min[j]) * (uniform(gen) + 1) / 2;
+
+      double exact = mdf.EvalPolynomial(k, x);
+      max_diff = std::max(max_diff, std::abs(mdf.Eval(k, x) - exact));
+      max_value = std::max(max_value, std::abs(exact));
+    }
+
+    if (max_diff_nodes > 1e-12) {
+      std::cerr << "Row " << k << ": The grid differs from the polynomial by " << max_diff_nodes << " at the nodes\n";
+      failed++;
+    }
+
+    if (!(max_diff < 0.02 * max_value)) {
+      std::cerr << "Row " << k << ": The interpolation differs from the polynomial by " << max_diff
+                << " for values up to " << max_value << '\n';
+      failed++;
+    }
+  }
+
+  return failed;
+}
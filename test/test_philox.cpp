@@ -0,0 +1,54 @@
+#include <iostream>
+
+#include "tpcrs/detail/philox.h"
+
+using tpcrs::detail::Philox;
+
+
+/**
+ * Compares Philox4x32-10 with the known-answer vectors published with the
+ * Random123 library and checks that the TRandom interface sets the key.
+ */
+int main()
+{
+  struct Vector {
+    Philox::Block counter;
+    Philox::Key key;
+    Philox::Block expected;
+  };
+
+  const Vector vectors[] = {
+    {{0x00000000, 0x00000000, 0x00000000, 0x00000000}, {0x00000000, 0x00000000},
+     {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+    {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff},
+     {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+    {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0},
+     {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}
+  };
+
+  int failed = 0;
+
+  for (const Vector& v : vectors) {
+    if (Philox::Generate(v.counter, v.key) != v.expected) {
+      std::cerr << "Philox4x32-10 does not match the known answer for counter " << std::hex << v.counter[0] << '\n';
+      failed++;
+    }
+  }
+
+  // A seed set via the TRandom interface must give the same stream as SetKey
+  Philox a(1), b(2);
+  TRandom& random = b;
+  random.SetSeed(1);
+  a.SetStream(3, 4, 5);
+  b.SetStream(3, 4, 5);
+
+  for (int i = 0; i < 16; i++) {
+    if (a.Next() != b.Next()) {
+      std::cerr << "TRandom::SetSeed does not set the Philox key\n";
+      failed++;
+      break;
+    }
+  }
+
+  return failed;
+}
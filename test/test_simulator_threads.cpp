@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/tpcrs.h"
+
+#include "simulated_hits.h"
+
+using tpcrs::test::CountDifferences;
+using tpcrs::test::GenerateHits;
+
+
+/**
+ * Digitizes the same hits with one and with several threads and checks that
+ * the output is identical, with the counter-based generator and without an
+ * explicit context. The hits of the tracks in the same sector are not
+ * adjacent in the unsorted input.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  tpcrs::Configurator cfg(cfgname);
+  tpcrs::MagField mag_field(cfg);
+
+  std::vector<tpcrs::SimulatedHit> unsorted = GenerateHits(cfg);
+  std::vector<tpcrs::SimulatedHit> sorted = unsorted;
+  std::stable_sort(begin(sorted), end(sorted));
+
+  tpcrs::Simulator::Options serial_options;
+  tpcrs::Simulator::Options parallel_options;
+  parallel_options.n_threads = 4;
+
+  tpcrs::Simulator serial(cfg, serial_options);
+  tpcrs::Simulator parallel(cfg, parallel_options);
+
+  int failed = 0;
+
+  for (const std::vector<tpcrs::SimulatedHit>* hits : {&unsorted, &sorted}) {
+    std::vector<tpcrs::DigiHit> expected, digi_data;
+
+    tpcrs::Simulator::Context serial_context(2345);
+    serial.Digitize(hits->begin(), hits->end(), std::back_inserter(expected), mag_field, serial_context);
+
+    tpcrs::Simulator::Context parallel_context(2345);
+    parallel.Digitize(hits->begin(), hits->end(), std::back_inserter(digi_data), mag_field, parallel_context);
+
+    failed += CountDifferences(expected, digi_data);
+
+    // The implicit contexts use the sequential generator
+    expected.clear();
+    digi_data.clear();
+
+    serial.Digitize(hits->begin(), hits->end(), std::back_inserter(expected), mag_field);
+    parallel.Digitize(hits->begin(), hits->end(), std::back_inserter(digi_data), mag_field);
+
+    failed += CountDifferences(expected, digi_data);
+  }
+
+  return failed;
+}
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/tpcrs.h"
+
+#include "simulated_hits.h"
+
+using tpcrs::test::CountDifferences;
+using tpcrs::test::GenerateHits;
+
+
+/**
+ * Updates a simulator to a configuration with a different response and checks
+ * that it digitizes the same hits as a simulator created with that
+ * configuration, with and without a cache of the response tables.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  std::shared_ptr<const tpcrs::Configurator> base(new tpcrs::Configurator(cfgname));
+
+  // The pad response depends on K3IR and K3OR
+  YAML::Node delta;
+
+  TpcResponseSimulator response = base->S<TpcResponseSimulator>();
+  response.K3IR *= 0.8;
+  response.K3OR *= 1.25;
+  delta[tpcrs::ConfigNodeName<TpcResponseSimulator>()] = response;
+
+  const std::string delta_file = "test_simulator_update_delta.yaml";
+  std::ofstream(delta_file) << delta;
+
+  tpcrs::Configurator cfg(base, cfgname, delta_file);
+  std::remove(delta_file.c_str());
+
+  tpcrs::MagField mag_field(cfg);
+
+  std::vector<tpcrs::SimulatedHit> hits = GenerateHits(cfg);
+
+  auto digitize = [&](const tpcrs::Simulator& simulator)
+  {
+    tpcrs::Simulator::Context context(2345);
+    std::vector<tpcrs::DigiHit> digi_data;
+    simulator.Digitize(std::begin(hits), std::end(hits), std::back_inserter(digi_data), mag_field, context);
+    return digi_data;
+  };
+
+  std::vector<tpcrs::DigiHit> expected = digitize(tpcrs::Simulator(cfg));
+
+  if (expected.empty()) {
+    std::cerr << "No hits digitized\n";
+    return 1;
+  }
+
+  int failed = 0;
+
+  // The update must not depend on whether the tables of the base
+  // configuration were restored from the cache
+  const std::string cache_dir = "test_simulator_update_cache";
+  mkdir(cache_dir.c_str(), 0755);
+
+  for (const std::string& dir : {std::string(), cache_dir}) {
+    tpcrs::Simulator::Options options;
+    options.cache_dir = dir;
+
+    // The second simulator with the base configuration maps the cache
+    for (int i = 0; i < (dir.empty() ? 1 : 2); i++) {
+      tpcrs::Simulator updated(*base, options);
+      updated.Update(cfg);
+      failed += CountDifferences(expected, digitize(updated));
+    }
+  }
+
+  if (DIR* dir = opendir(cache_dir.c_str())) {
+    while (dirent* entry = readdir(dir))
+      std::remove((cache_dir + '/' + entry->d_name).c_str());
+
+    closedir(dir);
+  }
+
+  rmdir(cache_dir.c_str());
+
+  return failed;
+}
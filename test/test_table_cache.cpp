@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+
+#include "tpcrs/detail/binned_table.h"
+#include "tpcrs/detail/table_cache.h"
+
+using tpcrs::detail::BinnedTable;
+using tpcrs::detail::TableCache;
+
+
+/**
+ * Writes values and a binned table to a cache file and checks that the mapped
+ * file gives them back unchanged, and that a file with another key, a
+ * truncated file, and a missing file are rejected.
+ */
+int main()
+{
+  const std::string path = "test_table_cache.bin";
+  const uint64_t key = TableCache::Hash("test_table_cache");
+
+  TH1D hist("hist", "", 7, -1, 2.5);
+  hist.SetDirectory(nullptr);
+
+  for (int i = 1; i <= 7; i++)
+    hist.SetBinContent(i, i * i % 5 + 0.25);
+
+  BinnedTable table(hist);
+
+  std::vector<double> values = {0, -1.5, 1e-300, 3.141592653589793, 42};
+  table.Store(values);
+
+  int failed = 0;
+
+  if (!TableCache::Write(path, key, values)) {
+    std::cerr << "Cannot write " << path << '\n';
+    return 1;
+  }
+
+  {
+    TableCache cache(path, key);
+
+    const double* head = cache.Read(5);
+
+    if (!cache.valid() || !head || std::memcmp(head, values.data(), 5 * sizeof(double)) != 0) {
+      std::cerr << "The values read from the cache differ from the written ones\n";
+      failed++;
+    }
+
+    BinnedTable restored;
+
+    if (!restored.Restore(cache) || restored.n_bins() != table.n_bins()) {
+      std::cerr << "Cannot restore the binned table\n";
+      failed++;
+    }
+    else {
+      for (int i = 0; i < table.n_bins(); i++) {
+        if (restored.content(i) != table.content(i) || restored.low_edge(i) != table.low_edge(i) ||
+            restored.width(i) != table.width(i)) {
+          std::cerr << "Bin " << i << " of the restored table differs\n";
+          failed++;
+        }
+      }
+    }
+
+    double x;
+
+    if (cache.Read(x) || cache.Read(1)) {
+      std::cerr << "Read past the end of the cache\n";
+      failed++;
+    }
+  }
+
+  if (TableCache(path, key + 1).valid()) {
+    std::cerr << "A cache with another key is accepted\n";
+    failed++;
+  }
+
+  // Drop the last value
+  {
+    std::vector<char> bytes;
+    FILE* file = std::fopen(path.c_str(), "rb");
+
+    for (int c; (c = std::fgetc(file)) != EOF; )
+      bytes.push_back(c);
+
+    std::fclose(file);
+
+    const std::string truncated_path = "test_table_cache_truncated.bin";
+    file = std::fopen(truncated_path.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size() - sizeof(double), file);
+    std::fclose(file);
+
+    if (TableCache(truncated_path, key).valid()) {
+      std::cerr << "A truncated cache is accepted\n";
+      failed++;
+    }
+
+    std::remove(truncated_path.c_str());
+  }
+
+  std::remove(path.c_str());
+
+  if (TableCache(path, key).valid()) {
+    std::cerr << "A missing cache is accepted\n";
+    failed++;
+  }
+
+  return failed;
+}
@@ -0,0 +1,114 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TF1.h"
+
+#include "tpcrs/configurator.h"
+#include "tpcrs/detail/struct_containers.h"
+
+using tpcrs::Configurator;
+
+
+/**
+ * Replaces the pressure correction with rows of the gaus+polN and expo+polN
+ * series and checks them against the ROOT formulas they replace. The batch
+ * evaluation must give the same values as the single one, and a Gaussian with
+ * zero sigma must be 1e30 as with TMath::Gaus.
+ */
+int main(int argc, char **argv)
+{
+  std::string cfgname = argc > 1 ? argv[1] : "starY16_dAu200";
+
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+
+  const int types[] = {1000, 1100, 1200, 1300, 2000, 2100, 2200, 2300};
+  const int n_types = sizeof(types) / sizeof(types[0]);
+
+  // The last row is a Gaussian with zero sigma
+  const int n_rows = n_types + 1;
+  std::vector<tpcCorrection> rows(n_rows);
+
+  for (int i = 0; i < n_rows; i++) {
+    tpcCorrection& row = rows[i];
+    row.type = i < n_types ? types[i] : 1100;
+    row.idx = i + 1;
+    row.nrows = n_rows;
+    row.npar = row.type % 1000 / 100 + (row.type < 2000 ? 4 : 3);
+
+    for (int j = 0; j < 10; j++)
+      row.a[j] = 0.5 * uniform(gen);
+
+    if (row.type < 2000) row.a[2] = i < n_types ? 0.2 + 0.3 * (uniform(gen) + 1) : 0;
+  }
+
+  YAML::Node node;
+  for (const tpcCorrection& row : rows)
+    node.push_back(row);
+
+  YAML::Node delta;
+  delta[St_tpcPressureBC::name] = node;
+
+  const std::string delta_file = "test_tpc_correction_delta.yaml";
+  std::ofstream(delta_file) << delta;
+
+  std::shared_ptr<const Configurator> base(new Configurator(cfgname));
+  Configurator cfg(base, cfgname, delta_file);
+  std::remove(delta_file.c_str());
+
+  const St_tpcCorrectionC& correction = cfg.C<St_tpcPressureBC>();
+
+  if (correction.GetNRows() != n_rows) {
+    std::cerr << "Expected " << n_rows << " rows, got " << correction.GetNRows() << '\n';
+    return 1;
+  }
+
+  std::vector<double> x(1000);
+  for (double& xi : x)
+    xi = 2 * uniform(gen);
+
+  int failed = 0;
+
+  for (int i = 0; i < n_rows; i++) {
+    const tpcCorrection& row = rows[i];
+    int n = row.type % 1000 / 100;
+
+    std::string formula = (row.type < 2000 ? "gaus+pol" : "expo+pol") + std::to_string(n) +
+                          (row.type < 2000 ? "(3)" : "(2)");
+    TF1 func(("f" + std::to_string(row.type)).c_str(), formula.c_str());
+    func.SetParameters(row.a);
+
+    std::vector<double> batch(x.size());
+    correction.CalcCorrection(i, x.data(), batch.data(), x.size());
+
+    int n_bad = 0;
+
+    for (size_t j = 0; j < x.size(); j++) {
+      double value = correction.CalcCorrection(i, x[j]);
+      double pol = 0;
+
+      for (int k = n; k >= 0; k--)
+        pol = pol * x[j] + row.a[k + 3];
+
+      double expected = i < n_types ? func.Eval(x[j]) : row.a[0] * 1.e30 + pol;
+
+      bool close = std::abs(value - expected) <= 1e-12 * std::max(1., std::abs(expected));
+
+      if (!close || batch[j] != value) {
+        if (n_bad++ < 5)
+          std::cerr << formula << (i < n_types ? "" : " with zero sigma") << " at " << x[j] << ": " << value
+                    << " vs " << expected << " (batch " << batch[j] << ")\n";
+      }
+    }
+
+    failed += n_bad;
+  }
+
+  return failed;
+}
@@ -0,0 +1,29 @@
+/**
+ * Converts a yaml configuration to the binary snapshot memory-mapped by the
+ * Configurator. A snapshot is loaded by passing its path with the .bin
+ * extension to the Configurator in place of the yaml file.
+ *
+ * Usage: tpcrs-config2bin starY16_dAu200.yaml starY16_dAu200.bin
+ */
+
+#include <exception>
+#include <iostream>
+
+#include "tpcrs/configurator.h"
+
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.bin>\n";
+    return 1;
+  }
+
+  try {
+    tpcrs::Configurator cfg(argv[1], argv[1]);
+    return cfg.WriteSnapshot(argv[2]) ? 0 : 1;
+  } catch (std::exception& e) {
+    std::cerr << "Cannot convert configuration " << argv[1] << ": " << e.what() << '\n';
+    return 1;
+  }
+}
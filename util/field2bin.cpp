@@ -0,0 +1,29 @@
+/**
+ * Converts a magnetic field map from the text .dat format to the binary format
+ * memory-mapped by the library. A binary map found in the search paths is
+ * preferred over the text map with the same name.
+ *
+ * Usage: tpcrs-field2bin bfield_full_positive_3D.dat bfield_full_positive_3D.bin
+ */
+
+#include <iostream>
+
+#include "tpcrs/detail/field_map.h"
+
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <input.dat> <output.bin>\n";
+    return 1;
+  }
+
+  std::unique_ptr<tpcrs::detail::FieldMap> map = tpcrs::detail::FieldMap::ReadText(argv[1]);
+
+  if (!map) {
+    std::cerr << "Cannot read field map " << argv[1] << '\n';
+    return 1;
+  }
+
+  return map->WriteBinary(argv[2]) ? 0 : 1;
+}
@@ -39,6 +39,7 @@ from __future__ import print_function
 import json
 import sys
 import re
+import zlib
 
 # This is not required if you've installed pycparser into
 # your site-packages/ with setup.py
@@ -315,13 +316,52 @@ def generate_yamlcpp(ast_dict, pre=None):
     return inspect.cleandoc(cxx_code)
 
 
+def generate_binary_codec(ast_dict):
+    """Generates c++ code identifying the layout of C structures stored in
+    binary configuration snapshots. The version is the CRC-32 of the member
+    declarations and changes with the names, types, or dimensions of the members
+    """
+
+    # Skip header files without the proper struct
+    if not ast_dict['ext'] or not len(ast_dict['ext']):
+       return ""
+
+    members = ""
+
+    for decl in extract_decls(ast_dict):
+        if not decl.name or not decl.type: continue
+
+        members += f"{decl.type} {decl.name}" + "".join(f"[{dim}]" for dim in decl.dims) + ";"
+
+    struct_name = ast_dict['ext'][0]['type']['name']
+    # Pop the last three charasters "_st"
+    header_name = struct_name[:-3]
+
+    cxx_code = """
+    #include "%(header_name)s.h"
+
+    namespace tpcrs {
+    template<>
+    struct BinaryCodec<%(struct_name)s> {
+      static uint32_t version() { return 0x%(version)08x; }
+    };
+    }
+    """ % {'header_name': header_name, 'struct_name': struct_name,
+           'version': zlib.crc32(members.encode())}
+
+    import inspect
+    return inspect.cleandoc(cxx_code)
+
+
 #------------------------------------------------------------------------------
 if __name__ == "__main__":
+    binary = len(sys.argv) > 2 and sys.argv[1] == "--binary"
+
     if len(sys.argv) > 1:
         # Some test code...
         # Do trip from C -> ast -> dict -> ast -> json, then print.
-        ast_dict = file_to_dict(sys.argv[1])
-        cxx_code = generate_yamlcpp(ast_dict)
+        ast_dict = file_to_dict(sys.argv[-1])
+        cxx_code = generate_binary_codec(ast_dict) if binary else generate_yamlcpp(ast_dict)
         print(cxx_code)
     else:
-        print("Please provide a filename as argument")
+        print("Please provide a filename as argument: [--binary] <header>")